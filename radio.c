@@ -6,231 +6,1340 @@
  */
 
 //----------------------------------------------------------------------------
+#ifdef RADIO_BITS_CPU
+#  define _GNU_SOURCE // pthread_setaffinity_np(), CPU_SET()
+#endif
 #include "radio.h"
-#include "spi.h"      // `spi_t`
-#include "sgpio.h"    // `sgpio_t`
+#include "sx127x_def.h" // REG_FIFO
 #include "stimer.h"   // stimer_sleep_ms()
 #include "vsthread.h" // `vsthread.h`
 #include <stdio.h>    // printf()
-#include <stdlib.h>   // exit(), EXIT_SUCCESS, EXIT_FAILURE
+#include <stdlib.h>   // malloc(), free(), qsort()
+#include <string.h>   // memset()
+#include <errno.h>    // EINTR
+#include <time.h>     // clock_gettime()
+#include <unistd.h>   // read(), write(), close()
+#include <poll.h>     // poll()
+#include <sys/eventfd.h> // eventfd()
+#include <sys/timerfd.h> // timerfd_create(), timerfd_settime()
 //----------------------------------------------------------------------------
-sx127x_t radio;
 int radio_stop = 0;
 //----------------------------------------------------------------------------
-static spi_t spi;
+// IRQ dispatcher: one thread waits DIO lines of all attached modules
+// in one wait context and routes edges to `sx127x_t` of each module
+static sgpio_wait_t radio_wait;        // shared wait context
+static radio_t *radio_list[RADIO_MAX]; // attached modules (index - slot)
+static int radio_count = 0;            // number of attached modules
+static int radio_thread_on = 0;        // 1 - IRQ thread is created
 static vsthread_t thread_irq;
+static pthread_mutex_t radio_list_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  radio_list_cond  = PTHREAD_COND_INITIALIZER;
+
+// owners of line IDs in wait context (allocated by radio_wait_add())
+typedef struct radio_line_ {
+  radio_t *radio; // module (NULL - line ID is free)
+  int dio;        // DIO line 0...5 (0 - SX127x model eventfd) or timer
+} radio_line_t;
+static radio_line_t radio_line[SGPIO_WAIT_MAX];
+
+#define RADIO_LINE_TIMER RADIO_DIO_NUM            // timerfd of module
+#define RADIO_LINE_LBT   (RADIO_DIO_NUM + 1)        // timerfd of LBT backoff
+#define RADIO_LINE_SWEEP (RADIO_DIO_NUM + 2)        // timerfd of RSSI sweep
+#define RADIO_DIO_MASK   ((1 << RADIO_DIO_NUM) - 1) // all DIO lines
+
+// SPI buses: modules on separate chip selects of one SPI device share one
+// recursive lock held over CS writes and ioctl() (and driver transactions)
+struct radio_bus_ {
+  const char *device;    // SPI device (key)
+  int users;             // number of modules on bus (0 - slot is free)
+  pthread_mutex_t mutex; // recursive bus lock
+};
+static radio_bus_t radio_bus[RADIO_MAX];
+static pthread_mutex_t radio_bus_mutex = PTHREAD_MUTEX_INITIALIZER;
+//-----------------------------------------------------------------------------
+// get default board configuration of SX127x module (RADIO_GPIO_* defines)
+void radio_cfg_default(radio_cfg_t *cfg)
+{
+  cfg->spi_device = RADIO_SPI_DEVICE;
+  cfg->spi_speed  = RADIO_SPI_SPEED;
+
+#ifdef RADIO_SPI_NATIVE_CS
+  cfg->native_cs  = 1;
+#else
+  cfg->native_cs  = 0;
+#endif
 
 #ifdef RADIO_GPIO_IRQ
-static sgpio_t gpio_irq;   // in IRQ
+  cfg->gpio_dio[0] = RADIO_GPIO_IRQ;
+#else
+  cfg->gpio_dio[0] = -1;
+#endif
+
+#ifdef RADIO_GPIO_DIO1
+  cfg->gpio_dio[1] = RADIO_GPIO_DIO1;
+#else
+  cfg->gpio_dio[1] = -1;
+#endif
+
+#ifdef RADIO_GPIO_DIO2
+  cfg->gpio_dio[2] = RADIO_GPIO_DIO2;
+#else
+  cfg->gpio_dio[2] = -1;
+#endif
+
+#ifdef RADIO_GPIO_DIO3
+  cfg->gpio_dio[3] = RADIO_GPIO_DIO3;
+#else
+  cfg->gpio_dio[3] = -1;
+#endif
+
+#ifdef RADIO_GPIO_DIO4
+  cfg->gpio_dio[4] = RADIO_GPIO_DIO4;
+#else
+  cfg->gpio_dio[4] = -1;
+#endif
+
+#ifdef RADIO_GPIO_DIO5
+  cfg->gpio_dio[5] = RADIO_GPIO_DIO5;
+#else
+  cfg->gpio_dio[5] = -1;
 #endif
 
 #ifdef RADIO_GPIO_RESET
-static sgpio_t gpio_reset; // out
+  cfg->gpio_reset = RADIO_GPIO_RESET;
+#else
+  cfg->gpio_reset = -1;
 #endif
 
 #ifdef RADIO_GPIO_CS
-static sgpio_t gpio_cs;    // out
+  cfg->gpio_cs    = RADIO_GPIO_CS;
+#else
+  cfg->gpio_cs    = -1;
 #endif
 
 #ifdef RADIO_GPIO_DATA
-static sgpio_t gpio_data;  // out
+  cfg->gpio_data  = RADIO_GPIO_DATA;
+#else
+  cfg->gpio_data  = -1;
 #endif
 
 #ifdef RADIO_GPIO_LED
-static sgpio_t gpio_led;   // out
+  cfg->gpio_led   = RADIO_GPIO_LED;
+#else
+  cfg->gpio_led   = -1;
 #endif
+}
 //-----------------------------------------------------------------------------
 // on/off DATA line
-void radio_data_on(bool on)
+void radio_data_on(radio_t *self, bool on)
 {
-#ifdef RADIO_GPIO_DATA
-  sgpio_set(&gpio_data, on ? 1 : 0);
-#endif
+  if (self->cfg.gpio_data >= 0)
+    sgpio_lines_set(&self->gpio_data, 1, on ? 1 : 0);
 }
 //-----------------------------------------------------------------------------
 // on/off LED
-void radio_led_on(bool on)
+void radio_led_on(radio_t *self, bool on)
 {
-#ifdef RADIO_GPIO_LED
-  sgpio_set(&gpio_led, on ? 1 : 0);
-#endif
+  if (self->cfg.gpio_led >= 0)
+    sgpio_set(&self->gpio_led, on ? 1 : 0);
 }
 //-----------------------------------------------------------------------------
 // blink LED
-void radio_blink_led()
+void radio_blink_led(radio_t *self)
 {
-#ifdef RADIO_GPIO_LED
-  radio_led_on(true);
-  stimer_sleep_ms(100.);
-  radio_led_on(false);
-  stimer_sleep_ms(20.);
-#else
-  printf("RADIO: radio_blink_led()\n");
-#endif
+  if (self->cfg.gpio_led >= 0)
+  {
+    radio_led_on(self, true);
+    stimer_sleep_ms(100.);
+    radio_led_on(self, false);
+    stimer_sleep_ms(20.);
+  }
+  else
+    printf("RADIO: radio_blink_led()\n");
 }
 //-----------------------------------------------------------------------------
-// crystall select for SX127X chip
-static void radio_spi_cs(bool cs)
+// crystall select for SX127X chip (write GPIO only if level changed)
+static void radio_spi_cs(radio_t *self, bool cs)
 {
-#ifdef RADIO_GPIO_CS
-  sgpio_set(&gpio_cs, cs ? 0 : 1);
+  int level = cs ? 0 : 1;
+  if (self->cs == RADIO_CS_NATIVE || level == self->gpio_cs_level) return;
+  sgpio_set(&self->gpio_cs, level);
+  self->gpio_cs_level = level;
+  self->stat.syscalls++; // write()
+}
+//-----------------------------------------------------------------------------
+// export and setup CS GPIO
+static void radio_gpio_cs_init(radio_t *self)
+{
+  if (self->gpio_cs_on) return;
+  sgpio_export(self->cfg.gpio_cs);
+  sgpio_init(&self->gpio_cs, self->cfg.gpio_cs);
+  sgpio_mode(&self->gpio_cs, SGPIO_DIR_OUT_HIGH, SGPIO_EDGE_NONE); // deselect
+  self->gpio_cs_level = 1;
+  self->gpio_cs_on    = 1;
+}
+//-----------------------------------------------------------------------------
+// free and unexport CS GPIO
+static void radio_gpio_cs_free(radio_t *self)
+{
+  if (!self->gpio_cs_on) return;
+  sgpio_free(&self->gpio_cs);
+  sgpio_unexport(self->cfg.gpio_cs);
+  self->gpio_cs_level = -1;
+  self->gpio_cs_on    = 0;
+}
+//-----------------------------------------------------------------------------
+// get shared lock of SPI device (create it for first module on device)
+// (return NULL if all RADIO_MAX slots are busy)
+static radio_bus_t *radio_bus_get(const char *device)
+{
+  radio_bus_t *bus = (radio_bus_t*) NULL;
+  int i;
+
+  if (device == (const char*) NULL) device = "";
+
+  pthread_mutex_lock(&radio_bus_mutex);
+  for (i = 0; i < RADIO_MAX && bus == (radio_bus_t*) NULL; i++)
+    if (radio_bus[i].users && strcmp(radio_bus[i].device, device) == 0)
+      bus = &radio_bus[i];
+
+  for (i = 0; i < RADIO_MAX && bus == (radio_bus_t*) NULL; i++)
+    if (radio_bus[i].users == 0)
+    { // first module on SPI device (recursive: driver functions are nested)
+      pthread_mutexattr_t attr;
+      bus = &radio_bus[i];
+      bus->device = device;
+      pthread_mutexattr_init(&attr);
+      pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+      pthread_mutex_init(&bus->mutex, &attr);
+      pthread_mutexattr_destroy(&attr);
+    }
+
+  if (bus != (radio_bus_t*) NULL)
+    bus->users++;
+  pthread_mutex_unlock(&radio_bus_mutex);
+  return bus;
+}
+//-----------------------------------------------------------------------------
+// release shared lock of SPI device (destroy it after last module)
+static void radio_bus_put(radio_bus_t *bus)
+{
+  pthread_mutex_lock(&radio_bus_mutex);
+  if (--bus->users == 0)
+    pthread_mutex_destroy(&bus->mutex);
+  pthread_mutex_unlock(&radio_bus_mutex);
+}
+//-----------------------------------------------------------------------------
+// export and setup input/output GPIO (if it is connected)
+static void radio_gpio_open(sgpio_t *gpio, int num, int dir, int edge)
+{
+  if (num < 0) return;
+  if (dir == SGPIO_DIR_IN)
+    sgpio_unexport(num); // FIXME: it is important! Why?
+  sgpio_export(num);
+  sgpio_init(gpio, num);
+  sgpio_mode(gpio, dir, edge);
+}
+//-----------------------------------------------------------------------------
+// export and setup DATA output as group of lines (look radio_bits_send())
+static void radio_data_open(radio_t *self)
+{
+  if (self->cfg.gpio_data < 0) return;
+  sgpio_export(self->cfg.gpio_data);
+  sgpio_lines_init(&self->gpio_data, &self->cfg.gpio_data, 1, SGPIO_DIR_OUT);
+}
+//-----------------------------------------------------------------------------
+// free and unexport DATA output (if it is connected)
+static void radio_data_close(radio_t *self)
+{
+  if (self->cfg.gpio_data < 0) return;
+  sgpio_lines_free(&self->gpio_data);
+  sgpio_unexport(self->cfg.gpio_data);
+}
+//-----------------------------------------------------------------------------
+// free and unexport GPIO (if it is connected)
+static void radio_gpio_close(sgpio_t *gpio, int num)
+{
+  if (num < 0) return;
+  sgpio_free(gpio);
+  sgpio_unexport(num);
+}
+//-----------------------------------------------------------------------------
+// pulse RESET line of SX127x radio module (driver state is not touched)
+static void radio_hw_reset(radio_t *self)
+{
+  if (self->cfg.gpio_reset >= 0)
+  {
+    sgpio_set(&self->gpio_reset, 1);
+    stimer_sleep_ms(100.);
+    sgpio_set(&self->gpio_reset, 0);
+    stimer_sleep_ms(100.);
+    sgpio_set(&self->gpio_reset, 1);
+    stimer_sleep_ms(100.);
+  }
+
+#ifdef RADIO_SIM
+  sx127x_sim_reset(&self->sim);
 #endif
 }
 //-----------------------------------------------------------------------------
-// hard reset SX127x radio module
-void radio_reset()
+// hard reset SX127x radio module (after sx127x_init())
+void radio_reset(radio_t *self)
 {
   printf("RADIO: radio_reset()\n");
 
-#ifdef RADIO_GPIO_RESET
-  sgpio_set(&gpio_reset, 1);
-  stimer_sleep_ms(100.);
-  sgpio_set(&gpio_reset, 0);
-  stimer_sleep_ms(100.);
-  sgpio_set(&gpio_reset, 1);
-  stimer_sleep_ms(100.);
+  radio_hw_reset(self);
+
+#ifdef SX127X_USE_CACHE
+  // all registers are reset to defaults: invalidating is not enough
+  // if cache was on before, so reload it from chip by one SPI burst
+  sx127x_cache_sync(self->sx);
+#endif
+}
+//----------------------------------------------------------------------------
+// get current time [ns] by CLOCK_MONOTONIC (same clock as edge timestamps)
+static u64_t radio_time_ns()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((u64_t) ts.tv_sec) * 1000000000ULL + (u64_t) ts.tv_nsec;
+}
+//----------------------------------------------------------------------------
+#ifndef RADIO_SIM
+// read all pending edge events of input GPIO
+// (return bit mask of found edges: 1 - rising, 2 - falling,
+//  `ns` - timestamp of last rising edge)
+static int radio_gpio_edge(sgpio_t *gpio, u64_t *ns)
+{
+  sgpio_event_t ev[SGPIO_EVENTS_MAX];
+  int i, n, edges = 0;
+
+  do {
+    n = sgpio_events(gpio, ev, SGPIO_EVENTS_MAX);
+    for (i = 0; i < n; i++)
+    {
+      if (ev[i].edge == SGPIO_EDGE_RISING)
+      {
+        *ns = (u64_t) ev[i].ns;
+        edges |= 1;
+      }
+      else
+        edges |= 2;
+    }
+  } while (n == SGPIO_EVENTS_MAX);
+
+  return edges;
+}
+//----------------------------------------------------------------------------
+// check that falling edge on DIO1 is interrupt (FSK/OOK FIFO events)
+static bool radio_dio1_falling(const radio_t *self)
+{
+#ifdef SX127X_USE_DIO
+  int event = sx127x_dio_event(self->sx, 1);
+  return event == SX127X_EV_FIFO_LEVEL ||
+         event == SX127X_EV_FIFO_EMPTY ||
+         event == SX127X_EV_FIFO_FULL;
+#else
+  return true; // DIO1 is used only by FSK/OOK streaming
 #endif
 }
+#endif // !RADIO_SIM
 //----------------------------------------------------------------------------
-// IRQ waiting thread
+// read edge events of module lines ready in wait context
+// (`ready` and return bit mask: 1 << N - DIO line N)
+static int radio_irq_events(radio_t *self, int ready)
+{
+#ifdef RADIO_SIM
+  // DIO events of SX127x model by eventfd (timestamp on wake-up)
+  if (ready & 1)
+  {
+    u64_t ns = radio_time_ns();
+    int i;
+    for (i = 0; i < RADIO_DIO_NUM; i++)
+      self->irq_ns[i] = ns;
+    return sx127x_sim_events(&self->sim); // SX127X_SIM_DIO0...DIO5
+  }
+  return 0;
+#else
+  // read edge events (cdev: kernel timestamps, sysfs: level, clear POLLPRI)
+  int i, edges;
+  for (i = 0; i < RADIO_DIO_NUM; i++)
+  {
+    if ((ready & (1 << i)) == 0) continue;
+
+    edges = radio_gpio_edge(&self->gpio_dio[i], &self->irq_ns[i]);
+    if (i == 1 && (edges & 2) && radio_dio1_falling(self))
+      edges |= 1; // falling edge on DIO1 is interrupt too
+
+    if ((edges & 1) == 0)
+      ready &= ~(1 << i); // no interrupt on line
+  }
+
+  return ready;
+#endif // RADIO_SIM
+}
+//----------------------------------------------------------------------------
+// route DIO interrupts to `sx127x_t` object of module
+// (DIO1...DIO5 before DIO0: `ValidHeader` etc. come before `RxDone`)
+static void radio_irq_dispatch(radio_t *self, int dio)
+{
+#ifdef SX127X_USE_DIO
+  int i;
+  for (i = 1; i <= RADIO_DIO_NUM; i++)
+  {
+    int n = i % RADIO_DIO_NUM; // DIO1, ..., DIO5, DIO0
+    if (dio & (1 << n))
+    {
+      sx127x_irq_time(self->sx, self->irq_ns[n]); // for on_receive_ex()
+      sx127x_dio_handler(self->sx, n); // event is known by mapping
+    }
+  }
+#else
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_STREAM)
+  if (dio & 2) // `FifoLevel`/`FifoEmpty` on DIO1 (flags are checked)
+    sx127x_dio1_handler(self->sx);
+#endif
+  if (dio & 1) // rising edge on DIO0
+  {
+    sx127x_irq_time(self->sx, self->irq_ns[0]); // for on_receive_ex()
+    sx127x_irq_handler(self->sx);
+  }
+#endif // SX127X_USE_DIO
+}
+//----------------------------------------------------------------------------
+#if defined(SX127X_USE_QUEUE) && defined(SX127X_USE_LBT)
+// LBT timer hook: arm one-shot timerfd (called by sx127x_t under lock)
+static void radio_lbt_timer(sx127x_t *sx, u32_t delay_us, void *context)
+{
+  radio_t *self = (radio_t*) context;
+  struct itimerspec its;
+  its.it_interval.tv_sec  = 0;
+  its.it_interval.tv_nsec = 0;
+  its.it_value.tv_sec     = delay_us / 1000000;
+  its.it_value.tv_nsec    = (delay_us % 1000000) * 1000;
+  if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0)
+    its.it_value.tv_nsec = 1; // zero value disarms timer
+  timerfd_settime(self->lbt_tfd, 0, &its, NULL);
+}
+#endif
+//----------------------------------------------------------------------------
+#if (defined(SX127X_USE_LORA)   && defined(SX127X_USE_DUTY)) || \
+    (defined(SX127X_USE_QUEUE)  && defined(SX127X_USE_LBT))  || \
+    (defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_SWEEP))
+// read expiration of ready timerfd (return 1 - expired, 0 - spurious)
+static int radio_timer_read(int tfd)
+{
+  u64_t expirations;
+  return tfd >= 0 &&
+         read(tfd, &expirations, sizeof(expirations)) == sizeof(expirations);
+}
+#endif
+//----------------------------------------------------------------------------
+// read expired timers of module ready in wait context (under
+// `radio_list_mutex`: callbacks may close timerfd by radio_rx_duty() etc.)
+// (`ready` and return bit mask: 1 << RADIO_LINE_* - expired timer)
+static int radio_timers(radio_t *self, int ready)
+{
+  int expired = 0;
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_DUTY)
+  if ((ready & (1 << RADIO_LINE_TIMER)) && radio_timer_read(self->duty_tfd))
+    expired |= 1 << RADIO_LINE_TIMER;
+#endif
+#if defined(SX127X_USE_QUEUE) && defined(SX127X_USE_LBT)
+  if ((ready & (1 << RADIO_LINE_LBT)) && radio_timer_read(self->lbt_tfd))
+    expired |= 1 << RADIO_LINE_LBT;
+#endif
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_SWEEP)
+  if ((ready & (1 << RADIO_LINE_SWEEP)) && radio_timer_read(self->sweep_tfd))
+    expired |= 1 << RADIO_LINE_SWEEP;
+#endif
+  return expired;
+}
+//----------------------------------------------------------------------------
+// IRQ dispatcher thread (one for all modules)
 static void *thread_irq_fn(void *arg)
 {
+  int i, retv, dio;
+  int ready[RADIO_MAX];      // bit masks of ready lines of modules
+  radio_t *list[RADIO_MAX]; // modules of current routing
+
   printf("RADIO: start irq_thread()\n");
-  
-#ifdef RADIO_GPIO_IRQ
+
   while (1)
   {
-    // wait interrupt
-    int retv  = sgpio_poll(&gpio_irq, 1000); // FIXME
-    int value = sgpio_get( &gpio_irq);
-    //printf("RADIO: sgpio_poll(&gpio_irq, 1000) return %d\n", retv); // FIXME
-
-    if (retv > 0)
-    { // interrupt
-      //printf("RADIO: sgpio_get(&gpio_irq) return %d\n", value); // FIXME
-      if (value) sx127x_irq_handler(&radio);
-    }
-    else if (retv == 0)
-    { // timeout
-      if (radio_stop)
-      {
-        printf("RADIO: thread_irq_fn() finished by `radio_stop`\n");
-        break; // finish by `global_stop`
+    // wait interrupt (poll TX queue by timeout if TX done IRQ is lost)
+    int msec = -1;
+#ifdef SX127X_USE_QUEUE
+    pthread_mutex_lock(&radio_list_mutex);
+    for (i = 0; i < RADIO_MAX; i++)
+      if (radio_list[i] != (radio_t*) NULL && radio_list[i]->sx->txq_busy)
+      { // poll after time on air of longest frame (not later than limit)
+        int t = (int) sx127x_airtime_ms(radio_list[i]->sx, MAX_PKT_LENGTH) +
+                SX127X_TX_MARGIN;
+        t = SX127X_MIN(t, RADIO_TXQ_POLL);
+        if (msec < 0 || t < msec) msec = t;
       }
-    }
-    else // retv < 0
+    pthread_mutex_unlock(&radio_list_mutex);
+#endif
+
+    retv = sgpio_wait(&radio_wait, msec);
+
+    if (retv < 0)
     { // error
-      printf("RADIO: thread_irq_fn() finished by sgpio_poll() error\n");
+      printf("RADIO: thread_irq_fn() finished by sgpio_wait() error\n");
       radio_stop = 1;
-      break; // finish by sgpio_poll() error
+      break; // finish by sgpio_wait() error
+    }
+
+    pthread_mutex_lock(&radio_list_mutex);
+
+    if (radio_stop || radio_count == 0)
+    {
+      pthread_mutex_unlock(&radio_list_mutex);
+      printf("RADIO: thread_irq_fn() finished by `radio_stop`\n");
+      break; // finish by `radio_stop` or by radio_free() of last module
+    }
+
+    // collect ready DIO lines of modules by owners of line IDs
+    memset((void*) ready, 0, sizeof(ready));
+    for (i = 0; i < SGPIO_WAIT_MAX; i++)
+      if ((retv & (1 << i)) && radio_line[i].radio != (radio_t*) NULL)
+        ready[radio_line[i].radio->index] |= 1 << radio_line[i].dio;
+
+    // take modules and expired timers, then route events without lock
+    // (callbacks may call radio_rx_duty() etc., radio_free() waits `dispatch`)
+    for (i = 0; i < RADIO_MAX; i++)
+    {
+      list[i] = radio_list[i];
+      if (list[i] == (radio_t*) NULL) continue;
+      list[i]->dispatch = 1;
+      ready[i] = (ready[i] & RADIO_DIO_MASK) | radio_timers(list[i], ready[i]);
+    }
+
+    pthread_mutex_unlock(&radio_list_mutex);
+
+    // route interrupts to modules
+    for (i = 0; i < RADIO_MAX; i++)
+    {
+      radio_t *self = list[i];
+      if (self == (radio_t*) NULL || ready[i] == 0) continue;
+
+      dio = radio_irq_events(self, ready[i] & RADIO_DIO_MASK);
+      if (dio)
+        radio_irq_dispatch(self, dio);
+
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_DUTY)
+      if (ready[i] & (1 << RADIO_LINE_TIMER)) // after IRQs of last window
+        sx127x_rx_duty_wake(self->sx, radio_time_ns());
+#endif
+
+#if defined(SX127X_USE_QUEUE) && defined(SX127X_USE_LBT)
+      if (ready[i] & (1 << RADIO_LINE_LBT)) // after `CadDone` IRQ
+        sx127x_lbt_wake(self->sx);
+#endif
+
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_SWEEP)
+      if (ready[i] & (1 << RADIO_LINE_SWEEP)) // dwell time is expired
+        sx127x_sweep_step(self->sx, radio_time_ns());
+#endif
     }
+
+#ifdef SX127X_USE_QUEUE
+    if (retv == 0)
+    { // timeout only: TX done IRQ may be lost (timer lines are not polled,
+      // RX/CAD of LBT backoff owns IRQ flags)
+      for (i = 0; i < RADIO_MAX; i++)
+        if (list[i] != (radio_t*) NULL)
+          sx127x_txq_poll(list[i]->sx);
+    }
+#endif
+
+    // end of routing: wake up radio_free()
+    pthread_mutex_lock(&radio_list_mutex);
+    for (i = 0; i < RADIO_MAX; i++)
+      if (list[i] != (radio_t*) NULL)
+        list[i]->dispatch = 0;
+    pthread_cond_broadcast(&radio_list_cond);
+    pthread_mutex_unlock(&radio_list_mutex);
   } // while(1)
-#endif // RADIO_GPIO_IRQ
 
   return NULL;
 }
 //-----------------------------------------------------------------------------
+// close SPI, unexport GPIOs and release SPI bus lock (look radio_init())
+static void radio_hw_free(radio_t *self)
+{
+  int i;
+
+  // free SPI
+#ifndef RADIO_SIM
+  spi_free(&self->spi);
+#endif
+  self->spi_on = 0;
+
+  // unexport GPIOs
+  radio_gpio_close(&self->gpio_led,   self->cfg.gpio_led);
+  radio_data_close(self);
+  radio_gpio_cs_free(self);
+  radio_gpio_close(&self->gpio_reset, self->cfg.gpio_reset);
+  for (i = 0; i < RADIO_DIO_NUM; i++)
+    radio_gpio_close(&self->gpio_dio[i], self->cfg.gpio_dio[i]);
+
+#ifdef RADIO_SIM
+  sx127x_sim_free(&self->sim);
+#endif
+
+  radio_bus_put(self->bus);
+  self->bus = (radio_bus_t*) NULL;
+}
+//-----------------------------------------------------------------------------
 // init SX127x radio module hardware layer (before call sx127x_init())
-void radio_init()
+// (`sx` - driver object, pass `self` as SPI exchange context to it;
+//  `cfg` - board configuration or NULL for default; return 0 or -1)
+int radio_init(radio_t *self, sx127x_t *sx, const radio_cfg_t *cfg)
 {
-  int retv;
+  int i, retv;
+
+  memset((void*) self, 0, sizeof(radio_t));
+  if (cfg != (const radio_cfg_t*) NULL)
+    self->cfg = *cfg;
+  else
+    radio_cfg_default(&self->cfg);
+
+  self->sx            = sx;
+  self->index         = -1;
+  self->dispatch      = 0;
+  self->cs            = RADIO_CS_MODE;
+  self->gpio_cs_level = -1;
 
+  // SPI bus lock shared by modules on same SPI device
+  self->bus = radio_bus_get(self->cfg.spi_device);
+  if (self->bus == (radio_bus_t*) NULL) return -1;
+
+#ifdef RADIO_SIM
+  // setup SX127x model instead of SPI
+  retv = sx127x_sim_init(&self->sim);
+  printf("RADIO: sx127x_sim_init() return %d\n", retv);
+  if (retv != 0)
+  {
+    radio_bus_put(self->bus);
+    return -1;
+  }
+#else
   // setup SPI
-  retv = spi_init(&spi,
-                  RADIO_SPI_DEVICE, // filename like "/dev/spidev0.0"
-                  0,                // SPI_* (look "linux/spi/spidev.h")
-                  0,                // bits per word (usually 8)
-                  RADIO_SPI_SPEED); // max speed [Hz]
+  retv = spi_init(&self->spi,
+                  self->cfg.spi_device, // filename like "/dev/spidev0.0"
+                  0,                    // SPI_* (look "linux/spi/spidev.h")
+                  0,                    // bits per word (usually 8)
+                  self->cfg.spi_speed); // max speed [Hz]
   printf("RADIO: spi_init(device='%s', speed=%d) return %d\n",
-         RADIO_SPI_DEVICE, RADIO_SPI_SPEED, retv);
-  if (retv != 0) exit(EXIT_FAILURE);
+         self->cfg.spi_device, self->cfg.spi_speed, retv);
+  if (retv != 0)
+  {
+    radio_bus_put(self->bus);
+    return -1;
+  }
+#endif // RADIO_SIM
+  pthread_mutex_init(&self->tx_mutex, NULL);
 
-  // setup GPIOs
-#ifdef RADIO_GPIO_IRQ
-  sgpio_unexport(RADIO_GPIO_IRQ); // FIXME: it is important! Why?
-  sgpio_export(RADIO_GPIO_IRQ);
-  sgpio_init(&gpio_irq,   RADIO_GPIO_IRQ);
-  sgpio_mode(&gpio_irq,   SGPIO_DIR_IN,  SGPIO_EDGE_RISING);
-  retv = sgpio_get(&gpio_irq);
-  printf("RADIO: first sgpio_get(&gpio_irq) return %d\n", retv); // FIXME
-#endif
+  // setup GPIOs (DIO1 - both edges for `FifoLevel` in FSK/OOK streaming)
+  for (i = 0; i < RADIO_DIO_NUM; i++)
+  {
+    radio_gpio_open(&self->gpio_dio[i], self->cfg.gpio_dio[i], SGPIO_DIR_IN,
+                    i == 1 ? SGPIO_EDGE_BOTH : SGPIO_EDGE_RISING);
+    if (self->cfg.gpio_dio[i] >= 0)
+    {
+      retv = sgpio_get(&self->gpio_dio[i]);
+      printf("RADIO: first sgpio_get(&gpio_dio[%d]) return %d\n",
+             i, retv); // FIXME
+    }
+  }
 
-#ifdef RADIO_GPIO_RESET
-  sgpio_export(RADIO_GPIO_RESET);
-  sgpio_init(&gpio_reset, RADIO_GPIO_RESET);
-  sgpio_mode(&gpio_reset, SGPIO_DIR_OUT, SGPIO_EDGE_NONE);
-  sgpio_set(&gpio_reset, 1);
+  // RESET is high (not asserted) from request of line
+  radio_gpio_open(&self->gpio_reset, self->cfg.gpio_reset,
+                  SGPIO_DIR_OUT_HIGH, SGPIO_EDGE_NONE);
+
+  // select CS strategy (export CS GPIO if need)
+  self->spi_on = 1;
+  radio_spi_cs_mode(self, self->cs);
+  printf("RADIO: CS strategy is '%s'\n", radio_spi_cs_name(self->cs));
+
+  radio_data_open(self); // low from request of line
+
+
+  radio_gpio_open(&self->gpio_led,   self->cfg.gpio_led,
+                  SGPIO_DIR_OUT, SGPIO_EDGE_NONE);
+  radio_led_on(self, false);
+
+#ifdef SX127X_USE_RXQ
+  // eventfd of RX ring consumer
+  self->rxq_efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (self->rxq_efd < 0)
+  { // close SPI and unexport GPIOs opened above
+    radio_hw_free(self);
+    return -1;
+  }
 #endif
 
-#ifdef RADIO_GPIO_CS
-  sgpio_export(RADIO_GPIO_CS);
-  sgpio_init(&gpio_cs,    RADIO_GPIO_CS);
-  sgpio_mode(&gpio_cs,    SGPIO_DIR_OUT, SGPIO_EDGE_NONE);
-  radio_spi_cs(false);
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_DUTY)
+  self->duty_tfd = -1; // duty-cycled receive is off
 #endif
 
-#ifdef RADIO_GPIO_DATA
-  sgpio_export(RADIO_GPIO_DATA);
-  sgpio_init(&gpio_data,  RADIO_GPIO_DATA);
-  sgpio_mode(&gpio_data,  SGPIO_DIR_OUT, SGPIO_EDGE_NONE);
-  radio_data_on(false);
+#if defined(SX127X_USE_QUEUE) && defined(SX127X_USE_LBT)
+  self->lbt_tfd = -1; // listen before talk is off
 #endif
 
-#ifdef RADIO_GPIO_LED
-  sgpio_export(RADIO_GPIO_LED);
-  sgpio_init(&gpio_led,   RADIO_GPIO_LED);
-  sgpio_mode(&gpio_led,   SGPIO_DIR_OUT, SGPIO_EDGE_NONE);
-  radio_led_on(false);
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_SWEEP)
+  self->sweep_tfd = -1; // RSSI sweep is off
 #endif
 
-  // hard reset SX127x radio module
-  radio_reset();
+  // hard reset SX127x radio module (sx127x_init() resets cache itself)
+  radio_hw_reset(self);
+
+  return 0;
+}
+//-----------------------------------------------------------------------------
+// sleep in sx127x_send() until TX done IRQ or timeout (tx_wait() hook)
+static int radio_tx_wait(sx127x_t *sx, u32_t timeout_ms, void *context)
+{
+  radio_t *self = (radio_t*) context;
+  struct timespec ts;
+  int retv = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ts.tv_sec  += timeout_ms / 1000;
+  ts.tv_nsec += (timeout_ms % 1000) * 1000000;
+  if (ts.tv_nsec >= 1000000000)
+  {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000;
+  }
+
+  pthread_mutex_lock(&self->tx_mutex);
+  while (sx->tx_irq && retv == 0)
+    retv = pthread_cond_timedwait(&self->tx_cond, &self->tx_mutex, &ts);
+  pthread_mutex_unlock(&self->tx_mutex);
+
+  return sx->tx_irq ? -1 : 0;
+}
+//-----------------------------------------------------------------------------
+// monotonic time for TX done timeout of busy waiting (time_ns() hook)
+static u64_t radio_time_hook(sx127x_t *sx, void *context)
+{
+  return radio_time_ns();
+}
+//-----------------------------------------------------------------------------
+// wake up sender by TX done IRQ (tx_wake() hook)
+static void radio_tx_wake(sx127x_t *sx, void *context)
+{
+  radio_t *self = (radio_t*) context;
+  pthread_mutex_lock(&self->tx_mutex);
+  pthread_cond_broadcast(&self->tx_cond);
+  pthread_mutex_unlock(&self->tx_mutex);
+}
+//-----------------------------------------------------------------------------
+#ifdef SX127X_USE_LOCK
+// lock SPI bus (bus_lock() hook: wait or try lock)
+static int radio_bus_lock(sx127x_t *sx, bool wait, void *context)
+{
+  radio_t *self = (radio_t*) context;
+  if (wait)
+    return pthread_mutex_lock(&self->bus->mutex) == 0 ? 0 : -1;
+  return pthread_mutex_trylock(&self->bus->mutex) == 0 ? 0 : -1;
 }
 //-----------------------------------------------------------------------------
-// create listen IRQ thread (after sx127x_init())
-void radio_create_irq_thread()
+// unlock SPI bus (bus_unlock() hook)
+static void radio_bus_unlock(sx127x_t *sx, void *context)
 {
-  vsthread_create(32, SCHED_FIFO, &thread_irq, thread_irq_fn, NULL);
+  radio_t *self = (radio_t*) context;
+  pthread_mutex_unlock(&self->bus->mutex);
 }
+#endif // SX127X_USE_LOCK
 //-----------------------------------------------------------------------------
-// free SX127x radio module
-void radio_free()
+// check that module has IRQ line (DIO0) or SX127x model events
+static bool radio_has_irq(const radio_t *self)
 {
-  sx127x_free(&radio);
+#ifdef RADIO_SIM
+  return true;
+#else
+  return self->cfg.gpio_dio[0] >= 0;
+#endif
+}
+//-----------------------------------------------------------------------------
+// allocate free line ID in wait context for DIO line of module
+// (return line ID or -1 if all SGPIO_WAIT_MAX IDs are used)
+static int radio_line_alloc(radio_t *self, int dio)
+{
+  int id;
+  for (id = 0; id < SGPIO_WAIT_MAX; id++)
+    if (radio_line[id].radio == (radio_t*) NULL)
+    {
+      radio_line[id].radio = self;
+      radio_line[id].dio   = dio;
+      return id;
+    }
+  return -1;
+}
+//-----------------------------------------------------------------------------
+// free line IDs of module in wait context (dio < 0 - all lines)
+static void radio_line_free(radio_t *self, int dio)
+{
+  int id;
+  for (id = 0; id < SGPIO_WAIT_MAX; id++)
+    if (radio_line[id].radio == self && (dio < 0 || radio_line[id].dio == dio))
+      radio_line[id].radio = (radio_t*) NULL;
+}
+//-----------------------------------------------------------------------------
+// register connected DIO lines (or SX127x model eventfd) of module
+static int radio_wait_add(radio_t *self)
+{
+  int id, retv;
+#ifdef RADIO_SIM
+  id = radio_line_alloc(self, 0);
+  retv = id < 0 ? -1 :
+         sgpio_wait_add_fd(&radio_wait, sx127x_sim_fd(&self->sim), id);
+#else
+  int i;
+  for (i = 0, retv = 0; retv == 0 && i < RADIO_DIO_NUM; i++)
+  {
+    if (self->cfg.gpio_dio[i] < 0) continue;
+    id = radio_line_alloc(self, i);
+    retv = id < 0 ? -1 : sgpio_wait_add(&radio_wait, &self->gpio_dio[i], id);
+  }
+#endif
+  return retv;
+}
+//-----------------------------------------------------------------------------
+// unregister DIO lines (or SX127x model eventfd) of module
+static void radio_wait_del(radio_t *self)
+{
+#ifdef RADIO_SIM
+  sgpio_wait_del(&radio_wait, sx127x_sim_fd(&self->sim));
+#else
+  int i;
+  for (i = 0; i < RADIO_DIO_NUM; i++)
+    if (self->cfg.gpio_dio[i] >= 0)
+      sgpio_wait_del(&radio_wait, self->gpio_dio[i].fd);
+#endif
+  radio_line_free(self, -1);
+}
+//-----------------------------------------------------------------------------
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_DUTY)
+// stop timer of duty-cycled receive (under `radio_list_mutex`)
+static void radio_duty_stop(radio_t *self)
+{
+  if (self->duty_tfd < 0) return;
+  sgpio_wait_del(&radio_wait, self->duty_tfd);
+  radio_line_free(self, RADIO_LINE_TIMER);
+  close(self->duty_tfd);
+  self->duty_tfd = -1;
+}
+#endif
+//-----------------------------------------------------------------------------
+#if defined(SX127X_USE_QUEUE) && defined(SX127X_USE_LBT)
+// stop timer of listen before talk (under `radio_list_mutex`)
+static void radio_lbt_stop(radio_t *self)
+{
+  if (self->lbt_tfd < 0) return;
+  sx127x_lbt_hooks(self->sx, NULL, NULL);
+  sgpio_wait_del(&radio_wait, self->lbt_tfd);
+  radio_line_free(self, RADIO_LINE_LBT);
+  close(self->lbt_tfd);
+  self->lbt_tfd = -1;
+}
+#endif
+//-----------------------------------------------------------------------------
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_SWEEP)
+// stop timer of RSSI sweep (under `radio_list_mutex`)
+static void radio_sweep_stop(radio_t *self)
+{
+  if (self->sweep_tfd < 0) return;
+  sgpio_wait_del(&radio_wait, self->sweep_tfd);
+  radio_line_free(self, RADIO_LINE_SWEEP);
+  close(self->sweep_tfd);
+  self->sweep_tfd = -1;
+}
+#endif
+//-----------------------------------------------------------------------------
+// attach module to IRQ dispatcher thread (after sx127x_init()),
+// create thread once (one thread serves up to RADIO_MAX modules),
+// set hooks to sleep in sx127x_send() until TX done IRQ and SPI bus lock
+int radio_create_irq_thread(radio_t *self)
+{
+  int i, retv = 0;
 
-  radio_stop = 1;
-  
-  // free SPI
-  spi_free(&spi);
+#ifdef SX127X_USE_LOCK
+  // IRQ thread and application threads share SPI bus
+  sx127x_lock_hooks(self->sx, radio_bus_lock, radio_bus_unlock, self);
+#endif
 
-  // unexport GPIOs
-#ifdef RADIO_GPIO_LED
-  sgpio_free(&gpio_led);
-  sgpio_unexport(RADIO_GPIO_LED);
+  // busy waiting of TX done is bounded by time, not by register polls
+  sx127x_time_hook(self->sx, radio_time_hook, self);
+
+  if (!radio_has_irq(self))
+    return 0; // no IRQ: poll TX done in sx127x_send()
+
+  pthread_mutex_lock(&radio_list_mutex);
+
+  // create shared wait context by first module
+  if (radio_count == 0 && !radio_thread_on)
+  {
+    retv = sgpio_wait_init(&radio_wait);
+    printf("RADIO: sgpio_wait_init() return %d\n", retv);
+  }
+
+  // find free slot
+  for (i = 0; retv == 0 && i < RADIO_MAX; i++)
+    if (radio_list[i] == (radio_t*) NULL) break;
+
+  if (retv == 0 && i < RADIO_MAX)
+  {
+    self->index = i; // owners of line IDs are routed by slot
+    retv = radio_wait_add(self);
+    if (retv != 0)
+    {
+      radio_wait_del(self);
+      self->index = -1;
+    }
+  }
+  else
+    retv = -1; // too many modules or wait context error
+
+  if (retv == 0)
+  {
+    pthread_condattr_t attr;
+
+    // TX done condition on monotonic clock
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&self->tx_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    // sleep in sx127x_send() until TX done IRQ on DIO0
+    sx127x_tx_hooks(self->sx, radio_tx_wait, radio_tx_wake, self);
+
+    radio_list[i] = self;
+    self->index = i;
+    radio_count++;
+
+    if (!radio_thread_on)
+    {
+      vsthread_create(32, SCHED_FIFO, &thread_irq, thread_irq_fn, NULL);
+      radio_thread_on = 1;
+    }
+  }
+  printf("RADIO: attach module to IRQ thread (slot %d) return %d\n",
+         self->index, retv);
+
+  pthread_mutex_unlock(&radio_list_mutex);
+  return retv;
+}
+//-----------------------------------------------------------------------------
+// free SX127x radio module (IRQ thread is stopped with last module)
+void radio_free(radio_t *self)
+{
+  int last = 0;
+
+  sx127x_free(self->sx);
+
+  // detach module from IRQ dispatcher
+  pthread_mutex_lock(&radio_list_mutex);
+  if (self->index >= 0)
+  {
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_DUTY)
+    radio_duty_stop(self);
 #endif
+#if defined(SX127X_USE_QUEUE) && defined(SX127X_USE_LBT)
+    radio_lbt_stop(self);
+#endif
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_SWEEP)
+    radio_sweep_stop(self);
+#endif
+    radio_wait_del(self);
+    radio_list[self->index] = (radio_t*) NULL;
+    self->index = -1;
+    radio_count--;
+    last = radio_count == 0 && radio_thread_on;
+  }
+  while (self->dispatch) // IRQ thread routes events of module
+    pthread_cond_wait(&radio_list_cond, &radio_list_mutex);
+  pthread_mutex_unlock(&radio_list_mutex);
 
-#ifdef RADIO_GPIO_DATA
-  sgpio_free(&gpio_data);
-  sgpio_unexport(RADIO_GPIO_DATA);
+  if (last)
+  { // stop and join IRQ thread at once (it sleeps in sgpio_wait())
+    sgpio_wait_wake(&radio_wait);
+    vsthread_join(thread_irq, NULL);
+    sgpio_wait_free(&radio_wait);
+    radio_thread_on = 0;
+  }
+
+#ifdef SX127X_USE_RXQ
+  close(self->rxq_efd);
+  self->rxq_efd = -1;
 #endif
 
-#ifdef RADIO_GPIO_CS
-  sgpio_free(&gpio_cs);
-  sgpio_unexport(RADIO_GPIO_CS);
+#ifdef SX127X_USE_LOCK
+  sx127x_lock_hooks(self->sx, NULL, NULL, NULL);
 #endif
 
-#ifdef RADIO_GPIO_RESET
-  sgpio_free(&gpio_reset);
-  sgpio_unexport(RADIO_GPIO_RESET);
+  radio_hw_free(self);
+}
+//-----------------------------------------------------------------------------
+#ifdef SX127X_USE_RXQ
+// signal RX ring consumer (rxq_notify() callback in IRQ thread)
+static void radio_rxq_notify(sx127x_t *sx, void *context)
+{
+  radio_t *self = (radio_t*) context;
+  u64_t one = 1;
+  if (write(self->rxq_efd, &one, sizeof(one)) != sizeof(one))
+    return; // eventfd is already signalled
+}
+//-----------------------------------------------------------------------------
+// on/off RX ring mode (after radio_init()): received frames are put to
+// lock-free ring by IRQ thread, read them by sx127x_rxq_peek()/pop()
+void radio_rxq_on(radio_t *self, bool on)
+{
+  sx127x_rxq_on(self->sx, on, on ? radio_rxq_notify : NULL, self);
+}
+//-----------------------------------------------------------------------------
+// get eventfd signalled when frame is put to RX ring (for poll()/epoll())
+int radio_rxq_fd(const radio_t *self)
+{
+  return self->rxq_efd;
+}
+//-----------------------------------------------------------------------------
+// wait frames in RX ring (msec < 0 - infinite)
+// (return number of frames, 0 - timeout, < 0 - error)
+int radio_rxq_wait(radio_t *self, int msec)
+{
+  struct pollfd fds;
+  u64_t cnt;
+  int retv;
+
+  if (sx127x_rxq_count(self->sx) > 0)
+    return sx127x_rxq_count(self->sx);
+
+  fds.fd      = self->rxq_efd;
+  fds.events  = POLLIN;
+  fds.revents = 0;
+  retv = poll(&fds, 1, msec);
+  if (retv <= 0) return retv;
+
+  if (read(self->rxq_efd, &cnt, sizeof(cnt)) < 0)
+    return -1;
+
+  return sx127x_rxq_count(self->sx);
+}
+#endif // SX127X_USE_RXQ
+//-----------------------------------------------------------------------------
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_DUTY)
+// on/off duty-cycled receive (LoRa, after radio_create_irq_thread()):
+// IRQ thread opens RX single window by timerfd each period and sleeps
+// (look sx127x_rx_duty(); return period [us], 0 - off or preamble is short)
+u32_t radio_rx_duty(radio_t *self, bool on, u16_t window)
+{
+  u32_t period = 0;
+  int id = -1;
+
+  pthread_mutex_lock(&radio_list_mutex);
+  radio_duty_stop(self);
+
+  if (on && self->index >= 0) // IRQ thread is need
+    period = sx127x_rx_duty(self->sx, true, window);
+
+  if (period != 0)
+  { // periodic timer in wait context of IRQ thread
+    struct itimerspec its;
+    its.it_interval.tv_sec  = period / 1000000;
+    its.it_interval.tv_nsec = (period % 1000000) * 1000;
+    its.it_value = its.it_interval;
+
+    self->duty_tfd = timerfd_create(CLOCK_MONOTONIC,
+                                    TFD_NONBLOCK | TFD_CLOEXEC);
+    if (self->duty_tfd >= 0)
+      id = radio_line_alloc(self, RADIO_LINE_TIMER);
+    if (id < 0 ||
+        sgpio_wait_add_fd(&radio_wait, self->duty_tfd, id) != 0 ||
+        timerfd_settime(self->duty_tfd, 0, &its, NULL) != 0)
+    {
+      radio_duty_stop(self);
+      period = 0;
+    }
+  }
+
+  if (period == 0)
+    sx127x_rx_duty(self->sx, false, 0);
+
+  pthread_mutex_unlock(&radio_list_mutex);
+  printf("RADIO: radio_rx_duty(%s) period %lu us\n",
+         on ? "on" : "off", (unsigned long) period);
+  return period;
+}
 #endif
+//-----------------------------------------------------------------------------
+#if defined(SX127X_USE_QUEUE) && defined(SX127X_USE_LBT)
+// on/off listen before talk in asynchronous TX queue (after
+// radio_create_irq_thread()): IRQ thread waits backoff by one-shot timerfd
+// (look sx127x_lbt(); return slot [us], 0 - off)
+u32_t radio_lbt(radio_t *self, bool on, u32_t slot_us, i16_t rssi)
+{
+  int id = -1;
 
-#ifdef RADIO_GPIO_IRQ
-  sgpio_free(&gpio_irq);
-  sgpio_unexport(RADIO_GPIO_IRQ);
+  pthread_mutex_lock(&radio_list_mutex);
+  sx127x_lbt(self->sx, false, 0, rssi);
+
+  if (on && self->index >= 0 && self->lbt_tfd < 0) // IRQ thread is need
+  { // one-shot timer in wait context of IRQ thread
+    self->lbt_tfd = timerfd_create(CLOCK_MONOTONIC,
+                                   TFD_NONBLOCK | TFD_CLOEXEC);
+    if (self->lbt_tfd >= 0)
+      id = radio_line_alloc(self, RADIO_LINE_LBT);
+    if (id < 0 || sgpio_wait_add_fd(&radio_wait, self->lbt_tfd, id) != 0)
+      radio_lbt_stop(self);
+    else
+      sx127x_lbt_hooks(self->sx, radio_lbt_timer, (void*) self);
+  }
+
+  if (on && self->lbt_tfd >= 0)
+    slot_us = sx127x_lbt(self->sx, true, slot_us, rssi);
+  else
+    slot_us = 0;
+
+  pthread_mutex_unlock(&radio_list_mutex);
+  printf("RADIO: radio_lbt(%s) slot %lu us\n",
+         on ? "on" : "off", (unsigned long) slot_us);
+  return slot_us;
+}
+#endif
+//-----------------------------------------------------------------------------
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_SWEEP)
+// on/off RSSI sweep (FSK/OOK, after radio_create_irq_thread()): IRQ
+// thread reads RSSI and hops to next bin by timerfd each dwell time
+// (look sx127x_sweep(); return dwell time [us], 0 - off)
+u32_t radio_sweep(radio_t *self, bool on, u32_t freq, u32_t step, int bins)
+{
+  u32_t dwell = 0;
+  int id = -1;
+
+  pthread_mutex_lock(&radio_list_mutex);
+  radio_sweep_stop(self);
+
+  if (on && self->index >= 0) // IRQ thread is need
+    dwell = sx127x_sweep(self->sx, true, freq, step, bins);
+
+  if (dwell != 0)
+  { // periodic timer in wait context of IRQ thread
+    struct itimerspec its;
+    its.it_interval.tv_sec  = dwell / 1000000;
+    its.it_interval.tv_nsec = (dwell % 1000000) * 1000;
+    its.it_value = its.it_interval;
+
+    self->sweep_tfd = timerfd_create(CLOCK_MONOTONIC,
+                                     TFD_NONBLOCK | TFD_CLOEXEC);
+    if (self->sweep_tfd >= 0)
+      id = radio_line_alloc(self, RADIO_LINE_SWEEP);
+    if (id < 0 ||
+        sgpio_wait_add_fd(&radio_wait, self->sweep_tfd, id) != 0 ||
+        timerfd_settime(self->sweep_tfd, 0, &its, NULL) != 0)
+    {
+      radio_sweep_stop(self);
+      dwell = 0;
+    }
+  }
+
+  if (dwell == 0)
+    sx127x_sweep(self->sx, false, 0, 0, 0);
+
+  pthread_mutex_unlock(&radio_list_mutex);
+  printf("RADIO: radio_sweep(%s) dwell %lu us\n",
+         on ? "on" : "off", (unsigned long) dwell);
+  return dwell;
+}
+#endif
+//-----------------------------------------------------------------------------
+// bit streaming job of RT thread (look radio_bits_send())
+typedef struct radio_bits_ {
+  radio_t *radio;    // module
+  const u8_t *data;  // bits (MSB first)
+  int bits;          // number of bits
+  u32_t bitrate;     // bitrate [bit/s]
+  u32_t *at;         // batch of bit indexes where DATA level changes
+  u32_t num;         // number of level changes in batch
+  u32_t *lat;        // latency of DATA line writes [ns]
+  u32_t edges;       // number of DATA line writes
+  u64_t start_ns;    // time of first bit [ns]
+  u64_t end_ns;      // time of end of last bit [ns]
+} radio_bits_t;
+//-----------------------------------------------------------------------------
+// sleep until absolute deadline [ns] by CLOCK_MONOTONIC
+static void radio_bits_sleep(u64_t deadline)
+{
+  struct timespec ts;
+  ts.tv_sec  = deadline / 1000000000ULL;
+  ts.tv_nsec = deadline % 1000000000ULL;
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) ==
+         EINTR);
+}
+//-----------------------------------------------------------------------------
+// RT thread of bit streaming: sleep to absolute deadline of each level
+// change of precomputed batch, write DATA line and measure latency
+static void *thread_bits_fn(void *arg)
+{
+  radio_bits_t *job = (radio_bits_t*) arg;
+  radio_t *self = job->radio;
+  u64_t t0, deadline, now;
+  u32_t k;
+  int level = 0;
+
+#ifdef RADIO_BITS_CPU
+  { // run on isolated CPU
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(RADIO_BITS_CPU, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  }
 #endif
 
-  // join IRQ thread
-  vsthread_join(thread_irq, NULL); // FIXME: is it realy necessary?
+  t0 = radio_time_ns() + RADIO_BITS_LEAD_US * 1000ULL;
+  for (k = 0; k <= job->num; k++)
+  {
+    // absolute deadline from start (no drift), end of last bit at last
+    u32_t i = k < job->num ? job->at[k] : (u32_t) job->bits;
+    deadline = t0 + ((u64_t) i * 1000000000ULL) / job->bitrate;
+    radio_bits_sleep(deadline);
+
+    // first bit sets level, next ones toggle it, DATA is low after last bit
+    if (k < job->num || level != 0)
+    {
+      level = k == 0 ? (job->data[0] >> 7) & 1 : !level;
+      if (self->cfg.gpio_data >= 0)
+        sgpio_lines_set(&self->gpio_data, 1, level);
+      now = radio_time_ns();
+      job->lat[job->edges++] = (u32_t) SX127X_MIN(now - deadline,
+                                                  0xFFFFFFFFULL);
+    }
+    else
+      now = radio_time_ns();
+
+    if (k == 0)        job->start_ns = now;
+    if (k == job->num) job->end_ns   = now;
+  }
+
+  return NULL;
+}
+//-----------------------------------------------------------------------------
+// compare latencies for qsort()
+static int radio_bits_cmp(const void *a, const void *b)
+{
+  u32_t x = *(const u32_t*) a, y = *(const u32_t*) b;
+  return x < y ? -1 : (x > y ? 1 : 0);
+}
+//-----------------------------------------------------------------------------
+// clock out `bits` bits of `data` (MSB first) on DATA line (DIO2 in
+// continuous mode) by RT thread with absolute deadlines; DATA line is
+// written only on level change and is low after last bit
+// (call between sx127x_tx() and sx127x_standby() in continuous mode;
+//  return 0 or -1 on error, `stat` - achieved bitrate and jitter or NULL)
+int radio_bits_send(radio_t *self, const u8_t *data, int bits, u32_t bitrate,
+                    radio_bits_stat_t *stat)
+{
+  radio_bits_t job;
+  vsthread_t thread;
+  u32_t n;
+  int i, val, level = -1;
+
+  if (bits <= 0 || bitrate == 0) return -1;
+
+  job.radio    = self;
+  job.data     = data;
+  job.bits     = bits;
+  job.bitrate  = bitrate;
+  job.edges    = 0;
+  job.start_ns = job.end_ns = 0;
+  job.lat      = (u32_t*) malloc(sizeof(u32_t) * (bits + 1) * 2);
+  if (job.lat == (u32_t*) NULL) return -1;
+  memset((void*) job.lat, 0, sizeof(u32_t) * (bits + 1)); // no page faults
+  job.at = job.lat + bits + 1;
+
+  // batch of level changes before start: run of equal bits is one write
+  for (i = 0, job.num = 0; i < bits; i++)
+  {
+    val = (data[i >> 3] >> (7 - (i & 7))) & 1;
+    if (val != level) job.at[job.num++] = (u32_t) i;
+    level = val;
+  }
+
+  if (vsthread_create(RADIO_BITS_PRIORITY, SCHED_FIFO, &thread,
+                      thread_bits_fn, (void*) &job) != 0)
+  {
+    free((void*) job.lat);
+    return -1;
+  }
+  vsthread_join(thread, NULL);
+
+  if (stat != (radio_bits_stat_t*) NULL)
+  {
+    u32_t i, half = 500000000UL / bitrate; // half of bit [ns]
+    n = job.edges;
+    qsort((void*) job.lat, n, sizeof(u32_t), radio_bits_cmp);
+
+    stat->bits    = bits;
+    stat->edges   = n;
+    stat->bitrate = job.end_ns > job.start_ns ?
+      (u32_t) (((u64_t) bits * 1000000000ULL + (job.end_ns - job.start_ns) / 2)
+               / (job.end_ns - job.start_ns)) : 0;
+    stat->p50_ns  = job.lat[(n - 1) * 50 / 100];
+    stat->p90_ns  = job.lat[(n - 1) * 90 / 100];
+    stat->p99_ns  = job.lat[(n - 1) * 99 / 100];
+    stat->max_ns  = job.lat[n - 1];
+    for (i = 0, stat->late = 0; i < n; i++)
+      if (job.lat[i] > half) stat->late++;
+  }
+
+  free((void*) job.lat);
+  return 0;
+}
+//-----------------------------------------------------------------------------
+// reset SPI exchange statistics
+void radio_spi_stat_reset(radio_t *self)
+{
+  memset((void*) &self->stat, 0, sizeof(self->stat));
+}
+//-----------------------------------------------------------------------------
+// select CS strategy RADIO_CS_* (after radio_init()),
+// return selected strategy (RADIO_CS_AUTO is resolved)
+int radio_spi_cs_mode(radio_t *self, int mode)
+{
+  if (mode == RADIO_CS_AUTO)
+  { // the cheapest: native CS (1 syscall), GPIO CS held over bursts
+    if (self->cfg.native_cs || self->cfg.gpio_cs < 0)
+      mode = RADIO_CS_NATIVE;
+    else
+      mode = RADIO_CS_GPIO_HOLD;
+  }
+
+  if (self->cfg.gpio_cs < 0)
+    mode = RADIO_CS_NATIVE; // no CS GPIO on board
+  else if (mode == RADIO_CS_NATIVE)
+    radio_gpio_cs_free(self); // FIXME: some SoC's keep pin in GPIO function
+  else if (self->spi_on)
+    radio_gpio_cs_init(self); // else export CS GPIO in radio_init()
+
+  self->cs = mode;
+  return mode;
+}
+//-----------------------------------------------------------------------------
+// get name of CS strategy
+const char *radio_spi_cs_name(int mode)
+{
+  switch (mode)
+  {
+    case RADIO_CS_AUTO:      return "auto";
+    case RADIO_CS_NATIVE:    return "native";
+    case RADIO_CS_GPIO:      return "GPIO";
+    case RADIO_CS_GPIO_HOLD: return "GPIO hold";
+  }
+  return "unknown";
 }
 //-----------------------------------------------------------------------------
 // SPI exchange wrapper function (return number or RX bytes)
@@ -238,12 +1347,124 @@ int radio_spi_exchange(
   u8_t       *rx_buf, // RX buffer
   const u8_t *tx_buf, // TX buffer
   u8_t len,           // number of bytes
-  void *context)      // optional SPI context or NULL
+  void *context)      // pointer to `radio_t` object
 {
+  radio_t *self = (radio_t*) context;
   int retv;
-  radio_spi_cs(true);
-  retv = spi_exchange(&spi, (char*) rx_buf, (const char*) tx_buf, (int) len);
-  radio_spi_cs(false);
+#ifdef RADIO_SIM
+  retv = sx127x_sim_exchange(rx_buf, tx_buf, len, (void*) &self->sim);
+#else
+  pthread_mutex_lock(&self->bus->mutex); // other module may share SPI bus
+  radio_spi_cs(self, true);
+  retv = spi_exchange(&self->spi,
+                      (char*) rx_buf, (const char*) tx_buf, (int) len);
+  radio_spi_cs(self, false);
+  pthread_mutex_unlock(&self->bus->mutex);
+  self->stat.syscalls++; // ioctl() (CS GPIO writes are counted apart)
+#endif
+
+  self->stat.calls++;
+  self->stat.bytes += len;
+
+  return retv;
+}
+//----------------------------------------------------------------------------
+// check that segment `next` continues burst of segment `prev`
+// (same direction, next register address or FIFO again)
+static int radio_spi_seg_continue(const sx127x_seg_t *prev,
+                                  const sx127x_seg_t *next)
+{
+  u8_t a = prev->tx_buf[0], b = next->tx_buf[0];
+  if (next->len < 2) return 0;
+  if ((a & 0x7F) == REG_FIFO) return a == b;
+  return b == (u8_t) (a + prev->len - 1) && (b & 0x80) == (a & 0x80);
+}
+//----------------------------------------------------------------------------
+// vectored SPI exchange wrapper function (return number or RX bytes)
+int radio_spi_exchange_v(
+  const sx127x_seg_t *seg, // array of segments
+  int n,                   // number of segments
+  void *context)           // pointer to `radio_t` object
+{
+  radio_t *self = (radio_t*) context;
+  spi_seg_t spi_seg[SX127X_SEG_MAX];
+  int i, j, len, retv = 0;
+
+#ifdef RADIO_SIM
+  // SX127x model: no CS, no system calls
+  for (i = 0; i < n; i++)
+  {
+    self->stat.calls++;
+    self->stat.bytes += seg[i].len;
+  }
+  return sx127x_sim_exchange_v(seg, n, (void*) &self->sim);
+#endif
+
+  if (self->cs == RADIO_CS_GPIO)
+  { // CS is driven by GPIO: one transaction per segment
+    for (i = 0; i < n; i++)
+    {
+      len = radio_spi_exchange(seg[i].rx_buf, seg[i].tx_buf,
+                               seg[i].len, context);
+      if (len < 0) return len;
+      retv += len;
+    }
+    return retv;
+  }
+
+  for (i = 0; i < n; i = j)
+  {
+    int k = 0;
+
+    if (self->cs == RADIO_CS_NATIVE)
+    { // CS is driven by SPI controller: all segments by one ioctl()
+      j = n;
+    }
+    else // RADIO_CS_GPIO_HOLD
+    { // hold GPIO CS over segments which continue previous burst
+      for (j = i + 1; j < n; j++)
+        if (!radio_spi_seg_continue(&seg[j - 1], &seg[j])) break;
+    }
+
+    spi_seg[k].rx_buf    = (char*) seg[i].rx_buf;
+    spi_seg[k].tx_buf    = (const char*) seg[i].tx_buf;
+    spi_seg[k].len       = (int) seg[i].len;
+    spi_seg[k].cs_change = 0;
+    self->stat.bytes += seg[i].len;
+    self->stat.calls++;
+
+    for (k = 1; k < j - i; k++)
+    {
+      const sx127x_seg_t *s = &seg[i + k];
+      if (self->cs == RADIO_CS_NATIVE)
+      { // toggle CS between segments
+        spi_seg[k - 1].cs_change = 1;
+        spi_seg[k].rx_buf = (char*) s->rx_buf;
+        spi_seg[k].tx_buf = (const char*) s->tx_buf;
+        spi_seg[k].len    = (int) s->len;
+        self->stat.calls++;
+      }
+      else
+      { // continue burst without address byte (CS is held)
+        spi_seg[k].rx_buf = (char*) (s->rx_buf + 1);
+        spi_seg[k].tx_buf = (const char*) (s->tx_buf + 1);
+        spi_seg[k].len    = (int) s->len - 1;
+      }
+      spi_seg[k].cs_change = 0;
+      self->stat.bytes += spi_seg[k].len;
+    }
+
+    pthread_mutex_lock(&self->bus->mutex); // other module may share SPI bus
+    radio_spi_cs(self, true);
+    len = spi_transfer_v(&self->spi, spi_seg, k);
+    radio_spi_cs(self, false);
+    pthread_mutex_unlock(&self->bus->mutex);
+    self->stat.syscalls++; // ioctl()
+
+    if (len < 0) return len;
+    retv += len;
+  }
+
   return retv;
 }
 //----------------------------------------------------------------------------
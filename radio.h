@@ -14,14 +14,23 @@
 //#define ORANGE_PI_ONE
 //#define ORANGE_PI_WIN_PLUS
 
+// software model of SX127x instead of hardware (or build by `make SIM=1`)
+//#define RADIO_SIM
+
 // GPIO lines and SPI devic to SX127x module
-#if defined(ORANGE_PI_ZERO)
+// (default board configuration, look radio_cfg_default())
+#if defined(RADIO_SIM)
+#  define RADIO_SPI_DEVICE  "sim" // no SPI and GPIO (look "sx127x_sim.h")
+#elif defined(ORANGE_PI_ZERO)
 #  define RADIO_SPI_DEVICE  "/dev/spidev1.0" // on linux ver. 3.4.113-sun8i
 #  define RADIO_GPIO_IRQ     6  // pin  7 of 26 (GPIO.7)
 //#  define RADIO_GPIO_IRQ   1  // pin 11 of 26 (RxD2)
 #  define RADIO_GPIO_RESET   7  // pin 12 of 26 (GPIO.1)
 #  define RADIO_GPIO_CS      13 // pin 24 of 26 (CE0)
+#  define RADIO_SPI_NATIVE_CS   // CS pin is CE0 of SPI controller
 #  define RADIO_GPIO_DATA    19 // pin 16 of 26 (GPIO.4)
+#  define RADIO_GPIO_DIO1    10 // pin 26 of 26 (GPIO.11)
+//#  define RADIO_GPIO_DIO3 ?  // `ValidHeader`/`CadDone` (not connected)
 #  define RADIO_GPIO_LED     18 // pin 18 of 26 (GPIO.5)
 //#  define RADIO_GPIO_LED   3  // pin 15 of 26 (CTS2)
 //#  define RADIO_GPIO_LED   2  // pin 22 of 26 (RTS2)
@@ -40,11 +49,143 @@
 #  define RADIO_GPIO_DATA  4 // FIXME
 #  define RADIO_GPIO_LED   5 // FIXME
 #endif
+
+#ifdef RADIO_SIM
+#  include "sx127x_sim.h" // `sx127x_sim_t`
+#endif
+
+#include "spi.h"     // `spi_t`
+#include "sgpio.h"   // `sgpio_t`
+#include <pthread.h> // `pthread_mutex_t`, `pthread_cond_t`
 //----------------------------------------------------------------------------
 // SPI max speed [Hz]
 #define RADIO_SPI_SPEED 20000000 // 20 MHz 
 //----------------------------------------------------------------------------
-extern sx127x_t radio;
+// maximum poll period of busy asynchronous TX queue if TX done IRQ is lost
+// [ms] (period is time on air of longest packet with SX127X_TX_MARGIN;
+// else IRQ thread sleeps without timeout)
+#define RADIO_TXQ_POLL 1000
+//----------------------------------------------------------------------------
+// max number of SX127x modules served by one IRQ dispatcher thread
+// (connected DIO lines of all modules share SGPIO_WAIT_MAX line IDs)
+#ifndef RADIO_MAX
+#define RADIO_MAX 8
+#endif
+//----------------------------------------------------------------------------
+// number of DIO lines of SX127x module (DIO0...DIO5)
+#define RADIO_DIO_NUM 6
+//----------------------------------------------------------------------------
+// chip select (CS) strategy of SPI exchange
+#define RADIO_CS_AUTO     -1 // cheapest strategy that board supports
+#define RADIO_CS_NATIVE    0 // CS driven by SPI controller (spidev)
+#define RADIO_CS_GPIO      1 // CS driven by GPIO around each transaction
+#define RADIO_CS_GPIO_HOLD 2 // CS driven by GPIO, held over continued bursts
+
+// default CS strategy
+#ifndef RADIO_CS_MODE
+#define RADIO_CS_MODE RADIO_CS_AUTO
+#endif
+//----------------------------------------------------------------------------
+// SPI exchange statistics (for benchmark)
+typedef struct radio_spi_stat_ {
+  unsigned long calls;    // number of SPI transactions
+  unsigned long bytes;    // number of transferred bytes
+  unsigned long syscalls; // number of system calls (ioctl + CS GPIO writes)
+} radio_spi_stat_t;
+//----------------------------------------------------------------------------
+// board configuration of one SX127x module (GPIO number -1 - not connected)
+typedef struct radio_cfg_ {
+  const char *spi_device; // SPI device like "/dev/spidev1.0" (ignored in SIM)
+  int spi_speed;          // SPI max speed [Hz]
+  int native_cs;          // 1 - CS pin is CEx of SPI controller
+  int gpio_dio[RADIO_DIO_NUM]; // DIO0...DIO5 inputs (DIO0 - main IRQ,
+                               // DIO1 - `FifoLevel` in FSK/OOK streaming)
+  int gpio_reset;         // RESET output
+  int gpio_cs;            // CS (NSS) output
+  int gpio_data;          // DATA (DIO2 in continuous mode) output
+                          // (don't connect same pin to `gpio_dio[2]`)
+  int gpio_led;           // LED output
+} radio_cfg_t;
+//----------------------------------------------------------------------------
+// SPI bus shared by modules on separate chip selects (look radio.c)
+typedef struct radio_bus_ radio_bus_t;
+//----------------------------------------------------------------------------
+// SX127x module context (one per module on board)
+typedef struct radio_ radio_t;
+struct radio_ {
+  sx127x_t *sx;          // driver object (IRQ dispatcher routes edges to it)
+  radio_cfg_t cfg;       // board configuration
+  int index;             // slot in IRQ dispatcher (-1 - not attached)
+  int dispatch;          // 1 - IRQ thread routes events of module
+  int cs;                // current CS strategy RADIO_CS_*
+  int spi_on;            // 1 - SPI opened by radio_init()
+  int gpio_cs_on;        // 1 - CS GPIO exported and configured
+  int gpio_cs_level;     // last written CS level (-1 - unknown)
+  radio_bus_t *bus;      // lock of SPI device shared by modules on it
+  u64_t irq_ns[RADIO_DIO_NUM]; // timestamps of last edges on DIO lines [ns]
+  radio_spi_stat_t stat; // SPI exchange statistics
+
+  spi_t spi;
+  sgpio_t gpio_dio[RADIO_DIO_NUM]; // in IRQ (DIO0...DIO5)
+  sgpio_t gpio_reset; // out
+  sgpio_t gpio_cs;    // out
+  sgpio_lines_t gpio_data; // out (line group: one ioctl() per write in cdev)
+  sgpio_t gpio_led;   // out
+
+  // TX done condition (look radio_tx_wait()/radio_tx_wake())
+  pthread_mutex_t tx_mutex;
+  pthread_cond_t  tx_cond;
+
+#ifdef SX127X_USE_RXQ
+  // eventfd signalled when frame is put to RX ring (look radio_rxq_wait())
+  int rxq_efd;
+#endif
+
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_DUTY)
+  // timerfd of duty-cycled receive in IRQ thread (look radio_rx_duty())
+  int duty_tfd;
+#endif
+
+#if defined(SX127X_USE_QUEUE) && defined(SX127X_USE_LBT)
+  // one-shot timerfd of LBT backoff in IRQ thread (look radio_lbt())
+  int lbt_tfd;
+#endif
+
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_SWEEP)
+  // periodic timerfd of RSSI sweep in IRQ thread (look radio_sweep())
+  int sweep_tfd;
+#endif
+
+#ifdef RADIO_SIM
+  sx127x_sim_t sim; // software model of SX127x instead of SPI and GPIO
+#endif
+};
+//----------------------------------------------------------------------------
+// priority of bit streaming RT thread (SCHED_FIFO)
+#ifndef RADIO_BITS_PRIORITY
+#define RADIO_BITS_PRIORITY 80
+#endif
+
+// lead time from start of bit streaming to first bit [us]
+#ifndef RADIO_BITS_LEAD_US
+#define RADIO_BITS_LEAD_US 1000
+#endif
+
+// CPU of bit streaming RT thread (define it for isolated CPU, `isolcpus`)
+//#define RADIO_BITS_CPU 3
+
+// bit streaming statistics (look radio_bits_send())
+typedef struct radio_bits_stat_ {
+  u32_t bits;    // number of sent bits
+  u32_t edges;   // number of DATA line writes (level changes)
+  u32_t late;    // number of writes later than half of bit
+  u32_t bitrate; // achieved bitrate [bit/s]
+  u32_t p50_ns;  // median latency of DATA line writes [ns]
+  u32_t p90_ns;  // 90th percentile of latency [ns]
+  u32_t p99_ns;  // 99th percentile of latency [ns]
+  u32_t max_ns;  // maximum latency [ns]
+} radio_bits_stat_t;
+//----------------------------------------------------------------------------
 extern int radio_stop;
 //----------------------------------------------------------------------------
 #ifdef __cplusplus
@@ -52,33 +193,104 @@ extern "C"
 {
 #endif // __cplusplus
 //----------------------------------------------------------------------------
+// get default board configuration of SX127x module (RADIO_GPIO_* defines)
+void radio_cfg_default(radio_cfg_t *cfg);
+//-----------------------------------------------------------------------------
 // on/off DATA line
-void radio_data_on(bool on);
+void radio_data_on(radio_t *self, bool on);
 //-----------------------------------------------------------------------------
 // on/off LED
-void radio_led_on(bool on);
+void radio_led_on(radio_t *self, bool on);
 //-----------------------------------------------------------------------------
 // blink LED
-void radio_blink_led();
+void radio_blink_led(radio_t *self);
 //-----------------------------------------------------------------------------
-// hard reset SX127x radio module
-void radio_reset();
+// hard reset SX127x radio module (after sx127x_init(); shadow register
+// cache is reloaded by sx127x_cache_sync())
+void radio_reset(radio_t *self);
 //----------------------------------------------------------------------------
 // init SX127x radio module hardware layer (before call sx127x_init())
-void radio_init();
+// (`sx` - driver object, pass `self` as SPI exchange context to it;
+//  `cfg` - board configuration or NULL for default; return 0 or -1)
+int radio_init(radio_t *self, sx127x_t *sx, const radio_cfg_t *cfg);
+//-----------------------------------------------------------------------------
+// attach module to IRQ dispatcher thread (after sx127x_init()),
+// create thread once (one thread serves up to RADIO_MAX modules),
+// set hooks to sleep in sx127x_send() until TX done IRQ and SPI bus lock
+// (driver callbacks run in IRQ thread without list lock: they may call
+//  radio_rx_duty(), radio_lbt(), radio_sweep(), radio_rxq_on() and
+//  radio_create_irq_thread(), but not radio_free())
+int radio_create_irq_thread(radio_t *self);
+//-----------------------------------------------------------------------------
+// free SX127x radio module (IRQ thread is stopped with last module)
+// (waits end of event routing of module; don't call it from callbacks)
+void radio_free(radio_t *self);
+//-----------------------------------------------------------------------------
+#ifdef SX127X_USE_RXQ
+// on/off RX ring mode (after radio_init()): received frames are put to
+// lock-free ring by IRQ thread, read them by sx127x_rxq_peek()/pop()
+void radio_rxq_on(radio_t *self, bool on);
 //-----------------------------------------------------------------------------
-// create listen IRQ thread (after sx127x_init())
-void radio_create_irq_thread();
+// get eventfd signalled when frame is put to RX ring (for poll()/epoll())
+int radio_rxq_fd(const radio_t *self);
 //-----------------------------------------------------------------------------
-// free SX127x radio module
-void radio_free();
+// wait frames in RX ring (msec < 0 - infinite)
+// (return number of frames, 0 - timeout, < 0 - error)
+int radio_rxq_wait(radio_t *self, int msec);
+#endif
+//-----------------------------------------------------------------------------
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_DUTY)
+// on/off duty-cycled receive (LoRa, after radio_create_irq_thread()):
+// IRQ thread opens RX single window by timerfd each period and sleeps
+// (look sx127x_rx_duty(); return period [us], 0 - off or preamble is short)
+u32_t radio_rx_duty(radio_t *self, bool on, u16_t window);
+#endif
+//-----------------------------------------------------------------------------
+#if defined(SX127X_USE_QUEUE) && defined(SX127X_USE_LBT)
+// on/off listen before talk in asynchronous TX queue (after
+// radio_create_irq_thread()): IRQ thread waits backoff by one-shot timerfd
+// (look sx127x_lbt(); return slot [us], 0 - off)
+u32_t radio_lbt(radio_t *self, bool on, u32_t slot_us, i16_t rssi);
+#endif
+//-----------------------------------------------------------------------------
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_SWEEP)
+// on/off RSSI sweep (FSK/OOK, after radio_create_irq_thread()): IRQ
+// thread reads RSSI and hops to next bin by timerfd each dwell time
+// (look sx127x_sweep(); return dwell time [us], 0 - off)
+u32_t radio_sweep(radio_t *self, bool on, u32_t freq, u32_t step, int bins);
+#endif
+//-----------------------------------------------------------------------------
+// clock out `bits` bits of `data` (MSB first) on DATA line (DIO2 in
+// continuous mode) by RT thread with absolute deadlines; level changes are
+// precomputed as one batch, DATA line (sgpio_lines_t) is written only on
+// level change and is low after last bit
+// (call between sx127x_tx() and sx127x_standby() in continuous mode;
+//  return 0 or -1 on error, `stat` - achieved bitrate and jitter or NULL)
+int radio_bits_send(radio_t *self, const u8_t *data, int bits, u32_t bitrate,
+                    radio_bits_stat_t *stat);
+//-----------------------------------------------------------------------------
+// reset SPI exchange statistics
+void radio_spi_stat_reset(radio_t *self);
+//-----------------------------------------------------------------------------
+// select CS strategy RADIO_CS_* (after radio_init(): it sets RADIO_CS_MODE),
+// return selected strategy (RADIO_CS_AUTO is resolved)
+int radio_spi_cs_mode(radio_t *self, int mode);
+//-----------------------------------------------------------------------------
+// get name of CS strategy
+const char *radio_spi_cs_name(int mode);
 //-----------------------------------------------------------------------------
 // SPI exchange wrapper function (return number or RX bytes)
 int radio_spi_exchange(
   u8_t       *rx_buf, // RX buffer
   const u8_t *tx_buf, // TX buffer
   u8_t len,           // number of bytes
-  void *context);     // optional SPI context or NULL
+  void *context);     // pointer to `radio_t` object
+//----------------------------------------------------------------------------
+// vectored SPI exchange wrapper function (return number or RX bytes)
+int radio_spi_exchange_v(
+  const sx127x_seg_t *seg, // array of segments
+  int n,                   // number of segments
+  void *context);          // pointer to `radio_t` object
 //----------------------------------------------------------------------------
 #ifdef __cplusplus
 }
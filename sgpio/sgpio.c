@@ -8,7 +8,21 @@
 #include <string.h>    // strlen(), memset(), strerror()
 #include <poll.h>      // poll()
 #include <sys/epoll.h> // epoll()
+#include <sys/eventfd.h> // eventfd()
 #include <stdio.h>     // snprintf()
+#include <time.h>      // clock_gettime()
+#ifdef SGPIO_CDEV
+#  include <sys/ioctl.h>  // ioctl()
+#  include <linux/gpio.h> // GPIO_V2_*
+#endif
+//----------------------------------------------------------------------------
+#ifdef SGPIO_CDEV
+#  define SGPIO_POLLEV  POLLIN               // edge events are ready to read
+#  define SGPIO_EPOLLEV EPOLLIN              // level: events must be read
+#else
+#  define SGPIO_POLLEV  POLLPRI              // sysfs "value" file edge
+#  define SGPIO_EPOLLEV (EPOLLPRI | EPOLLET) // edge: no dummy read()
+#endif
 //----------------------------------------------------------------------------
 // write `size` bytes to stream `fd` from `buf` at once
 int sgpio_write(int fd, const char *buf, int size)
@@ -36,6 +50,7 @@ int sgpio_write(int fd, const char *buf, int size)
   return cnt;
 }
 //----------------------------------------------------------------------------
+#ifndef SGPIO_CDEV
 // write num to /sys/class/gpio/export file
 int sgpio_export(int num)
 {
@@ -103,6 +118,7 @@ int sgpio_mode(sgpio_t *self,
 {
   static char str_in[]      = SGPIO_STR_IN;
   static char str_out[]     = SGPIO_STR_OUT;
+  static char str_high[]    = SGPIO_STR_HIGH;
 
   static char str_none[]    = SGPIO_STR_NONE;
   static char str_rising[]  = SGPIO_STR_RISING;
@@ -112,7 +128,7 @@ int sgpio_mode(sgpio_t *self,
   char *str, fname[SGPIO_PATH_MAX];
   int fd, str_size, retv;
 
-  if (self->fd > 0)
+  if (self->fd >= 0)
   {
     close(self->fd);
     self->fd = -1;
@@ -131,7 +147,12 @@ int sgpio_mode(sgpio_t *self,
     return SGPIO_ERR_OPEN_DIR; 
   }
 
-  if (dir == SGPIO_DIR_OUT)
+  if (dir == SGPIO_DIR_OUT_HIGH)
+  { // output with initial high level by one write
+    dir = SGPIO_DIR_OUT;
+    str = str_high;
+  }
+  else if (dir == SGPIO_DIR_OUT)
     str = str_out;
   else // if (dir == SGPIO_DIR_IN)
   {
@@ -274,6 +295,320 @@ int sgpio_set(sgpio_t *self, int val)
   return SGPIO_ERR_NONE;
 }
 //----------------------------------------------------------------------------
+// read pending edge events (return number of events or error code < 0)
+// cdev: batch of events with kernel timestamps (0 if no events)
+// sysfs: one event by current level with user space timestamp
+int sgpio_events(sgpio_t *self, sgpio_event_t *ev, int max)
+{
+  struct timespec ts;
+  int val;
+
+  if (max <= 0) return 0;
+
+  val = sgpio_get(self); // clear POLLPRI
+  if (val < 0) return val;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ev->ns   = ((unsigned long long) ts.tv_sec) * 1000000000ull +
+             (unsigned long long) ts.tv_nsec;
+  ev->num  = self->num;
+  ev->edge = val ? SGPIO_EDGE_RISING : SGPIO_EDGE_FALLING;
+
+  return 1;
+}
+#else // SGPIO_CDEV
+//----------------------------------------------------------------------------
+// request lines of GPIO chip (return line request fd or error code < 0)
+static int sgpio_cdev_request(const int *num, int n, int dir, int edge)
+{
+  struct gpio_v2_line_request req;
+  int i, fd, retv;
+
+  memset((void*) &req, 0, sizeof(req));
+  for (i = 0; i < n; i++)
+    req.offsets[i] = (__u32) num[i];
+  req.num_lines = (__u32) n;
+  strncpy(req.consumer, SGPIO_CONSUMER, sizeof(req.consumer) - 1);
+
+  if (dir == SGPIO_DIR_OUT || dir == SGPIO_DIR_OUT_HIGH)
+  { // initial level of all lines (else kernel drives them low at request)
+    req.config.flags = GPIO_V2_LINE_FLAG_OUTPUT;
+    req.config.num_attrs = 1;
+    req.config.attrs[0].attr.id     = GPIO_V2_LINE_ATTR_ID_OUTPUT_VALUES;
+    req.config.attrs[0].attr.values =
+      dir == SGPIO_DIR_OUT_HIGH ? (((__u64) 1) << n) - 1 : 0;
+    req.config.attrs[0].mask = (((__u64) 1) << n) - 1;
+  }
+  else
+  {
+    req.config.flags = GPIO_V2_LINE_FLAG_INPUT;
+    if (edge == SGPIO_EDGE_RISING || edge == SGPIO_EDGE_BOTH)
+      req.config.flags |= GPIO_V2_LINE_FLAG_EDGE_RISING;
+    if (edge == SGPIO_EDGE_FALLING || edge == SGPIO_EDGE_BOTH)
+      req.config.flags |= GPIO_V2_LINE_FLAG_EDGE_FALLING;
+  }
+
+  fd = open(SGPIO_CHIP, O_RDWR | O_CLOEXEC);
+  if (fd < 0)
+  {
+    SGPIO_DBG("can't open '%s': '%s' in sgpio_cdev_request(%d)",
+              SGPIO_CHIP, strerror(errno), num[0]);
+    return SGPIO_ERR_OPEN_CHIP;
+  }
+
+  retv = ioctl(fd, GPIO_V2_GET_LINE_IOCTL, &req);
+  close(fd);
+  if (retv < 0)
+  {
+    SGPIO_DBG("ioctl(GPIO_V2_GET_LINE) error: '%s' in sgpio_cdev_request(%d)",
+              strerror(errno), num[0]);
+    return SGPIO_ERR_REQUEST;
+  }
+
+  // read edge events without blocking (look sgpio_events())
+  if (edge != SGPIO_EDGE_NONE)
+    fcntl(req.fd, F_SETFL, fcntl(req.fd, F_GETFL) | O_NONBLOCK);
+
+  return req.fd;
+}
+//----------------------------------------------------------------------------
+// no export in cdev (lines are requested by sgpio_mode())
+int sgpio_export(int num)
+{
+  return SGPIO_ERR_NONE;
+}
+//----------------------------------------------------------------------------
+// no unexport in cdev (lines are released by sgpio_free())
+int sgpio_unexport(int num)
+{
+  return SGPIO_ERR_NONE;
+}
+//----------------------------------------------------------------------------
+// set GPIO mode (request line of GPIO chip)
+int sgpio_mode(sgpio_t *self,
+               int dir,  // sgpio_dir_t
+               int edge) // sgpio_edge_t
+{
+  int fd;
+
+  if (self->fd >= 0)
+  {
+    close(self->fd);
+    self->fd = -1;
+  }
+
+  if (dir != SGPIO_DIR_OUT && dir != SGPIO_DIR_OUT_HIGH)
+    dir = SGPIO_DIR_IN;
+
+  if (dir != SGPIO_DIR_IN ||
+      (edge != SGPIO_EDGE_RISING && edge != SGPIO_EDGE_FALLING &&
+       edge != SGPIO_EDGE_BOTH))
+    edge = SGPIO_EDGE_NONE;
+
+  fd = sgpio_cdev_request(&self->num, 1, dir, edge);
+  if (fd < 0) return fd;
+
+  self->fd   = fd;
+  self->dir  = dir == SGPIO_DIR_IN ? SGPIO_DIR_IN : SGPIO_DIR_OUT;
+  self->edge = edge;
+
+  return SGPIO_ERR_NONE;
+}
+//----------------------------------------------------------------------------
+// get value (return 0 or 1 or error code < 0)
+int sgpio_get(sgpio_t *self)
+{
+  struct gpio_v2_line_values val;
+
+  if (self->fd < 0)
+  {
+    SGPIO_DBG("unset mode in sgpio_get(%d)", self->num);
+    return SGPIO_ERR_UNSET_MODE;
+  }
+
+  val.mask = 1;
+  val.bits = 0;
+  if (ioctl(self->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &val) < 0)
+  {
+    SGPIO_DBG("ioctl(GPIO_V2_LINE_GET_VALUES) error in sgpio_get(%d)",
+              self->num);
+    return SGPIO_ERR_GET;
+  }
+
+  return (val.bits & 1) ? 1 : 0;
+}
+//----------------------------------------------------------------------------
+// set value (return 0 or 1 or error code < 0)
+int sgpio_set(sgpio_t *self, int val)
+{
+  struct gpio_v2_line_values v;
+
+  if (self->fd < 0)
+  {
+    SGPIO_DBG("unset mode in sgpio_set(%d)", self->num);
+    return SGPIO_ERR_UNSET_MODE;
+  }
+
+  v.mask = 1;
+  v.bits = val ? 1 : 0;
+  if (ioctl(self->fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &v) < 0)
+  {
+    SGPIO_DBG("ioctl(GPIO_V2_LINE_SET_VALUES) error in sgpio_set(%d)",
+              self->num);
+    return SGPIO_ERR_SET;
+  }
+
+  return SGPIO_ERR_NONE;
+}
+//----------------------------------------------------------------------------
+// read pending edge events (return number of events or error code < 0)
+// cdev: batch of events with kernel timestamps (0 if no events)
+// sysfs: one event by current level with user space timestamp
+int sgpio_events(sgpio_t *self, sgpio_event_t *ev, int max)
+{
+  struct gpio_v2_line_event buf[SGPIO_EVENTS_MAX];
+  int i, n;
+
+  if (self->fd < 0)
+  {
+    SGPIO_DBG("unset mode in sgpio_events(%d)", self->num);
+    return SGPIO_ERR_UNSET_MODE;
+  }
+
+  if (max > SGPIO_EVENTS_MAX) max = SGPIO_EVENTS_MAX;
+  if (max <= 0) return 0;
+
+  n = read(self->fd, (void*) buf, sizeof(buf[0]) * max);
+  if (n < 0)
+  {
+    if (errno == EAGAIN || errno == EINTR)
+      return 0; // no events
+
+    SGPIO_DBG("read() return %d: '%s' in sgpio_events(%d)",
+              n, strerror(errno), self->num);
+    return SGPIO_ERR_EVENT;
+  }
+
+  n /= sizeof(buf[0]);
+  for (i = 0; i < n; i++)
+  {
+    ev[i].ns   = (unsigned long long) buf[i].timestamp_ns;
+    ev[i].num  = (int) buf[i].offset;
+    ev[i].edge = buf[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE ?
+                 SGPIO_EDGE_RISING : SGPIO_EDGE_FALLING;
+  }
+
+  return n;
+}
+#endif // SGPIO_CDEV
+//----------------------------------------------------------------------------
+// set mode of group of lines (GPIO must be exported in sysfs)
+int sgpio_lines_init(sgpio_lines_t *self,
+                     const int *num, // GPIO numbers
+                     int n,          // number of lines
+                     int dir)        // sgpio_dir_t
+{
+  int i;
+
+  if (n <= 0 || n > SGPIO_LINES_MAX)
+    return SGPIO_ERR_LINES;
+
+  self->n   = n;
+  self->dir = dir == SGPIO_DIR_OUT ? SGPIO_DIR_OUT : SGPIO_DIR_IN;
+  for (i = 0; i < n; i++)
+    self->num[i] = num[i];
+
+#ifdef SGPIO_CDEV
+  // all lines by one request
+  self->fd = sgpio_cdev_request(num, n, self->dir, SGPIO_EDGE_NONE);
+  return self->fd < 0 ? self->fd : SGPIO_ERR_NONE;
+#else
+  for (i = 0; i < n; i++)
+  {
+    int retv;
+    sgpio_init(&self->gpio[i], num[i]);
+    retv = sgpio_mode(&self->gpio[i], self->dir, SGPIO_EDGE_NONE);
+    if (retv < 0)
+    {
+      self->n = i;
+      sgpio_lines_free(self);
+      return retv;
+    }
+  }
+  return SGPIO_ERR_NONE;
+#endif
+}
+//----------------------------------------------------------------------------
+// free group of lines
+void sgpio_lines_free(sgpio_lines_t *self)
+{
+#ifdef SGPIO_CDEV
+  if (self->fd >= 0) close(self->fd);
+  self->fd = -1;
+#else
+  int i;
+  for (i = 0; i < self->n; i++)
+    sgpio_free(&self->gpio[i]);
+#endif
+  self->n = 0;
+}
+//----------------------------------------------------------------------------
+// get values of group of lines by one ioctl() in cdev
+// (return bit mask: bit i - line num[i], or error code < 0)
+int sgpio_lines_get(sgpio_lines_t *self)
+{
+#ifdef SGPIO_CDEV
+  struct gpio_v2_line_values val;
+
+  val.mask = (1ull << self->n) - 1;
+  val.bits = 0;
+  if (ioctl(self->fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &val) < 0)
+  {
+    SGPIO_DBG("ioctl(GPIO_V2_LINE_GET_VALUES) error in sgpio_lines_get()");
+    return SGPIO_ERR_GET;
+  }
+
+  return (int) val.bits;
+#else
+  int i, retv, bits = 0;
+  for (i = 0; i < self->n; i++)
+  {
+    retv = sgpio_get(&self->gpio[i]);
+    if (retv < 0) return retv;
+    if (retv) bits |= 1 << i;
+  }
+  return bits;
+#endif
+}
+//----------------------------------------------------------------------------
+// set values of group of lines by one ioctl() in cdev
+// (bits of lines selected by `mask`; return 0 or error code < 0)
+int sgpio_lines_set(sgpio_lines_t *self, int mask, int bits)
+{
+#ifdef SGPIO_CDEV
+  struct gpio_v2_line_values val;
+
+  val.mask = (unsigned) mask & ((1u << self->n) - 1);
+  val.bits = (unsigned) bits;
+  if (ioctl(self->fd, GPIO_V2_LINE_SET_VALUES_IOCTL, &val) < 0)
+  {
+    SGPIO_DBG("ioctl(GPIO_V2_LINE_SET_VALUES) error in sgpio_lines_set()");
+    return SGPIO_ERR_SET;
+  }
+
+  return SGPIO_ERR_NONE;
+#else
+  int i, retv;
+  for (i = 0; i < self->n; i++)
+  {
+    if (!(mask & (1 << i))) continue;
+    retv = sgpio_set(&self->gpio[i], bits & (1 << i));
+    if (retv < 0) return retv;
+  }
+  return SGPIO_ERR_NONE;
+#endif
+}
+//----------------------------------------------------------------------------
 // pool wraper for non block read (return 0:false, 1:true, <0:error code)
 // msec - timeout in ms
 // if sigmask!=0 ignore interrupt by signals
@@ -292,7 +627,7 @@ int sgpio_poll_ex(const sgpio_t *self, int msec, int sigmask)
   {
     memset((void*) fds, 0, sizeof(fds));
     fds->fd      = self->fd;
-    fds->events  = POLLPRI;
+    fds->events  = SGPIO_POLLEV;
     fds->revents = 0;
 
     retv = poll(fds, 1, msec);
@@ -324,7 +659,7 @@ int sgpio_poll_ex(const sgpio_t *self, int msec, int sigmask)
 
   if (retv > 0)
   {
-    if (fds->revents & POLLPRI)
+    if (fds->revents & SGPIO_POLLEV)
       return 1; // may non block read
     
     return SGPIO_ERR_POOL2; // error #2
@@ -346,7 +681,7 @@ int sgpio_epoll(const sgpio_t *self, int msec)
     return SGPIO_ERR_UNSET_MODE;
   }
 
-  ev.events  = EPOLLET;
+  ev.events  = SGPIO_EPOLLEV;
   ev.data.fd = self->fd;
   
   epfd = epoll_create(1);
@@ -385,6 +720,150 @@ int sgpio_epoll(const sgpio_t *self, int msec)
   return 0; // empty
 }
 //----------------------------------------------------------------------------
+// register file descriptor in wait context
+static int sgpio_wait_ctl(sgpio_wait_t *self, int fd, unsigned events,
+                          unsigned data)
+{
+  struct epoll_event ev;
+  int retv;
+
+  memset((void*) &ev, 0, sizeof(ev));
+  ev.events   = events;
+  ev.data.u32 = data;
+
+  retv = epoll_ctl(self->epfd, EPOLL_CTL_ADD, fd, &ev);
+  if (retv != 0)
+  {
+    SGPIO_DBG("epoll_ctl(%d) return %d: '%s' in sgpio_wait_ctl()",
+              fd, retv, strerror(errno));
+    return SGPIO_ERR_EPOOL2;
+  }
+
+  return SGPIO_ERR_NONE;
+}
+//----------------------------------------------------------------------------
+// create wait context: epoll instance with wake-up eventfd
+int sgpio_wait_init(sgpio_wait_t *self)
+{
+  int retv;
+
+  self->evfd = -1;
+  self->epfd = epoll_create1(EPOLL_CLOEXEC);
+  if (self->epfd < 0)
+  {
+    SGPIO_DBG("epoll_create1() return %d: '%s' in sgpio_wait_init()",
+              self->epfd, strerror(errno));
+    return SGPIO_ERR_EPOOL1;
+  }
+
+  self->evfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (self->evfd < 0)
+  {
+    SGPIO_DBG("eventfd() return %d: '%s' in sgpio_wait_init()",
+              self->evfd, strerror(errno));
+    sgpio_wait_free(self);
+    return SGPIO_ERR_EVENTFD;
+  }
+
+  retv = sgpio_wait_ctl(self, self->evfd, EPOLLIN, SGPIO_WAIT_WAKE);
+  if (retv != SGPIO_ERR_NONE)
+    sgpio_wait_free(self);
+
+  return retv;
+}
+//----------------------------------------------------------------------------
+// free wait context
+void sgpio_wait_free(sgpio_wait_t *self)
+{
+  if (self->evfd >= 0) close(self->evfd);
+  if (self->epfd >= 0) close(self->epfd);
+  self->evfd = -1;
+  self->epfd = -1;
+}
+//----------------------------------------------------------------------------
+// register GPIO "value" file in wait context once (edge by POLLPRI)
+// id - line ID 0...SGPIO_WAIT_MAX-1 (bit number in sgpio_wait() result)
+int sgpio_wait_add(sgpio_wait_t *self, const sgpio_t *gpio, int id)
+{
+  if (gpio->fd < 0)
+  {
+    SGPIO_DBG("unset mode in sgpio_wait_add(%d,%d)", gpio->num, id);
+    return SGPIO_ERR_UNSET_MODE;
+  }
+
+  if (id < 0 || id >= SGPIO_WAIT_MAX)
+    return SGPIO_ERR_WAIT_ID;
+
+  // sysfs: edge triggered POLLPRI; cdev: edge events must be read
+  return sgpio_wait_ctl(self, gpio->fd, SGPIO_EPOLLEV, 1u << id);
+}
+//----------------------------------------------------------------------------
+// register other file descriptor in wait context (ready by POLLIN)
+// id - line ID 0...SGPIO_WAIT_MAX-1 (bit number in sgpio_wait() result)
+int sgpio_wait_add_fd(sgpio_wait_t *self, int fd, int id)
+{
+  if (id < 0 || id >= SGPIO_WAIT_MAX)
+    return SGPIO_ERR_WAIT_ID;
+
+  return sgpio_wait_ctl(self, fd, EPOLLIN, 1u << id);
+}
+//----------------------------------------------------------------------------
+// unregister file descriptor (or GPIO "value" file) from wait context
+int sgpio_wait_del(sgpio_wait_t *self, int fd)
+{
+  int retv = epoll_ctl(self->epfd, EPOLL_CTL_DEL, fd, NULL);
+  if (retv != 0)
+  {
+    SGPIO_DBG("epoll_ctl(%d) return %d: '%s' in sgpio_wait_del()",
+              fd, retv, strerror(errno));
+    return SGPIO_ERR_EPOOL2;
+  }
+
+  return SGPIO_ERR_NONE;
+}
+//----------------------------------------------------------------------------
+// wait registered lines or wake-up request
+// (return bit mask of ready lines | SGPIO_WAIT_WAKE, 0:timeout, <0:error)
+// msec - timeout in ms (-1 - infinite)
+int sgpio_wait(sgpio_wait_t *self, int msec)
+{
+  struct epoll_event events[SGPIO_WAIT_MAX + 1];
+  unsigned long long cnt;
+  int retv, i, mask = 0;
+
+  retv = epoll_wait(self->epfd, events, SGPIO_WAIT_MAX + 1, msec);
+  if (retv < 0)
+  {
+    if (errno == EINTR)
+      return 0; // interrupt by signal
+
+    SGPIO_DBG("epoll_wait() return %d: '%s' in sgpio_wait()",
+              retv, strerror(errno));
+    return SGPIO_ERR_EPOOL3;
+  }
+
+  for (i = 0; i < retv; i++)
+  {
+    mask |= (int) events[i].data.u32;
+
+    if (events[i].data.u32 == SGPIO_WAIT_WAKE) // clear eventfd counter
+      if (read(self->evfd, (void*) &cnt, sizeof(cnt)) < 0)
+        SGPIO_DBG("read(eventfd) error: '%s' in sgpio_wait()",
+                  strerror(errno));
+  }
+
+  return mask;
+}
+//----------------------------------------------------------------------------
+// wake up thread blocked in sgpio_wait() (may be called from any thread)
+void sgpio_wait_wake(sgpio_wait_t *self)
+{
+  unsigned long long one = 1;
+  if (write(self->evfd, (const void*) &one, sizeof(one)) < 0)
+    SGPIO_DBG("write(eventfd) error: '%s' in sgpio_wait_wake()",
+              strerror(errno));
+}
+//----------------------------------------------------------------------------
 const char *sgpio_errors[] = {
   "success",
   "can't write fo file",
@@ -404,6 +883,12 @@ const char *sgpio_errors[] = {
   "epool() return error #1",
   "epool() return error #2",
   "epool() return error #3",
+  "eventfd() return error",
+  "bad line ID in wait context",
+  "can't open GPIO chip device",
+  "can't request lines of GPIO chip",
+  "read() of edge events return error",
+  "bad number of lines in group",
 };
 static const char *sgpio_error_unknown = "unknown error";
 //----------------------------------------------------------------------------
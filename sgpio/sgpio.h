@@ -15,6 +15,19 @@
 #define SGPIO_MAIN_PATH "/sys/class/gpio/"
 //#define SGPIO_MAIN_PATH "./gpio/" // FIXME test directory
 //----------------------------------------------------------------------------
+// use GPIO character device (gpiochip, uAPI v2) instead of sysfs
+//#define SGPIO_CDEV
+
+#ifdef SGPIO_CDEV
+// GPIO chip device (GPIO number is line offset on this chip)
+#ifndef SGPIO_CHIP
+#define SGPIO_CHIP "/dev/gpiochip0"
+#endif
+
+// consumer label of requested lines
+#define SGPIO_CONSUMER "sgpio"
+#endif // SGPIO_CDEV
+//----------------------------------------------------------------------------
 // max path size
 //#define SGPIO_PATH_MAX 1024
 #define SGPIO_PATH_MAX PATH_MAX
@@ -23,8 +36,9 @@
 #define SGPIO_STR_MAX 80
 //----------------------------------------------------------------------------
 // write strings to "direction" file
-#define SGPIO_STR_IN  "in"
-#define SGPIO_STR_OUT "out"
+#define SGPIO_STR_IN   "in"
+#define SGPIO_STR_OUT  "out"
+#define SGPIO_STR_HIGH "high"
 //----------------------------------------------------------------------------
 // write strings to "edge" file
 #define SGPIO_STR_NONE    "none"
@@ -32,6 +46,12 @@
 #define SGPIO_STR_FALLING "falling"
 #define SGPIO_STR_BOTH    "both"
 //----------------------------------------------------------------------------
+// max number of edge events read at once by sgpio_events()
+#define SGPIO_EVENTS_MAX 16
+
+// max number of lines in group (look `sgpio_lines_t`)
+#define SGPIO_LINES_MAX 16
+//----------------------------------------------------------------------------
 // inline macro (platform depended)
 #ifndef   SGPIO_INLINE
 #  define SGPIO_INLINE static inline
@@ -64,15 +84,30 @@
 #define SGPIO_ERR_EPOOL1     -15 // epool() return error #1
 #define SGPIO_ERR_EPOOL2     -16 // epool() return error #2
 #define SGPIO_ERR_EPOOL3     -17 // epool() return error #3
+#define SGPIO_ERR_EVENTFD    -18 // eventfd() return error
+#define SGPIO_ERR_WAIT_ID    -19 // bad line ID in wait context
+#define SGPIO_ERR_OPEN_CHIP  -20 // can't open GPIO chip device
+#define SGPIO_ERR_REQUEST    -21 // can't request lines of GPIO chip
+#define SGPIO_ERR_EVENT      -22 // read() of edge events return error
+#define SGPIO_ERR_LINES      -23 // bad number of lines in group
 
-#define SGPIO_ERROR_NUM        18          // look sgpio_error_str() code
+#define SGPIO_ERROR_NUM        24          // look sgpio_error_str() code
 #define SGPIO_ERROR_INDEX(err) (0 - (err)) // ...
 //----------------------------------------------------------------------------
+// max number of lines (file descriptors) in wait context (up to 30)
+#ifndef SGPIO_WAIT_MAX
+#define SGPIO_WAIT_MAX 30
+#endif
+
+// wake-up bit returned by sgpio_wait() (look sgpio_wait_wake())
+#define SGPIO_WAIT_WAKE 0x40000000
+//----------------------------------------------------------------------------
 // GPIO input/output direction mode
 typedef enum {
   SGPIO_DIR_UNSET = 0, // initial set
   SGPIO_DIR_IN,        // input mode
-  SGPIO_DIR_OUT        // output mode
+  SGPIO_DIR_OUT,       // output mode (initial low level)
+  SGPIO_DIR_OUT_HIGH   // output mode with initial high level (no low glitch)
 } sgpio_dir_t;
 //----------------------------------------------------------------------------
 // GPIO edge mode
@@ -85,12 +120,38 @@ typedef enum {
 //----------------------------------------------------------------------------
 // `sgpio_t` type structure
 typedef struct sgpio_ {
-  int num;  // GPIO number /sys/class/gpio/gpioNUM
+  int num;  // GPIO number /sys/class/gpio/gpioNUM (line offset in cdev)
   int dir;  // GPIO input/output derection mode
   int edge; // GPIO edge mode
   int fd;   // file descriptor of /sys/class/gpio/gpioNUM/value
+            // (line request file descriptor in cdev)
 } sgpio_t;
 //----------------------------------------------------------------------------
+// edge event (look sgpio_events())
+typedef struct sgpio_event_ {
+  unsigned long long ns; // timestamp [ns] by CLOCK_MONOTONIC
+  int num;               // GPIO number
+  int edge;              // SGPIO_EDGE_RISING or SGPIO_EDGE_FALLING
+} sgpio_event_t;
+//----------------------------------------------------------------------------
+// `sgpio_lines_t` type structure (group of lines set/get at once)
+typedef struct sgpio_lines_ {
+  int n;                         // number of lines
+  int num[SGPIO_LINES_MAX];      // GPIO numbers
+  int dir;                       // GPIO input/output derection mode
+#ifdef SGPIO_CDEV
+  int fd;                        // line request file descriptor
+#else
+  sgpio_t gpio[SGPIO_LINES_MAX]; // one "value" file per line
+#endif
+} sgpio_lines_t;
+//----------------------------------------------------------------------------
+// `sgpio_wait_t` type structure (long-lived epoll wait context)
+typedef struct sgpio_wait_ {
+  int epfd; // epoll file descriptor
+  int evfd; // eventfd file descriptor for wake-up requests
+} sgpio_wait_t;
+//----------------------------------------------------------------------------
 #ifdef __cplusplus
 extern "C"
 {
@@ -117,7 +178,7 @@ SGPIO_INLINE void sgpio_init(sgpio_t *self, int num)
 // "destructor"
 SGPIO_INLINE void sgpio_free(sgpio_t *self)
 {
-  if (self->fd > 0) close(self->fd);
+  if (self->fd >= 0) close(self->fd);
   self->fd = -1;
 }
 //----------------------------------------------------------------------------
@@ -129,7 +190,7 @@ int sgpio_mode(sgpio_t *self,
 // set GPIO number
 SGPIO_INLINE void sgpio_set_num(sgpio_t *self, int num)
 {
-  if (self->fd > 0) close(self->fd);
+  if (self->fd >= 0) close(self->fd);
   sgpio_init(self, num);
 }
 //----------------------------------------------------------------------------
@@ -151,6 +212,11 @@ int sgpio_get(sgpio_t *self);
 // set value (return 0 or 1 or error code < 0)
 int sgpio_set(sgpio_t *self, int val);
 //----------------------------------------------------------------------------
+// read pending edge events (return number of events or error code < 0)
+// cdev: batch of events with kernel timestamps (0 if no events)
+// sysfs: one event by current level with user space timestamp
+int sgpio_events(sgpio_t *self, sgpio_event_t *ev, int max);
+//----------------------------------------------------------------------------
 // pool wraper for non block read (return 0:false, 1:true, <0:error code)
 // msec - timeout in ms
 // if sigmask!=0 ignore interrupt by signals
@@ -167,6 +233,48 @@ SGPIO_INLINE int sgpio_poll(const sgpio_t *self, int msec)
 // msec - timeout in ms
 int sgpio_epoll(const sgpio_t *self, int msec);
 //----------------------------------------------------------------------------
+// set mode of group of lines (GPIO must be exported in sysfs)
+int sgpio_lines_init(sgpio_lines_t *self,
+                     const int *num, // GPIO numbers
+                     int n,          // number of lines
+                     int dir);       // sgpio_dir_t
+//----------------------------------------------------------------------------
+// free group of lines
+void sgpio_lines_free(sgpio_lines_t *self);
+//----------------------------------------------------------------------------
+// get values of group of lines by one ioctl() in cdev
+// (return bit mask: bit i - line num[i], or error code < 0)
+int sgpio_lines_get(sgpio_lines_t *self);
+//----------------------------------------------------------------------------
+// set values of group of lines by one ioctl() in cdev
+// (bits of lines selected by `mask`; return 0 or error code < 0)
+int sgpio_lines_set(sgpio_lines_t *self, int mask, int bits);
+//----------------------------------------------------------------------------
+// create wait context: epoll instance with wake-up eventfd
+int sgpio_wait_init(sgpio_wait_t *self);
+//----------------------------------------------------------------------------
+// free wait context
+void sgpio_wait_free(sgpio_wait_t *self);
+//----------------------------------------------------------------------------
+// register GPIO "value" file in wait context once (edge by POLLPRI)
+// id - line ID 0...SGPIO_WAIT_MAX-1 (bit number in sgpio_wait() result)
+int sgpio_wait_add(sgpio_wait_t *self, const sgpio_t *gpio, int id);
+//----------------------------------------------------------------------------
+// register other file descriptor in wait context (ready by POLLIN)
+// id - line ID 0...SGPIO_WAIT_MAX-1 (bit number in sgpio_wait() result)
+int sgpio_wait_add_fd(sgpio_wait_t *self, int fd, int id);
+//----------------------------------------------------------------------------
+// unregister file descriptor (or GPIO "value" file) from wait context
+int sgpio_wait_del(sgpio_wait_t *self, int fd);
+//----------------------------------------------------------------------------
+// wait registered lines or wake-up request
+// (return bit mask of ready lines | SGPIO_WAIT_WAKE, 0:timeout, <0:error)
+// msec - timeout in ms (-1 - infinite)
+int sgpio_wait(sgpio_wait_t *self, int msec);
+//----------------------------------------------------------------------------
+// wake up thread blocked in sgpio_wait() (may be called from any thread)
+void sgpio_wait_wake(sgpio_wait_t *self);
+//----------------------------------------------------------------------------
 // return SGPIO error string
 const char *sgpio_error_str(int err);
 //----------------------------------------------------------------------------
@@ -164,6 +164,39 @@ int spi_exchange(spi_t *self, char *rx_buf, const char *tx_buf, int len)
   return retv;
 }
 //----------------------------------------------------------------------------
+// vectored transfer of `n` segments by one ioctl(SPI_IOC_MESSAGE(n))
+// (n <= SPI_SEG_MAX, return number of bytes or error code < 0)
+int spi_transfer_v(spi_t *self, const spi_seg_t *seg, int n)
+{
+  struct spi_ioc_transfer xfer[SPI_SEG_MAX];
+  int i, retv;
+
+  if (n <= 0 || n > SPI_SEG_MAX)
+  {
+    SPI_DBG("error in spi_transfer_v(): bad number of segments %d", n);
+    return SPI_ERR_TRANSFER;
+  }
+
+  for (i = 0; i < n; i++, seg++)
+  {
+    xfer[i] = self->xfer; // speed, delay, bits per word
+    xfer[i].tx_buf    = (__u64) seg->tx_buf; // output buffer
+    xfer[i].rx_buf    = (__u64) seg->rx_buf; // input buffer
+    xfer[i].len       = (__u32) seg->len;    // length of segment
+    xfer[i].cs_change = (__u8)  seg->cs_change;
+  }
+
+  retv = ioctl(self->fd, SPI_IOC_MESSAGE(n), xfer);
+  if (retv < 0)
+  {
+    SPI_DBG("error in spi_transfer_v(): ioctl(SPI_IOC_MESSAGE(%d)) return %d",
+            n, retv);
+    return SPI_ERR_TRANSFER;
+  }
+
+  return retv;
+}
+//----------------------------------------------------------------------------
 
 /*** end of "spi.c" file ***/
 
@@ -21,6 +21,7 @@
 #define SPI_ERR_READ       -9 // can't read
 #define SPI_ERR_WRITE     -10 // can't write
 #define SPI_ERR_EXCHANGE  -11 // can't read/write
+#define SPI_ERR_TRANSFER  -12 // can't do vectored transfer
 
 //----------------------------------------------------------------------------
 #ifdef SPI_DEBUG
@@ -30,6 +31,19 @@
 #  define SPI_DBG(fmt, ...) // debug output off
 #endif // SPI_DEBUG
 //----------------------------------------------------------------------------
+// maximum number of segments in one vectored transfer
+#ifndef SPI_SEG_MAX
+#define SPI_SEG_MAX 16
+#endif
+//----------------------------------------------------------------------------
+// segment of vectored transfer (look spi_transfer_v())
+typedef struct spi_seg_ {
+  char       *rx_buf;    // input buffer or NULL
+  const char *tx_buf;    // output buffer or NULL
+  int         len;       // number of bytes
+  int         cs_change; // 1 - deselect device after segment
+} spi_seg_t;
+//----------------------------------------------------------------------------
 // `spi_t` type structure
 typedef struct spi_ {
   int   fd;    // file descriptor: fd = open(filename, O_RDWR);
@@ -67,6 +81,10 @@ int spi_write(spi_t *self, const char *tx_buf, int len);
 // read and write `len` bytes from/to SPIdev
 int spi_exchange(spi_t *self, char *rx_buf, const char *tx_buf, int len);
 //----------------------------------------------------------------------------
+// vectored transfer of `n` segments by one ioctl(SPI_IOC_MESSAGE(n))
+// (n <= SPI_SEG_MAX, return number of bytes or error code < 0)
+int spi_transfer_v(spi_t *self, const spi_seg_t *seg, int n);
+//----------------------------------------------------------------------------
 #ifdef __cplusplus
 }
 #endif // __cplusplus
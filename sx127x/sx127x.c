@@ -6,6 +6,7 @@
 
 //-----------------------------------------------------------------------------
 #include <stdio.h>      // NULL
+#include <string.h>     // memset(), memcpy()
 #include "sx127x.h"     // `sx127x_t`
 #include "sx127x_def.h" // SX127x define's
 //-----------------------------------------------------------------------------
@@ -29,6 +30,8 @@ sx127x_pars_t sx127x_pars_default = {
   0x12,   // Sync Word (allways 0x12)
   6,      // Size of preamble: 6...65535 (8 by default)
   false,  // true - implicit header mode, false - explicit
+  false,  // FHSS on/off
+  10,     // `FreqHoppingPeriod` [symbols]: 1...255
 #endif
  
 #ifdef SX127X_USE_FSKOOK
@@ -58,6 +61,41 @@ typedef struct sx127x_rf_bw_tbl_ {
 
 static sx127x_rf_bw_tbl_t sx127x_rf_bw_tbl[] = RX_BW_TABLE;
 #endif
+
+#ifdef SX127X_USE_DIO
+// events of DIO0...DIO5 lines by mapping 0b00...0b11 (LoRa, FSK/OOK packet)
+// (0b11 of DIO4 in FSK/OOK is `Rssi` or `PreambleDetect` by `RegDioMapping2`)
+static const u8_t sx127x_dio_tbl[2][SX127X_DIO_NUM][4] = {
+  { // LoRa
+    {SX127X_EV_RX_DONE,      SX127X_EV_TX_DONE,
+     SX127X_EV_CAD_DONE,     SX127X_EV_NONE},            // DIO0
+    {SX127X_EV_RX_TIMEOUT,   SX127X_EV_FHSS_CHANGE,
+     SX127X_EV_CAD_DETECTED, SX127X_EV_NONE},            // DIO1
+    {SX127X_EV_FHSS_CHANGE,  SX127X_EV_FHSS_CHANGE,
+     SX127X_EV_FHSS_CHANGE,  SX127X_EV_NONE},            // DIO2
+    {SX127X_EV_CAD_DONE,     SX127X_EV_VALID_HEADER,
+     SX127X_EV_CRC_ERROR,    SX127X_EV_NONE},            // DIO3
+    {SX127X_EV_CAD_DETECTED, SX127X_EV_PLL_LOCK,
+     SX127X_EV_PLL_LOCK,     SX127X_EV_NONE},            // DIO4
+    {SX127X_EV_MODE_READY,   SX127X_EV_CLK_OUT,
+     SX127X_EV_CLK_OUT,      SX127X_EV_NONE}             // DIO5
+  },
+  { // FSK/OOK (`PayloadReady` in RX and `PacketSent` in TX on DIO0 0b00)
+    {SX127X_EV_RX_DONE,      SX127X_EV_CRC_OK,
+     SX127X_EV_NONE,         SX127X_EV_LOW_BAT},         // DIO0
+    {SX127X_EV_FIFO_LEVEL,   SX127X_EV_FIFO_EMPTY,
+     SX127X_EV_FIFO_FULL,    SX127X_EV_NONE},            // DIO1
+    {SX127X_EV_FIFO_FULL,    SX127X_EV_RX_READY,
+     SX127X_EV_RX_TIMEOUT,   SX127X_EV_SYNC_ADDRESS},    // DIO2
+    {SX127X_EV_FIFO_EMPTY,   SX127X_EV_TX_READY,
+     SX127X_EV_FIFO_EMPTY,   SX127X_EV_FIFO_EMPTY},      // DIO3
+    {SX127X_EV_LOW_BAT,      SX127X_EV_PLL_LOCK,
+     SX127X_EV_RX_TIMEOUT,   SX127X_EV_PREAMBLE_DETECT}, // DIO4
+    {SX127X_EV_CLK_OUT,      SX127X_EV_PLL_LOCK,
+     SX127X_EV_DATA,         SX127X_EV_MODE_READY}       // DIO5
+  }
+};
+#endif
 //-----------------------------------------------------------------------------
 #ifdef SX127X_USE_LORA
 // get index of bandwidth (LoRa mode), bandwidth in Hz
@@ -100,6 +138,379 @@ static void sx127x_rx_bw_pack(u32_t *bw, u8_t *m, u8_t *e)
 }
 #endif
 //-----------------------------------------------------------------------------
+// exchange `n` SPI segments (by one call if vectored exchange is set)
+static void sx127x_exchange_v(sx127x_t *self, const sx127x_seg_t *seg, int n)
+{
+  if (self->spi_exchange_v != (int (*)(const sx127x_seg_t*, int, void*)) NULL)
+  {
+    self->spi_exchange_v(seg, n, self->spi_exchange_context);
+    return;
+  }
+
+  for (; n > 0; n--, seg++)
+    self->spi_exchange(seg->rx_buf, seg->tx_buf, seg->len,
+                       self->spi_exchange_context);
+}
+//-----------------------------------------------------------------------------
+#ifdef SX127X_USE_LOCK
+// lock SPI bus: fast path by try lock, count contention of outer lock
+static void sx127x_bus_lock(sx127x_t *self, bool irq)
+{
+  bool wait = false;
+
+  if (self->bus_lock == (int (*)(sx127x_t*, bool, void*)) NULL)
+    return; // no locking
+
+  if (self->bus_lock(self, false, self->bus_context) != 0)
+  { // bus is owned by other thread
+    self->bus_lock(self, true, self->bus_context);
+    wait = true;
+  }
+
+  if (self->bus_depth++ == 0)
+  { // outer lock (transaction)
+    if (irq)
+    {
+      self->bus_stat.irq_locks++;
+      if (wait) self->bus_stat.irq_waits++;
+    }
+    else
+    {
+      self->bus_stat.locks++;
+      if (wait) self->bus_stat.waits++;
+    }
+  }
+}
+//-----------------------------------------------------------------------------
+// unlock SPI bus
+static void sx127x_bus_unlock(sx127x_t *self)
+{
+  if (self->bus_unlock == (void (*)(sx127x_t*, void*)) NULL)
+    return; // no locking
+
+  self->bus_depth--;
+  self->bus_unlock(self, self->bus_context);
+}
+
+#define SX127X_LOCK(self)     sx127x_bus_lock(self, false)
+#define SX127X_LOCK_IRQ(self) sx127x_bus_lock(self, true)
+#define SX127X_UNLOCK(self)   sx127x_bus_unlock(self)
+#else
+#define SX127X_LOCK(self)
+#define SX127X_LOCK_IRQ(self)
+#define SX127X_UNLOCK(self)
+#endif // SX127X_USE_LOCK
+//-----------------------------------------------------------------------------
+// defer callback until SPI bus is unlocked (called in callback section)
+static void sx127x_cb_put(sx127x_t *self, u8_t type, bool ok, i16_t status,
+                          int arg, void *ptr)
+{
+  sx127x_cb_t *cb;
+
+  if (self->cb_num >= SX127X_CB_MAX)
+  {
+#ifdef SX127X_USE_LOCK
+    self->bus_stat.cb_drops++;
+#endif
+    SX127X_DBG("callback %d is dropped (SX127X_CB_MAX)", (int) type);
+    return;
+  }
+
+  cb = &self->cb[self->cb_num++];
+  cb->type   = type;
+  cb->ok     = ok;
+  cb->status = status;
+  cb->arg    = arg;
+  cb->ptr    = ptr;
+}
+//-----------------------------------------------------------------------------
+// run deferred callback (SPI bus is unlocked)
+static void sx127x_cb_run(sx127x_t *self, const sx127x_cb_t *cb)
+{
+  if (cb->type == SX127X_CB_RECEIVE)
+  {
+    if (self->on_receive_ex != (void (*)(sx127x_t*, u8_t*, u8_t, bool,
+                                         const sx127x_rx_meta_t*, void*)) NULL)
+      self->on_receive_ex(self, (u8_t*) cb->ptr, (u8_t) cb->arg, cb->ok,
+                          &self->rx_meta, self->on_receive_ex_context);
+    else if (self->on_receive !=
+             (void (*)(sx127x_t*, u8_t*, u8_t, bool, void*)) NULL)
+      self->on_receive(self, (u8_t*) cb->ptr, (u8_t) cb->arg, cb->ok,
+                       self->on_receive_context);
+  }
+  else if (cb->type == SX127X_CB_TRANSMIT)
+  {
+    if (self->on_transmit != (void (*)(sx127x_t*, bool, void*)) NULL)
+      self->on_transmit(self, cb->ok, self->on_transmit_context);
+  }
+#ifdef SX127X_USE_QUEUE
+  else if (cb->type == SX127X_CB_SENT)
+  {
+    if (self->on_sent !=
+        (void (*)(sx127x_t*, void*, i16_t, u32_t, void*)) NULL)
+      self->on_sent(self, cb->ptr, cb->status, (u32_t) cb->arg,
+                    self->on_sent_context);
+  }
+#endif
+#ifdef SX127X_USE_DIO
+  else if (cb->type == SX127X_CB_EVENT)
+  {
+    if (self->on_event != (void (*)(sx127x_t*, int, int, void*)) NULL)
+      self->on_event(self, cb->status, cb->arg, self->on_event_context);
+  }
+#endif
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_STREAM)
+  else if (cb->type == SX127X_CB_RECEIVE_LONG)
+  {
+    if (self->on_receive_long !=
+        (void (*)(sx127x_t*, u8_t*, int, bool, void*)) NULL)
+      self->on_receive_long(self, (u8_t*) cb->ptr, cb->arg, cb->ok,
+                            self->on_receive_long_context);
+  }
+#endif
+#ifdef SX127X_USE_RXQ
+  else if (cb->type == SX127X_CB_RXQ)
+  {
+    if (self->rxq_notify != (void (*)(sx127x_t*, void*)) NULL)
+      self->rxq_notify(self, self->rxq_context);
+  }
+#endif
+}
+//-----------------------------------------------------------------------------
+// begin callback section: lock SPI bus, callbacks are deferred
+static void sx127x_cb_lock(sx127x_t *self, bool irq)
+{
+#ifdef SX127X_USE_LOCK
+  sx127x_bus_lock(self, irq);
+#endif
+  self->cb_depth++;
+}
+//-----------------------------------------------------------------------------
+// end callback section: unlock SPI bus, then run deferred callbacks
+// (outer section only; callbacks may start new sections)
+static void sx127x_cb_unlock(sx127x_t *self)
+{
+  sx127x_cb_t cb[SX127X_CB_MAX];
+  int i, n = 0;
+
+  if (--self->cb_depth == 0)
+  {
+    n = self->cb_num;
+    memcpy((void*) cb, (const void*) self->cb, n * sizeof(sx127x_cb_t));
+    self->cb_num = 0;
+  }
+  SX127X_UNLOCK(self);
+
+  for (i = 0; i < n; i++)
+    sx127x_cb_run(self, &cb[i]);
+}
+//-----------------------------------------------------------------------------
+#if defined(SX127X_USE_CACHE) || defined(SX127X_USE_BATCH)
+// check register is changed by chip itself or has side effect on access
+static bool sx127x_reg_volatile(const sx127x_t *self, u8_t address)
+{
+  switch (address)
+  {
+    case REG_FIFO:        // FIFO access
+    case REG_OP_MODE:     // mode is changed by chip (TX done, RX single, ...)
+    case REG_LNA:         // `LnaGain` is changed by AGC
+    case 0x0D:            // `RegFifoAddrPtr` (LoRa), `RegRxConfig` (FSK/OOK)
+    case REG_IMAGE_CAL:   // `ImageCalStart`, `ImageCalRunning`
+    case REG_TEMP:        // temperature sensor value
+    case REG_IRQ_FLAGS_1: // IRQ flags (FSK/OOK)
+    case REG_IRQ_FLAGS_2: // IRQ flags (FSK/OOK)
+    case REG_FORMER_TEMP: // temperature of former IQ calibration
+      return true;
+  }
+
+  if (self->mode == SX127X_LORA)
+  { // LoRa mode registers
+    switch (address)
+    {
+      case REG_FIFO_RX_CURRENT_ADDR:
+      case REG_IRQ_FLAGS:
+      case REG_RX_NB_BYTES:
+      case REG_RX_HDR_CNT_MSB:
+      case REG_RX_HDR_CNT_LSB:
+      case REG_RX_PKT_CNT_MSB:
+      case REG_RX_PKT_CNT_LSB:
+      case REG_MODEM_STAT:
+      case REG_PKT_SNR_VALUE:
+      case REG_PKT_RSSI_VALUE:
+      case REG_LR_RSSI_VALUE:
+      case REG_HOP_CHANNEL:
+      case REG_FIFO_RX_BYTE_ADDR:
+      case REG_LR_FEI_MSB:
+      case REG_LR_FEI_MID:
+      case REG_LR_FEI_LSB:
+      case REG_RSSI_WIDEBAND:
+        return true;
+    }
+  }
+  else
+  { // FSK/OOK mode registers
+    switch (address)
+    {
+      case REG_RSSI_VALUE:
+      case REG_AFC_FEI:      // `AfcClear`, `AgcStart` (write only triggers)
+      case REG_AFC_MSB:
+      case REG_AFC_LSB:
+      case REG_FEI_MSB:
+      case REG_FEI_LSB:
+      case REG_OSC:          // `RcCalStart` trigger
+      case REG_SEQ_CONFIG_1: // `SequencerStart`, `SequencerStop` triggers
+        return true;
+    }
+  }
+
+  return false;
+}
+#endif
+//-----------------------------------------------------------------------------
+#ifdef SX127X_USE_CACHE
+// check valid bit of shadow register
+#define SX127X_CACHE_VALID(self, address) \
+  ((self)->cache_valid[(address) >> 3] & (1 << ((address) & 7)))
+
+// check register value may be get from shadow register cache
+static bool sx127x_cached(const sx127x_t *self, u8_t address)
+{
+  return self->cache &&
+         SX127X_CACHE_VALID(self, address) &&
+         !sx127x_reg_volatile(self, address);
+}
+//-----------------------------------------------------------------------------
+// put register value to shadow register cache
+static void sx127x_cache_put(sx127x_t *self, u8_t address, u8_t value)
+{
+  if (self->cache)
+  {
+    self->regs[address] = value;
+    self->cache_valid[address >> 3] |= 1 << (address & 7);
+  }
+}
+//-----------------------------------------------------------------------------
+// check register value in shadow cache before write (true - skip writing)
+static bool sx127x_cache_skip(sx127x_t *self, u8_t address, u8_t value)
+{
+  if (!self->cache)
+    return false;
+
+  if (address == REG_OP_MODE)
+  { // switch LoRa <-> FSK/OOK or LF <-> HF change registers page
+    if (!SX127X_CACHE_VALID(self, REG_OP_MODE) ||
+        ((self->regs[REG_OP_MODE] ^ value) &
+         (MODE_LONG_RANGE | MODE_LOW_FREQ_MODE_ON)))
+      sx127x_cache_reset(self);
+    return false;
+  }
+
+  return sx127x_cached(self, address) && self->regs[address] == value;
+}
+#endif // SX127X_USE_CACHE
+//-----------------------------------------------------------------------------
+#ifdef SX127X_USE_BATCH
+// check pending bit of register write
+#define SX127X_BATCH_PENDING(self, address) \
+  ((self)->batch_mask[(address) >> 3] & (1 << ((address) & 7)))
+
+// queue register write to batch
+static void sx127x_batch_put(sx127x_t *self, u8_t address, u8_t value)
+{
+  u8_t bit = 1 << (address & 7);
+#ifdef SX127X_USE_CACHE
+  if (sx127x_cached(self, address) && self->regs[address] == value)
+  { // value is unchanged in chip
+    self->batch_mask[address >> 3] &= ~bit;
+    return;
+  }
+#endif
+  self->batch_regs[address] = value;
+  self->batch_mask[address >> 3] |= bit;
+}
+//-----------------------------------------------------------------------------
+// replace registers values read from chip by pending values
+static void sx127x_batch_overlay(const sx127x_t *self, u8_t address,
+                                 u8_t *data, int size)
+{
+  int i;
+  if (self->batch && address != REG_FIFO)
+    for (i = 0; i < size; i++, address++)
+      if (SX127X_BATCH_PENDING(self, address))
+        data[i] = self->batch_regs[address];
+}
+//-----------------------------------------------------------------------------
+// write all pending registers by burst mode (return number of transactions)
+// (all bursts are sent by one vectored SPI exchange)
+static int sx127x_batch_flush(sx127x_t *self)
+{
+  u8_t rx_buf[128 * 2], tx_buf[128 * 2]; // address byte + value per register
+  sx127x_seg_t seg[SX127X_SEG_MAX];
+  int address = 0, cnt = 0, n = 0, pos = 0;
+
+  while (address < 128)
+  {
+    int first, last, i;
+    u8_t *buf;
+
+    if (!SX127X_BATCH_PENDING(self, address))
+    {
+      address++;
+      continue;
+    }
+
+    // find end of burst: pending registers and short gaps of known registers
+    first = last = address;
+    for (i = first + 1; i < 128 && i - last <= SX127X_BATCH_GAP; i++)
+    {
+      if (SX127X_BATCH_PENDING(self, i))
+        last = i;
+#ifdef SX127X_USE_CACHE
+      else if (!sx127x_cached(self, i))
+        break; // can't fill gap by unknown or volatile register
+#else
+      else
+        break;
+#endif
+    }
+
+    // prepare burst
+    buf = tx_buf + pos;
+    buf[0] = ((u8_t) first) | 0x80; // first register address with write bit
+    for (i = first; i <= last; i++)
+    {
+#ifdef SX127X_USE_CACHE
+      buf[i - first + 1] = SX127X_BATCH_PENDING(self, i) ?
+                           self->batch_regs[i] : self->regs[i];
+      sx127x_cache_put(self, (u8_t) i, buf[i - first + 1]);
+#else
+      buf[i - first + 1] = self->batch_regs[i];
+#endif
+      self->batch_mask[i >> 3] &= ~(1 << (i & 7));
+    }
+
+    seg[n].tx_buf = buf;
+    seg[n].rx_buf = rx_buf + pos;
+    seg[n].len    = (u8_t) (last - first + 2);
+    pos += seg[n].len;
+    cnt++;
+
+    if (++n == SX127X_SEG_MAX)
+    { // segments table is full
+      sx127x_exchange_v(self, seg, n);
+      n = 0;
+    }
+
+    address = last + 1;
+  }
+
+  if (n)
+    sx127x_exchange_v(self, seg, n);
+
+  return cnt;
+}
+#endif // SX127X_USE_BATCH
+//-----------------------------------------------------------------------------
 // init SX127x radio module
 int sx127x_init(
   sx127x_t *self,
@@ -124,11 +535,144 @@ int sx127x_init(
 {
   u8_t version;
   
-  self->spi_exchange = spi_exchange;
-  self->on_receive   = on_receive;
+  self->spi_exchange   = spi_exchange;
+  self->spi_exchange_v = NULL;
+  self->on_receive     = on_receive;
+  self->on_receive_ex  = NULL;
+  self->irq_time       = 0;
+
+  self->on_transmit    = NULL;
+  self->tx_wait        = NULL;
+  self->tx_wake        = NULL;
+  self->time_ns        = NULL;
+  self->tx_irq         = false;
+  self->tx_air_us      = 0;
+
+  // time on air parameters are set by sx127x_set_pars()
+  memset((void*) &self->toa,      0, sizeof(self->toa));
+  memset((void*) &self->air_stat, 0, sizeof(self->air_stat));
+  self->cb_num   = 0; // no deferred callbacks
+  self->cb_depth = 0;
+
+#ifdef SX127X_USE_DIO
+  // no DIO line event callback, mapping is set by sx127x_set_pars()
+  self->on_event         = NULL;
+  self->on_event_context = NULL;
+  self->dio_map1         = 0x00;
+  self->dio_map2         = 0x00;
+#endif
+
+#if defined(SX127X_USE_QUEUE) && defined(SX127X_USE_LBT)
+  // listen before talk is off
+  self->lbt_timer   = NULL;
+  self->lbt_context = NULL;
+  self->lbt_on      = false;
+  self->lbt_state   = SX127X_LBT_IDLE;
+  memset((void*) &self->lbt_stat, 0, sizeof(self->lbt_stat));
+#endif
+
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_DUTY)
+  // duty-cycled receive is off
+  self->duty_on        = false;
+  self->duty_rx        = false;
+  self->duty_window_us = 0;
+  self->duty_period_us = 0;
+  memset((void*) &self->duty_stat, 0, sizeof(self->duty_stat));
+#endif
+
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_FHSS)
+  // no hop table (FHSS is off)
+  self->hop_period = 0;
+  self->hop_num    = 0;
+  self->hop_ch     = 0;
+  self->hop_idx    = 0;
+  memset((void*) &self->hop_stat, 0, sizeof(self->hop_stat));
+#endif
+
+#ifdef SX127X_USE_PLAN
+  self->plan = (const sx127x_plan_t*) NULL; // no channel plan
+#endif
+
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_SWEEP)
+  // RSSI sweep is off
+  self->sweep_on   = false;
+  self->sweep_head = 0;
+  self->sweep_tail = 0;
+  memset((void*) &self->sweep_stat, 0, sizeof(self->sweep_stat));
+#endif
+
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_EXTRA) && \
+    defined(SX127X_USE_ADR)
+  // adaptive data rate is off
+  self->adr_on        = false;
+  self->adr_margin    = 0;
+  self->adr_power_max = 0;
+  self->adr_power     = 0;
+  memset((void*) self->adr_peer, 0, sizeof(self->adr_peer));
+#endif
+
+#ifdef SX127X_USE_LORA
+  self->bw      = 0; // set by sx127x_set_pars()
+#endif
+#ifdef SX127X_USE_FSKOOK
+  self->bitrate = 0; // set by sx127x_set_pars()
+  self->rx_bw   = 0; // set by sx127x_set_pars()
+#endif
 
   self->spi_exchange_context = spi_exchange_context;
   self->on_receive_context   = on_receive_context;
+  self->on_receive_ex_context = NULL;
+  self->on_transmit_context  = NULL;
+  self->tx_context           = NULL;
+  self->time_context         = NULL;
+
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_STREAM)
+  // no FIFO streaming
+  self->on_receive_long         = NULL;
+  self->on_receive_long_context = NULL;
+  self->stream                  = SX127X_STREAM_OFF;
+#endif
+
+#ifdef SX127X_USE_QUEUE
+  // asynchronous TX queue is empty
+  self->on_sent         = NULL;
+  self->on_sent_context = NULL;
+  self->txq_head        = 0;
+  self->txq_tail        = 0;
+  self->txq_busy        = 0;
+#endif
+
+#ifdef SX127X_USE_LOCK
+  // no SPI bus locking
+  self->bus_lock    = NULL;
+  self->bus_unlock  = NULL;
+  self->bus_context = NULL;
+  self->bus_depth   = 0;
+  memset((void*) &self->bus_stat, 0, sizeof(self->bus_stat));
+#endif
+
+#ifdef SX127X_USE_RXQ
+  // RX ring is off and empty
+  self->rxq_notify  = NULL;
+  self->rxq_context = NULL;
+  self->rxq_on      = false;
+  self->rxq_head    = 0;
+  self->rxq_tail    = 0;
+  self->rxq_frames  = 0;
+  self->rxq_drops   = 0;
+#endif
+
+#ifdef SX127X_USE_CACHE
+  // shadow register cache on
+  self->cache = false;
+  sx127x_cache_on(self, true);
+#endif
+
+#ifdef SX127X_USE_BATCH
+  // batch writes off
+  self->batch = 0;
+  memset((void*) self->batch_mask, 0, sizeof(self->batch_mask));
+#endif
 
   // check version
   version = sx127x_version(self);
@@ -176,49 +720,525 @@ void sx127x_on_receive(
   self->on_receive_context = on_receive_context;
 }
 //-----------------------------------------------------------------------------
+// set callback on receive packet with metadata (Lora/FSK/OOK)
+// (metadata registers are read by the same burst as IRQ flags in LoRa mode;
+// if set then it is called instead of on_receive())
+void sx127x_on_receive_ex(
+  sx127x_t *self,
+  void (*on_receive_ex)(        // receive callback with metadata or NULL
+    sx127x_t *self,               // pointer to sx127x_t object
+    u8_t *payload,                // payload data
+    u8_t payload_size,            // payload size
+    bool crc,                     // CRC ok/false
+    const sx127x_rx_meta_t *meta, // packet metadata
+    void *context),               // optional context
+  void *on_receive_ex_context)  // optional on_receive_ex() context
+{
+  self->on_receive_ex         = on_receive_ex;
+  self->on_receive_ex_context = on_receive_ex_context;
+}
+//-----------------------------------------------------------------------------
+// set timestamp of DIO0 IRQ edge [ns] (call before sx127x_irq_handler())
+// (e.g. CLOCK_MONOTONIC of GPIO edge event, 0 - unknown)
+void sx127x_irq_time(sx127x_t *self, u64_t ns)
+{
+  self->irq_time = ns;
+}
+//-----------------------------------------------------------------------------
+// set callback on transmit done (LoRa/FSK/OOK)
+// (called from sx127x_irq_handler() or from sx127x_send() on timeout)
+void sx127x_on_transmit(
+  sx127x_t *self,
+  void (*on_transmit)(        // transmit done callback or NULL
+    sx127x_t *self,             // pointer to sx127x_t object
+    bool ok,                    // true - TX done, false - timeout
+    void *context),             // optional context
+  void *on_transmit_context)  // optional on_transmit() context
+{
+  self->on_transmit         = on_transmit;
+  self->on_transmit_context = on_transmit_context;
+}
+//-----------------------------------------------------------------------------
+// set OS hooks to sleep in sx127x_send() until TX done IRQ on DIO0
+// (tx_wait() return 0 if TX done or < 0 by timeout; NULL - busy polling)
+void sx127x_tx_hooks(
+  sx127x_t *self,
+  int (*tx_wait)(             // sleep until TX done or timeout hook
+    sx127x_t *self,             // pointer to sx127x_t object
+    u32_t timeout_ms,           // timeout [ms]
+    void *context),             // optional context
+  void (*tx_wake)(            // wake up thread sleeping in tx_wait()
+    sx127x_t *self,             // pointer to sx127x_t object
+    void *context),             // optional context
+  void *tx_context)           // optional tx_wait()/tx_wake() context
+{
+  self->tx_wait    = tx_wait;
+  self->tx_wake    = tx_wake;
+  self->tx_context = tx_context;
+}
+//-----------------------------------------------------------------------------
+// set OS hook of monotonic time for TX done timeout of busy waiting
+// (NULL - timeout by SX127X_POLL_PER_MS register polls, by default)
+void sx127x_time_hook(
+  sx127x_t *self,
+  u64_t (*time_ns)(           // get monotonic time [ns] hook or NULL
+    sx127x_t *self,             // pointer to sx127x_t object
+    void *context),             // optional context
+  void *time_context)         // optional time_ns() context
+{
+  self->time_ns      = time_ns;
+  self->time_context = time_context;
+}
+//-----------------------------------------------------------------------------
+// set vectored SPI exchange function (NULL by default after sx127x_init())
+// (segments are exchanged by one call, e.g. by one ioctl(SPI_IOC_MESSAGE(n)))
+void sx127x_spi_exchange_v(
+  sx127x_t *self,
+  int (*spi_exchange_v)(      // vectored SPI exchange function or NULL
+    const sx127x_seg_t *seg,    // segments (one chip select frame per segment)
+    int n,                      // number of segments (n <= SX127X_SEG_MAX)
+    void *context))             // optional SPI context or NULL
+{
+  self->spi_exchange_v = spi_exchange_v;
+}
+//-----------------------------------------------------------------------------
+#ifdef SX127X_USE_LOCK
+// set OS hooks of SPI bus lock shared by IRQ handlers and application
+// threads (bus_lock() must be recursive, e.g. PTHREAD_MUTEX_RECURSIVE;
+// NULL - no locking, by default after sx127x_init())
+void sx127x_lock_hooks(
+  sx127x_t *self,
+  int (*bus_lock)(            // lock SPI bus hook (return 0 if locked)
+    sx127x_t *self,             // pointer to sx127x_t object
+    bool wait,                  // true - wait, false - try lock
+    void *context),             // optional context
+  void (*bus_unlock)(         // unlock SPI bus hook
+    sx127x_t *self,             // pointer to sx127x_t object
+    void *context),             // optional context
+  void *bus_context)          // optional bus_lock()/bus_unlock() context
+{
+  self->bus_lock    = bus_lock;
+  self->bus_unlock  = bus_unlock;
+  self->bus_context = bus_context;
+  self->bus_depth   = 0;
+}
+//-----------------------------------------------------------------------------
+// begin atomic transaction: lock SPI bus (may be nested)
+// (every driver function locks bus itself; do not call sx127x_send() or
+// sx127x_send_long() inside transaction - IRQ handler waits TX done then)
+void sx127x_lock(sx127x_t *self)
+{
+  sx127x_bus_lock(self, false);
+}
+//-----------------------------------------------------------------------------
+// end atomic transaction: unlock SPI bus
+void sx127x_unlock(sx127x_t *self)
+{
+  sx127x_bus_unlock(self);
+}
+//-----------------------------------------------------------------------------
+// get SPI bus lock statistics (reset it if `reset` is true)
+void sx127x_lock_stat(sx127x_t *self, sx127x_lock_stat_t *stat, bool reset)
+{
+  if (self->bus_lock != (int (*)(sx127x_t*, bool, void*)) NULL)
+    self->bus_lock(self, true, self->bus_context); // not counted
+
+  if (stat != (sx127x_lock_stat_t*) NULL)
+    *stat = self->bus_stat;
+
+  if (reset)
+    memset((void*) &self->bus_stat, 0, sizeof(self->bus_stat));
+
+  if (self->bus_unlock != (void (*)(sx127x_t*, void*)) NULL)
+    self->bus_unlock(self, self->bus_context);
+}
+#endif // SX127X_USE_LOCK
+//-----------------------------------------------------------------------------
 // write SX127x 8-bit register to SPI
 void sx127x_write_reg(sx127x_t *self, u8_t address, u8_t value)
 {
   u8_t rx_buf[2], tx_buf[2];
+  address &= 0x7F;
+
+  SX127X_LOCK(self);
+
+#ifdef SX127X_USE_BATCH
+  if (self->batch)
+  {
+    if (!sx127x_reg_volatile(self, address))
+    { // queue write of configuration register
+      sx127x_batch_put(self, address, value);
+      SX127X_UNLOCK(self);
+      return;
+    }
+
+    // write all pending registers before volatile register (keep order)
+    sx127x_batch_flush(self);
+  }
+#endif
+
+#ifdef SX127X_USE_CACHE
+  if (sx127x_cache_skip(self, address, value))
+  {
+    SX127X_UNLOCK(self);
+    return; // value is unchanged
+  }
+#endif
+
   tx_buf[0] = address | 0x80;
   tx_buf[1] = value;
   self->spi_exchange(rx_buf, tx_buf, 2, self->spi_exchange_context);
+
+#ifdef SX127X_USE_CACHE
+  sx127x_cache_put(self, address, value);
+#endif
+
+  SX127X_UNLOCK(self);
 }
 //-----------------------------------------------------------------------------
 // read SX127x 8-bit register from SPI
 u8_t sx127x_read_reg(sx127x_t *self, u8_t address)
 {
   u8_t rx_buf[2], tx_buf[2];
-  tx_buf[0] = address & 0x7F;
-  self->spi_exchange(rx_buf, tx_buf, 2, self->spi_exchange_context);
+  address &= 0x7F;
+
+  SX127X_LOCK(self);
+
+#ifdef SX127X_USE_BATCH
+  if (self->batch && SX127X_BATCH_PENDING(self, address))
+    rx_buf[1] = self->batch_regs[address]; // get pending value
+  else
+#endif
+#ifdef SX127X_USE_CACHE
+  if (sx127x_cached(self, address))
+    rx_buf[1] = self->regs[address]; // get value from shadow register cache
+  else
+#endif
+  {
+    tx_buf[0] = address;
+    self->spi_exchange(rx_buf, tx_buf, 2, self->spi_exchange_context);
+
+#ifdef SX127X_USE_CACHE
+    sx127x_cache_put(self, address, rx_buf[1]);
+#endif
+  }
+
+  SX127X_UNLOCK(self);
   return rx_buf[1];
 }
 //----------------------------------------------------------------------------
-// setup SX127x radio module (uses from sx127x_init())
-void sx127x_set_pars(
-  sx127x_t *self,
-  sx127x_mode_t mode, // radio mode: SX127X_LORA, SX127X_FSK, SX127X_OOK
-  const sx127x_pars_t *pars) // configuration parameters or NULL
+// read `size` bytes from SX127x FIFO (address=0) or registers by burst mode
+// (one SPI transaction per SX127X_BURST_MAX bytes)
+void sx127x_read_burst(sx127x_t *self, u8_t address, u8_t *data, int size)
 {
-  if (pars == (sx127x_pars_t*) NULL)
-    pars = &sx127x_pars_default; // use default pars
-  
-  if (mode != SX127X_FSK && mode != SX127X_OOK)
-    mode = SX127X_LORA;
+  u8_t rx_buf[SX127X_BURST_MAX + 1], tx_buf[SX127X_BURST_MAX + 1];
+  address &= 0x7F;
 
-  // switch mode
-#if defined(SX127X_USE_FSKOOK)
-  if      (mode == SX127X_FSK) sx127x_fsk(self);  // FSK
-  else if (mode == SX127X_OOK) sx127x_ook(self);  // OOK
-#else
-  mode = SX127X_LORA;
-#endif
+  SX127X_LOCK(self);
 
-#if defined(SX127X_USE_LORA)
-  if      (mode == SX127X_LORA) sx127x_lora(self); // LoRa
-#endif
+#ifdef SX127X_USE_CACHE
+  if (address != REG_FIFO)
+  { // try to get all registers values from shadow register cache
+    int i;
+    for (i = 0; i < size; i++)
+      if (!sx127x_cached(self, address + i)) break;
 
-  // config RF frequency
+    if (i == size)
+    {
+      memcpy((void*) data, (const void*) (self->regs + address), size);
+#ifdef SX127X_USE_BATCH
+      sx127x_batch_overlay(self, address, data, size);
+#endif
+      SX127X_UNLOCK(self);
+      return;
+    }
+  }
+#endif
+
+  while (size > 0)
+  {
+    int len = SX127X_MIN(size, SX127X_BURST_MAX);
+
+    tx_buf[0] = address; // first register address without write bit
+    memset((void*) (tx_buf + 1), 0, len);
+    self->spi_exchange(rx_buf, tx_buf, (u8_t) (len + 1),
+                       self->spi_exchange_context);
+    memcpy((void*) data, (const void*) (rx_buf + 1), len);
+
+    if (address != REG_FIFO)
+    {
+#ifdef SX127X_USE_CACHE
+      int i;
+      for (i = 0; i < len; i++)
+        sx127x_cache_put(self, address + i, data[i]);
+#endif
+#ifdef SX127X_USE_BATCH
+      sx127x_batch_overlay(self, address, data, len);
+#endif
+      address += len; // address auto increment (except FIFO)
+    }
+
+    data += len;
+    size -= len;
+  }
+
+  SX127X_UNLOCK(self);
+}
+//----------------------------------------------------------------------------
+// write `size` bytes to SX127x FIFO (address=0) or registers by burst mode
+// (one SPI transaction per SX127X_BURST_MAX bytes)
+void sx127x_write_burst(sx127x_t *self, u8_t address,
+                        const u8_t *data, int size)
+{
+  u8_t rx_buf[SX127X_BURST_MAX + 1], tx_buf[SX127X_BURST_MAX + 1];
+  address &= 0x7F;
+
+  SX127X_LOCK(self);
+
+#ifdef SX127X_USE_BATCH
+  if (self->batch)
+  {
+    if (address != REG_FIFO)
+    { // queue writes of registers
+      for (; size > 0; size--)
+        sx127x_write_reg(self, address++, *data++);
+      SX127X_UNLOCK(self);
+      return;
+    }
+
+    // write all pending registers before FIFO (keep order)
+    sx127x_batch_flush(self);
+  }
+#endif
+
+#ifdef SX127X_USE_CACHE
+  if (address != REG_FIFO)
+  { // skip writing if all registers values are unchanged
+    int i;
+    for (i = 0; i < size; i++)
+      if (!sx127x_cached(self, address + i) ||
+          self->regs[address + i] != data[i]) break;
+
+    if (i == size)
+    {
+      SX127X_UNLOCK(self);
+      return;
+    }
+  }
+#endif
+
+  while (size > 0)
+  {
+    int len = SX127X_MIN(size, SX127X_BURST_MAX);
+
+    tx_buf[0] = address | 0x80; // first register address with write bit
+    memcpy((void*) (tx_buf + 1), (const void*) data, len);
+    self->spi_exchange(rx_buf, tx_buf, (u8_t) (len + 1),
+                       self->spi_exchange_context);
+
+    if (address != REG_FIFO)
+    {
+#ifdef SX127X_USE_CACHE
+      int i;
+      for (i = 0; i < len; i++)
+        sx127x_cache_put(self, address + i, data[i]);
+#endif
+      address += len; // address auto increment (except FIFO)
+    }
+
+    data += len;
+    size -= len;
+  }
+
+  SX127X_UNLOCK(self);
+}
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_CACHE
+// on/off shadow register cache (on by default after sx127x_init())
+void sx127x_cache_on(sx127x_t *self, bool on)
+{
+  self->cache = on;
+  sx127x_cache_reset(self);
+}
+//----------------------------------------------------------------------------
+// reload shadow register cache from SX127x chip by one SPI burst
+void sx127x_cache_sync(sx127x_t *self)
+{
+  u8_t regs[127];
+
+  SX127X_LOCK(self);
+  if (self->cache)
+  {
+    sx127x_cache_reset(self);
+    sx127x_read_burst(self, REG_OP_MODE, regs, 127); // 0x01...0x7F
+  }
+  SX127X_UNLOCK(self);
+}
+//----------------------------------------------------------------------------
+// invalidate shadow register cache (call after hard reset of SX127x chip)
+void sx127x_cache_reset(sx127x_t *self)
+{
+  memset((void*) self->cache_valid, 0, sizeof(self->cache_valid));
+}
+#endif
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_BATCH
+// begin batch of register writes (may be nested)
+// all configuration register writes are queued until sx127x_batch_commit()
+// (SPI bus is locked until sx127x_batch_commit())
+void sx127x_batch_begin(sx127x_t *self)
+{
+  SX127X_LOCK(self);
+  self->batch++;
+}
+//----------------------------------------------------------------------------
+// commit batch of register writes (return number of SPI transactions)
+// pending writes are sorted by address and merged to burst writes
+int sx127x_batch_commit(sx127x_t *self)
+{
+  int cnt;
+
+  if (self->batch <= 0)
+    return 0; // batch is not started
+
+  if (self->batch > 1)
+  { // nested batch
+    self->batch--;
+    SX127X_UNLOCK(self);
+    return 0;
+  }
+
+  cnt = sx127x_batch_flush(self);
+  self->batch = 0;
+  SX127X_UNLOCK(self);
+
+  if (cnt == 0)
+    return 0; // no pending writes
+
+  SX127X_DBG("commit batch by %d SPI transaction(s)", cnt);
+  return cnt;
+}
+#endif
+//----------------------------------------------------------------------------
+// set default mapping 0b00 of all DIO lines (`RegDioMapping1/2`)
+static void sx127x_dio_reset(sx127x_t *self)
+{
+  sx127x_write_reg(self, REG_DIO_MAPPING_1, 0x00);
+#ifdef SX127X_USE_DIO
+  sx127x_write_reg(self, REG_DIO_MAPPING_2, 0x00);
+  self->dio_map1 = 0x00; // copies are used by IRQ dispatch (no SPI read)
+  self->dio_map2 = 0x00;
+#endif
+}
+//----------------------------------------------------------------------------
+// set bits of `RegDioMapping1` or `RegDioMapping2` selected by mask
+static void sx127x_dio_bits(sx127x_t *self, u8_t address, u8_t mask,
+                            u8_t bits)
+{
+#ifdef SX127X_USE_DIO
+  u8_t *copy = address == REG_DIO_MAPPING_1 ? &self->dio_map1 :
+                                              &self->dio_map2;
+  u8_t reg = *copy;
+#else
+  u8_t reg = sx127x_read_reg(self, address);
+#endif
+  if ((reg & mask) != bits)
+  {
+    reg = (reg & ~mask) | bits;
+    sx127x_write_reg(self, address, reg);
+#ifdef SX127X_USE_DIO
+    *copy = reg;
+#endif
+  }
+}
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_LORA
+// compute LoRa time on air parameters by `sf`, `bw` and `ldro`
+// (other packet parameters are taken from active configuration)
+static void sx127x_toa_lora(const sx127x_t *self, sx127x_toa_t *toa,
+                            u8_t sf, u32_t bw, bool ldro)
+{
+  // look "LoRa Modem Designer's Guide":
+  // Tpacket  = (Npreamble + 4.25 + Npayload) * Tsym, Tsym = 2**SF / BW
+  // Npayload = 8 + max(ceil((8*PL + num) / den) * CR, 0)
+  memset((void*) toa, 0, sizeof(sx127x_toa_t));
+  if (bw == 0 || sf < 6 || sf > 12) return; // not set yet
+  toa->unit_ns = (u32_t) ((((u64_t) 1000000000) << sf) / bw);
+  toa->over    = (u32_t) self->preamble * 4 + 17 + 8 * 4; // 1/4 symbols
+  toa->num     = 28 - 4 * (i32_t) sf + (self->crc ? 16 : 0) -
+                 (self->impl_hdr ? 20 : 0);
+  toa->den     = 4 * (sf - (ldro ? 2 : 0));
+  toa->cr      = self->cr;
+}
+#endif
+//----------------------------------------------------------------------------
+// update cached time on air parameters of active configuration
+// (called by setters of modulation and packet parameters)
+static void sx127x_toa_update(sx127x_t *self)
+{
+  sx127x_toa_t *toa = &self->toa;
+  memset((void*) toa, 0, sizeof(sx127x_toa_t));
+
+  if (self->mode == SX127X_LORA) // LoRa mode
+  {
+#ifdef SX127X_USE_LORA
+    sx127x_toa_lora(self, toa, self->sf, self->bw, self->ldro);
+#endif
+  }
+  else // FSK/OOK mode
+  {
+#ifdef SX127X_USE_FSKOOK
+    // preamble + sync word + [length byte] + payload + [CRC]
+    // (preamble and sync word are not Manchester encoded)
+    u32_t bytes = ((u32_t) sx127x_read_reg(self, REG_PREAMBLE_L_MSB) << 8) |
+                           sx127x_read_reg(self, REG_PREAMBLE_L_LSB);
+    u8_t sync = sx127x_read_reg(self, REG_SYNC_CONFIG);
+    if (sync & 0x10) bytes += (sync & 0x07) + 1; // `SyncOn`, `SyncSize`
+    if (self->bitrate == 0) return; // not set yet
+    toa->bits    = self->dcfree == 1 ? 16 : 8; // Manchester x2
+    toa->unit_ns = (1000000000 + self->bitrate / 2) / self->bitrate;
+    toa->over    = bytes * 8 +
+                   ((self->fixed ? 0 : 1) + (self->crc ? 2 : 0)) * toa->bits;
+#endif
+  }
+}
+//----------------------------------------------------------------------------
+// setup SX127x radio module (uses from sx127x_init())
+void sx127x_set_pars(
+  sx127x_t *self,
+  sx127x_mode_t mode, // radio mode: SX127X_LORA, SX127X_FSK, SX127X_OOK
+  const sx127x_pars_t *pars) // configuration parameters or NULL
+{
+  SX127X_LOCK(self);
+  if (pars == (sx127x_pars_t*) NULL)
+    pars = &sx127x_pars_default; // use default pars
+  
+  if (mode != SX127X_FSK && mode != SX127X_OOK)
+    mode = SX127X_LORA;
+
+#ifdef SX127X_USE_BATCH
+  // queue all configuration writes
+  sx127x_batch_begin(self);
+#endif
+
+  // switch mode
+#if defined(SX127X_USE_FSKOOK)
+  if      (mode == SX127X_FSK) sx127x_fsk(self);  // FSK
+  else if (mode == SX127X_OOK) sx127x_ook(self);  // OOK
+#else
+  mode = SX127X_LORA;
+#endif
+
+#if defined(SX127X_USE_LORA)
+  if      (mode == SX127X_LORA) sx127x_lora(self); // LoRa
+#endif
+
+#ifdef SX127X_USE_CACHE
+  // fill shadow register cache of new registers page by one burst
+  sx127x_cache_sync(self);
+#endif
+
+  // config RF frequency
   sx127x_set_frequency(self, pars->freq);
 
   // update band RF frequency
@@ -266,6 +1286,9 @@ void sx127x_set_pars(
    
     sx127x_set_preamble(self, pars->preamble); // preamble length
     sx127x_set_sw(self, pars->sw);             // Sync Word
+#ifdef SX127X_USE_FHSS
+    sx127x_set_hop_period(self, pars->freq_hop ? pars->hop_period : 0);
+#endif
 
     // set AGC auto on (internal AGC loop)
     sx127x_write_reg(self, REG_MODEM_CONFIG_3,
@@ -275,8 +1298,8 @@ void sx127x_set_pars(
     sx127x_write_reg(self, REG_FIFO_TX_BASE_ADDR, FIFO_TX_BASE_ADDR);
     sx127x_write_reg(self, REG_FIFO_RX_BASE_ADDR, FIFO_RX_BASE_ADDR);
 
-    // set DIO0 mapping (`RxDone`)
-    sx127x_write_reg(self, REG_DIO_MAPPING_1, 0x00);
+    // set DIO0 mapping (`RxDone`), other DIO lines by default
+    sx127x_dio_reset(self);
     
     // set maximum payload length
     sx127x_write_reg(self, REG_MAX_PAYLOAD_LEN, MAX_PKT_LENGTH);
@@ -313,14 +1336,22 @@ void sx127x_set_pars(
     //    in TxContin - `TxReady`
     //    in RxPacket - `PayloadReady` <- used signal
     //    in TxPacket - `PacketSent`
-    sx127x_write_reg(self, REG_DIO_MAPPING_1, 0x00);
+    sx127x_dio_reset(self);
 
     // RSSI and IQ calibrate
     sx127x_rx_calibrate(self);
 #endif
   }
 
+  // update time on air parameters (FSK/OOK preamble and sync word are set)
+  sx127x_toa_update(self);
+
   sx127x_standby(self);
+
+#ifdef SX127X_USE_BATCH
+  sx127x_batch_commit(self);
+#endif
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // return current mode (SX127X_LORA, SX127X_FSK, SX127X_OOK)
@@ -335,12 +1366,24 @@ u8_t sx127x_version(sx127x_t *self)
   return sx127x_read_reg(self, REG_VERSION);
 }
 //----------------------------------------------------------------------------
+#ifdef SX127X_USE_LORA
+// set DIO0 mapping: DIO0_RX_DONE, DIO0_TX_DONE or DIO0_CAD_DONE (LoRa)
+static void sx127x_dio0_map(sx127x_t *self, u8_t map)
+{
+  sx127x_dio_bits(self, REG_DIO_MAPPING_1, DIO0_MASK, map);
+}
+#endif
+//----------------------------------------------------------------------------
 // set mode in `RegOpMode` register
 void sx127x_set_mode(sx127x_t *self, u8_t mode)
 {
-  u8_t reg = sx127x_read_reg(self, REG_OP_MODE);
+  u8_t reg;
+
+  SX127X_LOCK(self);
+  reg = sx127x_read_reg(self, REG_OP_MODE);
   reg = (reg & ~MODES_MASK) | mode;
   sx127x_write_reg(self, REG_OP_MODE, reg);
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // get mode from `RegOpMode` register
@@ -353,8 +1396,11 @@ u8_t sx127x_get_mode(sx127x_t *self)
 // switch to LoRa mode
 void sx127x_lora(sx127x_t *self)
 {
-  u8_t mode = sx127x_read_reg(self, REG_OP_MODE); // read mode
-  u8_t sleep = (mode & ~MODES_MASK) | MODE_SLEEP;
+  u8_t mode, sleep;
+
+  SX127X_LOCK(self);
+  mode  = sx127x_read_reg(self, REG_OP_MODE); // read mode
+  sleep = (mode & ~MODES_MASK) | MODE_SLEEP;
   sx127x_write_reg(self, REG_OP_MODE, sleep); // go to sleep
   sleep |= MODE_LONG_RANGE;
   mode  |= MODE_LONG_RANGE;
@@ -362,7 +1408,9 @@ void sx127x_lora(sx127x_t *self)
   sx127x_write_reg(self, REG_OP_MODE, mode);  // restore old mode
   
   self->mode = SX127X_LORA;
+  sx127x_toa_update(self);
   SX127X_DBG("set LoRa mode");
+  SX127X_UNLOCK(self);
 }
 #endif
 //----------------------------------------------------------------------------
@@ -379,8 +1427,11 @@ bool sx127x_is_lora(sx127x_t *self)
 // switch to FSK mode
 void sx127x_fsk(sx127x_t *self)
 {
-  u8_t mode = sx127x_read_reg(self, REG_OP_MODE); // read mode
-  u8_t sleep = (mode & ~MODES_MASK) | MODE_SLEEP;
+  u8_t mode, sleep;
+
+  SX127X_LOCK(self);
+  mode  = sx127x_read_reg(self, REG_OP_MODE); // read mode
+  sleep = (mode & ~MODES_MASK) | MODE_SLEEP;
   sx127x_write_reg(self, REG_OP_MODE, sleep); // go to sleep
   sleep &= ~MODE_LONG_RANGE;
   mode  &= ~MODE_LONG_RANGE;
@@ -390,14 +1441,19 @@ void sx127x_fsk(sx127x_t *self)
   sx127x_write_reg(self, REG_OP_MODE, (mode & ~MODES_MASK2) | MODE_FSK);
   
   self->mode = SX127X_FSK;
+  sx127x_toa_update(self);
   SX127X_DBG("set FSK mode");
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // switch to OOK mode
 void sx127x_ook(sx127x_t *self)
 {
-  u8_t mode = sx127x_read_reg(self, REG_OP_MODE); // read mode
-  u8_t sleep = (mode & ~MODES_MASK) | MODE_SLEEP;
+  u8_t mode, sleep;
+
+  SX127X_LOCK(self);
+  mode  = sx127x_read_reg(self, REG_OP_MODE); // read mode
+  sleep = (mode & ~MODES_MASK) | MODE_SLEEP;
   sx127x_write_reg(self, REG_OP_MODE, sleep); // go to sleep
   sleep &= ~MODE_LONG_RANGE;
   mode  &= ~MODE_LONG_RANGE;
@@ -407,7 +1463,9 @@ void sx127x_ook(sx127x_t *self)
   sx127x_write_reg(self, REG_OP_MODE, (mode & ~MODES_MASK2) | MODE_OOK);
   
   self->mode = SX127X_OOK;
+  sx127x_toa_update(self);
   SX127X_DBG("set OOK mode");
+  SX127X_UNLOCK(self);
 }
 #endif
 //----------------------------------------------------------------------------
@@ -435,9 +1493,27 @@ void sx127x_tx(sx127x_t *self)
 // switch to RX (continuous) mode
 void sx127x_rx(sx127x_t *self)
 {
+  SX127X_LOCK(self);
+#ifdef SX127X_USE_LORA
+  if (self->mode == SX127X_LORA)
+    sx127x_dio0_map(self, DIO0_RX_DONE); // may be `TxDone` after send
+#endif
   sx127x_set_mode(self, MODE_RX_CONTINUOUS);
   SX127X_DBG("set RX continuous mode");
+  SX127X_UNLOCK(self);
+}
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_LORA
+// switch to RX single mode (LoRa): standby by `RxDone` or `RxTimeout`
+void sx127x_rx_single(sx127x_t *self)
+{
+  SX127X_LOCK(self);
+  sx127x_dio0_map(self, DIO0_RX_DONE); // `RxTimeout` is on DIO1 (0b00)
+  sx127x_set_mode(self, MODE_RX_SINGLE);
+  SX127X_DBG("set LoRa RX single mode");
+  SX127X_UNLOCK(self);
 }
+#endif
 //----------------------------------------------------------------------------
 #ifdef SX127X_USE_LORA
 // switch to CAD (LoRa) mode
@@ -448,11 +1524,10 @@ void sx127x_cad(sx127x_t *self)
 }
 #endif
 //----------------------------------------------------------------------------
-// set RF frequency [Hz]
-u32_t sx127x_set_frequency(sx127x_t *self, u32_t freq)
+// convert RF frequency [Hz] to 3 bytes of `Frf` (MSB first), return code
+static u32_t sx127x_frf_code(u32_t freq, u8_t *frf)
 {
   u32_t f, f1, f2, f11, f12, f21, f22;
-  u8_t rx_buf[4], tx_buf[4];
 
   // FREQ_MAGIC_1 = 8     // arithmetic shift
   // FREQ_MAGIC_2 = 625   // 5**4
@@ -473,18 +1548,34 @@ u32_t sx127x_set_frequency(sx127x_t *self, u32_t freq)
  
   f = f1 + f2; // FIXME: check limits
 
-  tx_buf[0] = REG_FRF_MSB | 0x80; // first register address with write bit
-  tx_buf[1] = (u8_t)(f >> 16); // MSB
-  tx_buf[2] = (u8_t)(f >> 8);  // MID
-  tx_buf[3] = (u8_t) f;        // LSB
-  self->spi_exchange(rx_buf, tx_buf, 4, self->spi_exchange_context);
+  frf[0] = (u8_t)(f >> 16); // MSB
+  frf[1] = (u8_t)(f >> 8);  // MID
+  frf[2] = (u8_t) f;        // LSB
+
+  return f;
+}
+//----------------------------------------------------------------------------
+// convert 3 bytes of `Frf` (MSB first) to RF frequency [Hz]
+static u32_t sx127x_frf_freq(const u8_t *frf)
+{
+  return ((((u32_t) frf[0]) * FREQ_MAGIC_4) << 8) +
+          (((u32_t) frf[1]) * FREQ_MAGIC_4) +
+         ((((u32_t) frf[2]) * FREQ_MAGIC_4 + (1<<7)) >> 8);
+}
+//----------------------------------------------------------------------------
+// set RF frequency [Hz]
+u32_t sx127x_set_frequency(sx127x_t *self, u32_t freq)
+{
+  u8_t frf[3];
+
+  sx127x_frf_code(freq, frf);
+  sx127x_write_burst(self, REG_FRF_MSB, frf, 3);
 
   // save RF frequency
-  self->freq = ((((u32_t) tx_buf[1]) * FREQ_MAGIC_4) << 8) +
-                (((u32_t) tx_buf[2]) * FREQ_MAGIC_4) +
-               ((((u32_t) tx_buf[3]) * FREQ_MAGIC_4 + (1<<7)) >> 8);
+  self->freq = sx127x_frf_freq(frf);
   
-  SX127X_DBG("set RF frequency to %lu Hz (code=%lu)", self->freq, f);
+  SX127X_DBG("set RF frequency to %lu Hz (code=0x%02X%02X%02X)",
+             (unsigned long) self->freq, frf[0], frf[1], frf[2]);
 
   return self->freq;
 }
@@ -493,32 +1584,80 @@ u32_t sx127x_set_frequency(sx127x_t *self, u32_t freq)
 // get RF frequency [Hz]
 u32_t sx127x_get_frequency(sx127x_t *self)
 {
-  u8_t rx_buf[4], tx_buf[4];
+  u8_t frf[3];
 
-  tx_buf[0] = REG_FRF_MSB & 0x7F; // first register address without write bit
-  self->spi_exchange(rx_buf, tx_buf, 4, self->spi_exchange_context);
+  sx127x_read_burst(self, REG_FRF_MSB, frf, 3);
 
-  return ((((u32_t) rx_buf[1]) * FREQ_MAGIC_4) << 8) +
-          (((u32_t) rx_buf[2]) * FREQ_MAGIC_4) +
-         ((((u32_t) rx_buf[3]) * FREQ_MAGIC_4 + (1<<7)) >> 8);
+  return sx127x_frf_freq(frf);
 }
 #endif
 //----------------------------------------------------------------------------
+#ifdef SX127X_USE_PLAN
+// convert `n` RF frequencies [Hz] of channel plan to `Frf` codes once
+// (return number of channels)
+int sx127x_plan_init(sx127x_plan_t *plan, const u32_t *freq, int n)
+{
+  int i;
+  n = SX127X_LIMIT(n, 0, SX127X_PLAN_MAX);
+
+  for (i = 0; i < n; i++)
+  {
+    sx127x_frf_code(freq[i], plan->frf[i]);
+    plan->freq[i] = sx127x_frf_freq(plan->frf[i]); // synthesized frequency
+  }
+  plan->num = n;
+
+  return n;
+}
+//----------------------------------------------------------------------------
+// set channel plan of module (NULL - no plan)
+void sx127x_set_plan(sx127x_t *self, const sx127x_plan_t *plan)
+{
+  self->plan = plan;
+  SX127X_DBG("set channel plan of %i channels",
+             plan != (const sx127x_plan_t*) NULL ? plan->num : 0);
+}
+//----------------------------------------------------------------------------
+// set RF frequency by channel of plan: one 3 byte burst of cached `Frf`
+// (call sx127x_update_band() if plan crosses LF/HF bands;
+//  return RF frequency [Hz], 0 - no plan or bad channel)
+u32_t sx127x_set_channel(sx127x_t *self, int ch)
+{
+  const sx127x_plan_t *plan = self->plan;
+
+  if (plan == (const sx127x_plan_t*) NULL ||
+      (unsigned) ch >= (unsigned) plan->num)
+    return 0;
+
+  sx127x_write_burst(self, REG_FRF_MSB, plan->frf[ch], 3);
+  self->freq = plan->freq[ch];
+
+  return self->freq;
+}
+#endif // SX127X_USE_PLAN
+//----------------------------------------------------------------------------
 // update band after change RF frequency from one band to another
 void sx127x_update_band(sx127x_t *self)
 {
-  u8_t mode = sx127x_read_reg(self, REG_OP_MODE);
+  u8_t mode;
+
+  SX127X_LOCK(self);
+  mode = sx127x_read_reg(self, REG_OP_MODE);
   if (self->freq < 600000000) // LF <= 525 < _600_ < 779 <= HF [MHz]
     mode |=  MODE_LOW_FREQ_MODE_ON; // LF
   else
     mode &= ~MODE_LOW_FREQ_MODE_ON; // HF
   sx127x_write_reg(self, REG_OP_MODE, mode);
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // set LNA boost on/off (only for high frequency band)
 void sx127x_set_lna_boost(sx127x_t *self, bool lna_boost)
 {
-  u8_t reg = sx127x_read_reg(self, REG_LNA);
+  u8_t reg;
+
+  SX127X_LOCK(self);
+  reg = sx127x_read_reg(self, REG_LNA);
 
   if (lna_boost)
     reg |= 0x03;  // set `LnaBoostHf` to 3 (boost on, 150% LNA current)
@@ -526,6 +1665,7 @@ void sx127x_set_lna_boost(sx127x_t *self, bool lna_boost)
     reg &= ~0x03; // set `LnaBoostHf` to 0 (default LNA current)
 
   sx127x_write_reg(self, REG_LNA, reg);
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // get current RX gain code [1..6] from `RegLna` (1 - maximum gain)
@@ -639,6 +1779,7 @@ i8_t sx127x_set_power_dbm(sx127x_t *self, i8_t dBm)
 // (note: you must set OCP trmimmer if set high power, look datasheet)
 void sx127x_set_high_power(sx127x_t *self, bool on)
 {
+  SX127X_LOCK(self);
   if (on)
     sx127x_write_reg(self, REG_PA_DAC, 0x87); // high power mode
   else
@@ -646,6 +1787,7 @@ void sx127x_set_high_power(sx127x_t *self, bool on)
     
   SX127X_DBG("set High Power mode (+3 dB on PA_BOOST pin) to '%s'",
              on ? "On" : "Off");
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // set trimming of OCP current (45...240 mA)
@@ -653,6 +1795,7 @@ void sx127x_set_ocp(sx127x_t *self, u8_t trim_mA, bool on)
 {
   i16_t trim;
 
+  SX127X_LOCK(self);
   if (trim_mA <= 120)
     trim = (trim_mA + (2 - 45)) / 5;
   else
@@ -669,6 +1812,7 @@ void sx127x_set_ocp(sx127x_t *self, u8_t trim_mA, bool on)
     trim |= 0x20; // `OcpOn`
 
   sx127x_write_reg(self, REG_OCP, (u8_t) (trim & 0xFF));
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // set PA rise/fall time of ramp code 0..15 (FSK/LoRa), default is 9
@@ -677,6 +1821,7 @@ void sx127x_set_ramp(sx127x_t *self, u8_t shaping, u8_t ramp)
 {
   u8_t reg;
 
+  SX127X_LOCK(self);
   shaping = SX127X_LIMIT(shaping, 0, 3);
   ramp    = SX127X_LIMIT(ramp,    0, 15);
     
@@ -685,12 +1830,15 @@ void sx127x_set_ramp(sx127x_t *self, u8_t shaping, u8_t ramp)
   sx127x_write_reg(self, REG_PA_RAMP, reg);
 
   SX127X_DBG("set Shaping=%d and Ramp=%d", (int) shaping, (int) ramp);
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // set PLL bandwidth 0=75, 1=150, 2=225, 3=300 kHz (LoRa/FSK/OOK), default 3
 void sx127x_set_pll_bw(sx127x_t *self, u8_t bw)
 {
   u8_t reg;
+
+  SX127X_LOCK(self);
   bw = SX127X_LIMIT(bw, 0, 3);
   reg = sx127x_read_reg(self, REG_PLL);
   reg = (reg & 0x3F) | (bw << 6);
@@ -701,13 +1849,16 @@ void sx127x_set_pll_bw(sx127x_t *self, u8_t bw)
              bw == 1 ? 150 :
              bw == 2 ? 225 :
                        300);
+  SX127X_UNLOCK(self);
 }
 #endif
 //----------------------------------------------------------------------------
 // enable/disable CRC LoRa/FSK/OOK, set/unset `CrcAutoClearOff` (FSK/OOK mode)
 void sx127x_enable_crc(sx127x_t *self, bool crc, bool crcAutoClearOff)
 {
+  SX127X_LOCK(self);
   self->crc = crc;
+  sx127x_toa_update(self);
   if (self->mode == SX127X_LORA) // LoRa mode
   {
     u8_t reg = sx127x_read_reg(self, REG_MODEM_CONFIG_2);
@@ -726,57 +1877,70 @@ void sx127x_enable_crc(sx127x_t *self, bool crc, bool crcAutoClearOff)
     SX127X_DBG("set CrcOn=%d; CrcAutoClearOff=%d (FSK/OOK)",
                (int) !!crc, (int) !!crcAutoClearOff);
   }
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 #ifdef SX127X_USE_LORA
 // set signal Bandwidth 7800...500000 Hz (LoRa)
 void sx127x_set_bw(sx127x_t *self, u32_t bw)
 {
+  SX127X_LOCK(self);
   if (self->mode == SX127X_LORA) // LoRa mode
   {
     u8_t ix;
     sx127x_bw_pack(&bw, &ix);
     u8_t reg = sx127x_read_reg(self, REG_MODEM_CONFIG_1) & 0x0F;
     sx127x_write_reg(self, REG_MODEM_CONFIG_1, reg | (ix << 4));
+    self->bw = bw;
+    sx127x_toa_update(self);
 
     SX127X_DBG("set bandwidth (BW) in LoRa mode to %d.%02d kHz (code=%d)",
                (int) bw / 1000, (int) (bw % 1000) / 10, (int) ix);
   }
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // set Coding Rate 5...8 (LoRa)
 void sx127x_set_cr(sx127x_t *self, u8_t cr)
 {
+  SX127X_LOCK(self);
   if (self->mode == SX127X_LORA) // LoRa mode
   {
     u8_t reg = sx127x_read_reg(self, REG_MODEM_CONFIG_1);
     cr = SX127X_LIMIT(cr, 5, 8) - 4; // 5...8 -> 1...4
     reg = (reg & 0xF1) | (cr << 1);
     sx127x_write_reg(self, REG_MODEM_CONFIG_1, reg);
+    self->cr = cr + 4;
+    sx127x_toa_update(self);
     
     SX127X_DBG("set Coding Rate (CR) in LoRa mode to 4/%d (code=%d)",
                cr + 4, cr);
   }
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // on/off "ImplicitHeaderMode" (LoRa)
 // (with SF=6 implicit header mode is the only mode of operation possible)
 void sx127x_impl_hdr(sx127x_t *self, bool impl_hdr)
 {
+  SX127X_LOCK(self);
   if (self->mode == SX127X_LORA) // LoRa mode
   {
     u8_t reg = sx127x_read_reg(self, REG_MODEM_CONFIG_1);
     reg = (self->impl_hdr = impl_hdr) ? (reg | 0x01) : (reg & 0xFE);
     sx127x_write_reg(self, REG_MODEM_CONFIG_1, reg);
+    sx127x_toa_update(self);
     
     SX127X_DBG("set `ImplicitHeaderMode` in LoRa mode to %d",
                impl_hdr ? 1 : 0);
   }
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // set Spreading Factor 6...12 (LoRa)
 void sx127x_set_sf(sx127x_t *self, u8_t sf)
 {
+  SX127X_LOCK(self);
   if (self->mode == SX127X_LORA) // LoRa mode
   {
     u8_t reg = sx127x_read_reg(self, REG_MODEM_CONFIG_2);
@@ -785,52 +1949,91 @@ void sx127x_set_sf(sx127x_t *self, u8_t sf)
     sx127x_write_reg(self, REG_MODEM_CONFIG_2,      reg);
     sx127x_write_reg(self, REG_DETECT_OPTIMIZE,     sf == 6 ? 0xC5 : 0xC3);
     sx127x_write_reg(self, REG_DETECTION_THRESHOLD, sf == 6 ? 0x0C : 0x0A);
+    self->sf = sf;
+    sx127x_toa_update(self);
     
     SX127X_DBG("set Spreading Factor (SF) in LoRa mode to %d", sf);
   }
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // set Low Data Rate Optimisation (LoRa)
 void sx127x_set_ldro(sx127x_t *self, bool ldro)
 {
+  SX127X_LOCK(self);
   if (self->mode == SX127X_LORA) // LoRa mode
   {
     u8_t reg = sx127x_read_reg(self, REG_MODEM_CONFIG_3) & ~0x08;
     if (ldro)
       reg |= 0x08; // `LowDataRateOptimize`
     sx127x_write_reg(self, REG_MODEM_CONFIG_3, reg);
+    self->ldro = ldro;
+    sx127x_toa_update(self);
     
     SX127X_DBG("set Low Data Rate Optimisation (LDRO) in LoRa mode to '%s'",
               ldro ? "true" : "false");
   }
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // set preamble length [6...65535] (LoRa)
 void sx127x_set_preamble(sx127x_t *self, u16_t length)
 {
+  SX127X_LOCK(self);
   if (self->mode == SX127X_LORA) // LoRa mode
   {
     length = SX127X_LIMIT(length, 6, 65535);
     sx127x_write_reg(self, REG_PREAMBLE_MSB, (u8_t) (length >> 8));
     sx127x_write_reg(self, REG_PREAMBLE_LSB, (u8_t) (length & 0xFF));
+    self->preamble = length;
+    sx127x_toa_update(self);
     
     SX127X_DBG("set Preamble Length in LoRa mode to %i", (int) length);
   }
+  SX127X_UNLOCK(self);
+}
+//----------------------------------------------------------------------------
+// set RX single timeout 4...1023 symbols (`RegSymbTimeout`, LoRa)
+void sx127x_set_symb_timeout(sx127x_t *self, u16_t symbols)
+{
+  SX127X_LOCK(self);
+  if (self->mode == SX127X_LORA) // LoRa mode
+  {
+    u8_t reg = sx127x_read_reg(self, REG_MODEM_CONFIG_2) & ~0x03;
+    symbols = SX127X_LIMIT(symbols, 4, 1023);
+    reg |= (u8_t) (symbols >> 8); // `SymbTimeout(9:8)`
+    sx127x_write_reg(self, REG_MODEM_CONFIG_2,   reg);
+    sx127x_write_reg(self, REG_SYMB_TIMEOUT_LSB, (u8_t) (symbols & 0xFF));
+
+    SX127X_DBG("set RX single timeout in LoRa mode to %i symbols",
+               (int) symbols);
+  }
+  SX127X_UNLOCK(self);
+}
+//----------------------------------------------------------------------------
+// get duration of symbol [us] by SF and BW (LoRa)
+u32_t sx127x_symbol_us(const sx127x_t *self)
+{
+  if (self->bw == 0) return 0; // BW is not set
+  return (u32_t) ((((u64_t) 1000000) << self->sf) / self->bw); // 2**SF / BW
 }
 //----------------------------------------------------------------------------
 // set Sync Word (LoRa)
 void sx127x_set_sw(sx127x_t *self, u8_t sw)
 {
+  SX127X_LOCK(self);
   if (self->mode == SX127X_LORA) // LoRa mode
   {
     sx127x_write_reg(self, REG_SYNC_WORD, sw);
     SX127X_DBG("set Sync Word (SW) in LoRa mode to 0x%02X", (int) sw);
   }
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // invert IQ channels (LoRa)
 void sx127x_invert_iq(sx127x_t *self, bool invert)
 {
+  SX127X_LOCK(self);
   if (self->mode == SX127X_LORA) // LoRa mode
   {
     u8_t reg = sx127x_read_reg(self, REG_INVERT_IQ);
@@ -841,6 +2044,7 @@ void sx127x_invert_iq(sx127x_t *self, bool invert)
     SX127X_DBG("set `InvertIq` in LoRa mode to '%s'",
                invert ? "true" : "false");
   }
+  SX127X_UNLOCK(self);
 }
 #endif
 //----------------------------------------------------------------------------
@@ -848,6 +2052,7 @@ void sx127x_invert_iq(sx127x_t *self, bool invert)
 // select Continuous mode, must use DIO2->DATA, DIO1->DCLK (FSK/OOK)
 void sx127x_continuous(sx127x_t *self, bool on)
 {
+  SX127X_LOCK(self);
   if (self->mode != SX127X_LORA) // FSK/OOK mode
   {
     u8_t reg = sx127x_read_reg(self, REG_PACKET_CONFIG_2);
@@ -857,11 +2062,13 @@ void sx127x_continuous(sx127x_t *self, bool on)
     
     SX127X_DBG("set Continuous mode (FSK/OOK) to '%s'", on ? "On" : "Off");
   }
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // RSSI and IQ callibration (FSK/OOK)
 void sx127x_rx_calibrate(sx127x_t *self)
 {
+  SX127X_LOCK(self);
   if (self->mode != SX127X_LORA) // FSK/OOK mode
   {
     u8_t reg = sx127x_read_reg(self, REG_IMAGE_CAL);
@@ -875,6 +2082,7 @@ void sx127x_rx_calibrate(sx127x_t *self)
       // FIXME: check timeout
     }
   }
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // set bitrate [bit/s] (FSK/OOK)
@@ -902,10 +2110,13 @@ u32_t sx127x_set_bitrate(sx127x_t *self, u32_t bitrate)
       frac = 0;
     }
 
-    
+    SX127X_LOCK(self);
     sx127x_write_reg(self, REG_BITRATE_MSB, (u8_t) (code >> 8));
     sx127x_write_reg(self, REG_BITRATE_LSB, (u8_t) code);
     sx127x_write_reg(self, REG_BITRATE_FRAC, frac);
+    self->bitrate = bitrate;
+    sx127x_toa_update(self);
+    SX127X_UNLOCK(self);
   
     SX127X_DBG("set Bitrate in FSK/OOK mode to %d bit/s (code=%i, frac=%i)",
                (int) bitrate, (int) code, (int) frac);
@@ -920,6 +2131,7 @@ u32_t sx127x_set_bitrate(sx127x_t *self, u32_t bitrate)
 // (note: must be set between 600 Hz and 200 kHz)
 void sx127x_set_fdev(sx127x_t *self, u32_t fdev)
 {
+  SX127X_LOCK(self);
   if (self->mode != SX127X_LORA) // FSK/OOK mode
   {
     u32_t f, f1, f2, f11, f12, f21, f22;
@@ -956,25 +2168,30 @@ void sx127x_set_fdev(sx127x_t *self, u32_t fdev)
                 (((u32_t) fmsb) * FREQ_MAGIC_4),
                f);
   }
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // set RX bandwidth [Hz] (FSK/OOK)
 void sx127x_set_rx_bw(sx127x_t *self, u32_t bw)
 {
+  SX127X_LOCK(self);
   if (self->mode != SX127X_LORA) // FSK/OOK mode
   {
     u8_t m, e;
     sx127x_rx_bw_pack(&bw, &m, &e);
     sx127x_write_reg(self, REG_RX_BW, (m << 3) | e);
+    self->rx_bw = bw;
 
     SX127X_DBG("set RX bandwidth in FSK/OOK to %d.%02d kHz (mant=%d, exp=%d)",
                (int) bw / 1000, (int) (bw % 1000) / 10, (int) m, (int) e);
   }
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // set AFC bandwidth [Hz] (FSK/OOK)
 void sx127x_set_afc_bw(sx127x_t *self, u32_t bw)
 {
+  SX127X_LOCK(self);
   if (self->mode != SX127X_LORA) // FSK/OOK mode
   {
     u8_t m, e;
@@ -984,11 +2201,13 @@ void sx127x_set_afc_bw(sx127x_t *self, u32_t bw)
     SX127X_DBG("set AFC bandwidth in FSK/OOK to %d.%02d Hz (mant=%d, exp=%d)",
                (int) bw / 1000, (int) (bw % 1000) / 10, (int) m, (int) e);
   }
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // enable/disable AFC (FSK/OOK)
 void sx127x_set_afc(sx127x_t *self, bool afc)
 {
+  SX127X_LOCK(self);
   if (self->mode != SX127X_LORA) // FSK/OOK mode
   {
     u8_t reg = sx127x_read_reg(self, REG_RX_CONFIG);
@@ -998,11 +2217,13 @@ void sx127x_set_afc(sx127x_t *self, bool afc)
 
     SX127X_DBG("set AFC (FSK/OOK) to '%s'", afc ? "On" : "Off");
   }
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // set Fixed or Variable packet mode (FSK/OOK)
 void sx127x_set_fixed(sx127x_t *self, bool fixed)
 {
+  SX127X_LOCK(self);
   if (self->mode != SX127X_LORA) // FSK/OOK mode
   {
     u8_t reg = sx127x_read_reg(self, REG_PACKET_CONFIG_1);
@@ -1014,17 +2235,22 @@ void sx127x_set_fixed(sx127x_t *self, bool fixed)
                fixed ? "Fixed" : "Variable");
 
     self->fixed = fixed;
+    sx127x_toa_update(self);
   }
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // set DcFree mode: 0=Off, 1=Manchester, 2=Whitening (FSK/OOK)
 void sx127x_set_dcfree(sx127x_t *self, u8_t dcfree)
 {
+  SX127X_LOCK(self);
   if (self->mode != SX127X_LORA) // FSK/OOK mode
   {
     u8_t reg = sx127x_read_reg(self, REG_PACKET_CONFIG_1);
     reg = (reg & 0x9F) | ((dcfree & 3) << 5); // bits 6-5 `DcFree`
     sx127x_write_reg(self, REG_PACKET_CONFIG_1, reg);
+    self->dcfree = dcfree & 3;
+    sx127x_toa_update(self);
     
     SX127X_DBG("set DC Free mode (FSK/OOK) to '%s'",
                dcfree == 0 ? "Off"        :
@@ -1032,11 +2258,13 @@ void sx127x_set_dcfree(sx127x_t *self, u8_t dcfree)
                dcfree == 2 ? "Whitening"  :
                              "Unknown");
   }
+  SX127X_UNLOCK(self);
 }
 //----------------------------------------------------------------------------
 // on/off fast frequency PLL hopping (FSK/OOK)
 void sx127x_set_fast_hop(sx127x_t *self, bool on)
 {
+  SX127X_LOCK(self);
   if (self->mode != SX127X_LORA) // FSK/OOK mode
   {
     u8_t reg = sx127x_read_reg(self, REG_PLL_HOP);
@@ -1046,188 +2274,1722 @@ void sx127x_set_fast_hop(sx127x_t *self, bool on)
     SX127X_DBG("set Fast Frequency PLL hopping (FSK/OOK) to '%s'",
                on ? "On" : "Off");
   }
+  SX127X_UNLOCK(self);
 }
 #endif
 //----------------------------------------------------------------------------
-// send packet (LoRa/FSK/OOK)
-// fixed - implicit header mode (LoRa), fixed packet length (FSK/OOK)
-i16_t sx127x_send(sx127x_t *self, const u8_t *data, i16_t size, bool fixed)
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_SWEEP)
+// on/off RSSI sweep (FSK/OOK): `bins` channels from `freq` [Hz] by `step`
+// [Hz] in RX mode with fast hop; call sx127x_sweep_step() by OS timer each
+// dwell time, power vectors of sweeps go to lock-free ring
+// (dwell time = PLL lock + RSSI settling by `RssiSmoothing` and RX BW;
+//  return dwell time [us], 0 - off or LoRa mode)
+u32_t sx127x_sweep(sx127x_t *self, bool on, u32_t freq, u32_t step, int bins)
 {
-  int i;
-  sx127x_standby(self);
-
-  // check size
-  if (size <= 0) return SX127X_ERR_BAD_SIZE;
-  size = SX127X_MIN(size, MAX_PKT_LENGTH);
+  SX127X_LOCK(self);
+  if (self->sweep_on)
+  { // stop sweep: restore RF frequency (fast hop is on yet) and `RegPllHop`
+    self->sweep_on = false;
+    sx127x_set_frequency(self, self->freq);
+    sx127x_write_reg(self, REG_PLL_HOP, self->sweep_pll_hop);
+  }
 
-  if (self->mode == SX127X_LORA) // LoRa mode
+  if (on && self->mode != SX127X_LORA && bins > 0)
   {
-#ifdef SX127X_USE_LORA
-    // set implicit or explicit header mode
-    if (self->impl_hdr != fixed)
-      sx127x_impl_hdr(self, fixed);
+    int i;
+    u32_t bw = SX127X_MAX(self->rx_bw, 2600);
 
-    // set FIFO base address
-    sx127x_write_reg(self, REG_FIFO_ADDR_PTR, FIFO_TX_BASE_ADDR);
+    // RSSI is averaged by 2**(RssiSmoothing+1) samples at 4*RxBw rate
+    u32_t samples = 2UL << (sx127x_read_reg(self, REG_RSSI_CONFIG) & 0x07);
+    self->sweep_dwell_us = SX127X_SWEEP_HOP_US +
+                           (samples * 1000000UL + 4 * bw - 1) / (4 * bw);
 
-    // write data to FIFO
-    for (i = 0; i < size; i++)
-      sx127x_write_reg(self, REG_FIFO, data[i]);
+    // convert frequencies of bins to `Frf` codes once
+    bins = SX127X_MIN(bins, SX127X_SWEEP_BINS);
+    for (i = 0; i < bins; i++)
+      sx127x_frf_code(freq + i * step, self->sweep_frf[i]);
+    self->sweep_bins = bins;
+    self->sweep_bin  = 0;
+    self->sweep_seq  = 0;
+    self->sweep_end  = 0;
+    memset((void*) &self->sweep_stat, 0, sizeof(self->sweep_stat));
 
-    // set payload length
-    sx127x_write_reg(self, REG_PAYLOAD_LENGTH, (u8_t) size);
+    // `Frf` change by `RegFrfLsb` write in RX mode (`FastHopOn`)
+    self->sweep_pll_hop = sx127x_read_reg(self, REG_PLL_HOP);
+    sx127x_write_reg(self, REG_PLL_HOP, self->sweep_pll_hop | 0x80);
+    sx127x_write_burst(self, REG_FRF_MSB, self->sweep_frf[0], 3);
+    sx127x_rx(self);
+    self->sweep_on = true;
+  }
+
+  SX127X_DBG("RSSI sweep: %i bins, dwell=%lu us",
+             self->sweep_on ? self->sweep_bins : 0,
+             self->sweep_on ? (unsigned long) self->sweep_dwell_us : 0UL);
+  SX127X_UNLOCK(self);
+  return self->sweep_on ? self->sweep_dwell_us : 0;
+}
+//----------------------------------------------------------------------------
+// dwell time expired: read RSSI of current bin and hop to next bin by one
+// vectored SPI exchange (call it by OS timer, `time_ns` - current time)
+void sx127x_sweep_step(sx127x_t *self, u64_t time_ns)
+{
+  u8_t tx_buf[2 + 4], rx_buf[2 + 4];
+  sx127x_seg_t seg[2];
+  sx127x_sweep_vec_t *vec;
+  const u8_t *frf;
+  int bin, next;
 
-    // start TX packet
-    sx127x_tx(self);
+  SX127X_LOCK_IRQ(self);
+  if (!self->sweep_on)
+  { // sweep is stopped
+    SX127X_UNLOCK(self);
+    return;
+  }
 
-    // wait for TX done, standby automatically on TX_DONE
-    while ((sx127x_read_reg(self, REG_IRQ_FLAGS) & IRQ_TX_DONE) == 0)
+  bin  = self->sweep_bin;
+  next = bin + 1 < self->sweep_bins ? bin + 1 : 0;
+  frf  = self->sweep_frf[next];
+  vec  = &self->sweep_vec[self->sweep_head % SX127X_SWEEP_RING];
+
+  if (bin == 0) // first bin: use free slot of ring or drop vector
+    self->sweep_skip =
+      self->sweep_head - self->sweep_tail >= SX127X_SWEEP_RING;
+
+  // read `RegRssiValue`
+  tx_buf[0] = REG_RSSI_VALUE;
+  tx_buf[1] = 0;
+  seg[0].tx_buf = tx_buf;
+  seg[0].rx_buf = rx_buf;
+  seg[0].len    = 2;
+
+  // write `Frf` of next bin by one burst (hop by `RegFrfLsb`)
+  tx_buf[2] = REG_FRF_MSB | 0x80;
+  memcpy((void*) (tx_buf + 3), (const void*) frf, 3);
+  seg[1].tx_buf = tx_buf + 2;
+  seg[1].rx_buf = rx_buf + 2;
+  seg[1].len    = 4;
+
+  sx127x_exchange_v(self, seg, 2);
+
+#ifdef SX127X_USE_CACHE
+  sx127x_cache_put(self, REG_FRF_MSB, frf[0]);
+  sx127x_cache_put(self, REG_FRF_MID, frf[1]);
+  sx127x_cache_put(self, REG_FRF_LSB, frf[2]);
+#endif
+
+  if (!self->sweep_skip)
+    vec->rssi[bin] = (- (i16_t) rx_buf[1]) >> 1;
+
+  if (next == 0)
+  { // last bin: put power vector to ring
+    u32_t period_us = self->sweep_end == 0 ? 0 :
+                      (u32_t) ((time_ns - self->sweep_end) / 1000);
+    sx127x_sweep_stat_t *st = &self->sweep_stat;
+
+    if (period_us != 0)
     {
-      // FIXME: check timeout, save energy
+      if (st->periods == 0 || period_us < st->min_us) st->min_us = period_us;
+      if (period_us > st->max_us) st->max_us = period_us;
+      st->total_us += period_us;
+      st->periods++;
     }
 
-    // clear IRQ's
-    sx127x_write_reg(self, REG_IRQ_FLAGS, IRQ_TX_DONE);
-#endif
+    if (self->sweep_skip)
+      st->drops++; // ring is full
+    else
+    { // fill and publish slot
+      vec->seq       = self->sweep_seq;
+      vec->period_us = period_us;
+      vec->end_ns    = time_ns;
+      vec->bins      = self->sweep_bins;
+      __sync_synchronize();
+      self->sweep_head++;
+      st->sweeps++;
+    }
+
+    self->sweep_seq++;
+    self->sweep_end = time_ns;
   }
-  else // FSK/OOK mode
-  {
-#ifdef SX127X_USE_FSKOOK
-    u32_t cnt;
-    //u8_t add;
-    
-    // set fixed or variable packet length
-    if (self->fixed != fixed)
-      sx127x_set_fixed(self, fixed);
 
-    // set TX start FIFO condition
-    //sx127x_write_reg(self, REG_FIFO_THRESH, TX_START_FIFO_NOEMPTY);
-    
-#if 0
-    SX127X_DBG("#0 RegIrqFlags1=0x%02X",
-	       sx127x_read_reg(self, REG_IRQ_FLAGS_1));
-    SX127X_DBG("#0 RegIrqFlags2=0x%02X",
-	       sx127x_read_reg(self, REG_IRQ_FLAGS_2));
+  self->sweep_bin = next;
+  SX127X_UNLOCK(self);
+}
+//----------------------------------------------------------------------------
+// get oldest power vector of sweep ring or NULL if ring is empty (consumer)
+// (vector is valid until sx127x_sweep_pop())
+const sx127x_sweep_vec_t *sx127x_sweep_peek(sx127x_t *self)
+{
+  if (self->sweep_tail == self->sweep_head)
+    return (const sx127x_sweep_vec_t*) NULL;
+
+  __sync_synchronize(); // read slot after `sweep_head`
+  return &self->sweep_vec[self->sweep_tail % SX127X_SWEEP_RING];
+}
+//----------------------------------------------------------------------------
+// free oldest power vector of sweep ring (consumer)
+void sx127x_sweep_pop(sx127x_t *self)
+{
+  if (self->sweep_tail != self->sweep_head)
+  {
+    __sync_synchronize();
+    self->sweep_tail++; // free slot
+  }
+}
+//----------------------------------------------------------------------------
+// get RSSI sweep statistics (reset it if `reset` is true)
+void sx127x_sweep_stat(sx127x_t *self, sx127x_sweep_stat_t *stat, bool reset)
+{
+  SX127X_LOCK(self);
+  *stat = self->sweep_stat;
+  if (reset)
+    memset((void*) &self->sweep_stat, 0, sizeof(self->sweep_stat));
+  SX127X_UNLOCK(self);
+}
+#endif // SX127X_USE_FSKOOK && SX127X_USE_SWEEP
+//----------------------------------------------------------------------------
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_FHSS)
+// set FHSS hop period 1...255 symbols (LoRa, 0 - FHSS off)
+void sx127x_set_hop_period(sx127x_t *self, u8_t period)
+{
+  SX127X_LOCK(self);
+  if (self->mode == SX127X_LORA) // LoRa mode
+  {
+    sx127x_write_reg(self, REG_HOP_PERIOD, period);
+    self->hop_period = period;
+
+    SX127X_DBG("set FHSS hop period in LoRa mode to %i symbols",
+               (int) period);
+  }
+  SX127X_UNLOCK(self);
+}
+//----------------------------------------------------------------------------
+// go to channel 0 of hop table before packet (LoRa FHSS)
+static void sx127x_fhss_reset(sx127x_t *self)
+{
+  if (self->hop_num == 0 || self->hop_period == 0)
+    return; // FHSS is off
+
+  sx127x_write_burst(self, REG_FRF_MSB, self->hop_frf[0], 3);
+  self->hop_ch  = 0;
+  self->hop_idx = 0;
+}
+//----------------------------------------------------------------------------
+// set FHSS hop table: `n` channel frequencies [Hz] are converted to `Frf`
+// codes once; channel 0 is used at start of each packet, channel of hop N
+// is `freq[N % n]` by hop counter of driver (also past 64 hops of 6-bit
+// `FhssPresentChannel`) (return number of channels, 0 - table off)
+int sx127x_fhss_table(sx127x_t *self, const u32_t *freq, int n)
+{
+  int i;
+  n = SX127X_LIMIT(n, 0, SX127X_HOP_MAX);
+
+  SX127X_LOCK(self);
+  for (i = 0; i < n; i++)
+    sx127x_frf_code(freq[i], self->hop_frf[i]);
+  self->hop_num = (u8_t) n;
+  self->hop_ch  = 0;
+  self->hop_idx = 0;
+  memset((void*) &self->hop_stat, 0, sizeof(self->hop_stat));
+
+  if (n) sx127x_fhss_reset(self);
+  else   sx127x_set_frequency(self, self->freq); // restore RF frequency
+
+  SX127X_DBG("set FHSS hop table of %i channels", n);
+  SX127X_UNLOCK(self);
+  return n;
+}
+//----------------------------------------------------------------------------
+// IRQ handler of `FhssChangeChannel` (DIO2 line by default mapping, LoRa):
+// write `Frf` of next channel, read `FhssPresentChannel` and clear IRQ flag
+// by one vectored SPI exchange (look sx127x_dio_handler())
+void sx127x_fhss_handler(sx127x_t *self)
+{
+  u8_t tx_buf[4 + 2 + 2], rx_buf[4 + 2 + 2], idx, gap;
+  const u8_t *frf;
+  sx127x_seg_t seg[3];
+
+  SX127X_LOCK_IRQ(self);
+  if (self->hop_num == 0)
+  { // no hop table: clear IRQ flag only
+    sx127x_write_reg(self, REG_IRQ_FLAGS, IRQ_FHSS_CHANGE);
+    SX127X_UNLOCK(self);
+    return;
+  }
+
+  // next channel is expected (hop deadline is one hop period); table is
+  // indexed by driver hop counter, not by 6-bit `FhssPresentChannel`
+  // (64 % hop_num != 0 would jump back to channel 0 at wrap of 64)
+  idx = self->hop_idx + 1;
+  if (idx >= self->hop_num) idx = 0;
+  frf = self->hop_frf[idx];
+
+  // write `Frf` by one burst
+  tx_buf[0] = REG_FRF_MSB | 0x80;
+  memcpy((void*) (tx_buf + 1), (const void*) frf, 3);
+  seg[0].tx_buf = tx_buf;
+  seg[0].rx_buf = rx_buf;
+  seg[0].len    = 4;
+
+  // read `FhssPresentChannel`
+  tx_buf[4] = REG_HOP_CHANNEL;
+  tx_buf[5] = 0;
+  seg[1].tx_buf = tx_buf + 4;
+  seg[1].rx_buf = rx_buf + 4;
+  seg[1].len    = 2;
+
+  // clear `FhssChangeChannel`
+  tx_buf[6] = REG_IRQ_FLAGS | 0x80;
+  tx_buf[7] = IRQ_FHSS_CHANGE;
+  seg[2].tx_buf = tx_buf + 6;
+  seg[2].rx_buf = rx_buf + 6;
+  seg[2].len    = 2;
+
+  sx127x_exchange_v(self, seg, 3);
+
+#ifdef SX127X_USE_CACHE
+  sx127x_cache_put(self, REG_FRF_MSB, frf[0]);
+  sx127x_cache_put(self, REG_FRF_MID, frf[1]);
+  sx127x_cache_put(self, REG_FRF_LSB, frf[2]);
 #endif
-    
-    // wait while FIFO is no empty
-    cnt = 1000000000; // FIXME: callibrate timeout
-    while ((sx127x_read_reg(self, REG_IRQ_FLAGS_2) & IRQ2_FIFO_EMPTY) == 0)
+
+  gap = ((rx_buf[5] & 0x3F) - self->hop_ch) & 0x3F;
+  if (gap == 0)
+    self->hop_stat.spurious++; // channel is not changed
+  else
+  {
+    self->hop_stat.hops++;
+    self->hop_stat.misses += gap - 1;
+  }
+
+  if (gap != 1)
+  { // IRQ is late or spurious: advance hop counter by channel delta and
+    // rewrite `Frf` of present channel
+    idx = (u8_t) ((self->hop_idx + gap) % self->hop_num);
+    sx127x_write_burst(self, REG_FRF_MSB, self->hop_frf[idx], 3);
+  }
+
+  self->hop_ch  = rx_buf[5] & 0x3F;
+  self->hop_idx = idx;
+  SX127X_UNLOCK(self);
+}
+//----------------------------------------------------------------------------
+// get FHSS statistics (reset it if `reset` is true)
+void sx127x_fhss_stat(sx127x_t *self, sx127x_fhss_stat_t *stat, bool reset)
+{
+  SX127X_LOCK(self);
+  *stat = self->hop_stat;
+  if (reset)
+    memset((void*) &self->hop_stat, 0, sizeof(self->hop_stat));
+  SX127X_UNLOCK(self);
+}
+#endif // SX127X_USE_LORA && SX127X_USE_FHSS
+//----------------------------------------------------------------------------
+// compute time on air of packet with `size` bytes payload [us] by `toa`
+static u32_t sx127x_toa_us(const sx127x_toa_t *toa, bool lora, int size)
+{
+  u64_t t = toa->over; // LoRa [1/4 symbols] or FSK/OOK [bits]
+
+  if (toa->unit_ns == 0 || size < 0) return 0; // parameters are not set
+
+  if (lora) // LoRa mode
+  {
+    i32_t num = 8 * (i32_t) size + toa->num;
+    if (num > 0 && toa->den != 0)
+      t += (u64_t) 4 * ((num + toa->den - 1) / toa->den) * toa->cr;
+    t = (t * toa->unit_ns + 3999) / 4000;
+  }
+  else // FSK/OOK mode
+  {
+    t += (u64_t) size * toa->bits;
+    t = (t * toa->unit_ns + 999) / 1000;
+  }
+
+  return t > 0xFFFFFFFF ? 0xFFFFFFFF : (u32_t) t;
+}
+//----------------------------------------------------------------------------
+// get time on air of packet with `size` bytes payload [us] (LoRa/FSK/OOK)
+// (computed by cached parameters of active configuration, look sx127x_toa_t)
+u32_t sx127x_airtime_us(const sx127x_t *self, int size)
+{
+  return sx127x_toa_us(&self->toa, self->mode == SX127X_LORA, size);
+}
+//----------------------------------------------------------------------------
+// get time on air of packet with `size` bytes payload [ms] (rounded up)
+u32_t sx127x_airtime_ms(const sx127x_t *self, int size)
+{
+  return (u32_t) (((u64_t) sx127x_airtime_us(self, size) + 999) / 1000);
+}
+//----------------------------------------------------------------------------
+// get time on air statistics (reset it if `reset` is true)
+void sx127x_air_stat(sx127x_t *self, sx127x_air_stat_t *stat, bool reset)
+{
+  SX127X_LOCK(self);
+  *stat = self->air_stat;
+  if (reset)
+    memset((void*) &self->air_stat, 0, sizeof(self->air_stat));
+  SX127X_UNLOCK(self);
+}
+//----------------------------------------------------------------------------
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_EXTRA) && \
+    defined(SX127X_USE_ADR)
+// 10*log10(500000 / BW) table of `sx127x_bw_tbl` [0.1 dB]
+static const i16_t sx127x_bw_db_tbl[] = BW_DB_TABLE;
+
+// Bandwidth candidates of adaptive data rate [Hz]
+static const u32_t sx127x_adr_bw_tbl[] = { 125000, 250000, 500000 };
+
+// demodulator SNR limit of SF7...SF12 [0.1 dB] (look datasheet)
+static const i16_t sx127x_adr_snr_tbl[] = {
+  -75, -100, -125, -150, -175, -200 };
+//----------------------------------------------------------------------------
+// get 10*log10(500000 / BW) [0.1 dB], bandwidth in Hz
+static i16_t sx127x_bw_db(u32_t bw)
+{
+  u8_t ix;
+  sx127x_bw_pack(&bw, &ix);
+  return sx127x_bw_db_tbl[ix];
+}
+//----------------------------------------------------------------------------
+// find link history of peer (NULL - not found)
+static sx127x_adr_peer_t *sx127x_adr_find(sx127x_t *self, u32_t peer)
+{
+  int i;
+  for (i = 0; i < SX127X_ADR_PEERS; i++)
+    if (self->adr_peer[i].frames != 0 && self->adr_peer[i].id == peer)
+      return &self->adr_peer[i];
+  return (sx127x_adr_peer_t*) NULL;
+}
+//----------------------------------------------------------------------------
+// on/off adaptive data rate (LoRa): keep SNR `margin` [dB] over demodulator
+// limit with TX power up to `power_max` [dBm]; link history is cleared
+// (return TX power set [dBm])
+i8_t sx127x_adr(sx127x_t *self, bool on, u8_t margin, i8_t power_max)
+{
+  SX127X_LOCK(self);
+  self->adr_on        = on;
+  self->adr_margin    = margin;
+  self->adr_power_max = power_max;
+  memset((void*) self->adr_peer, 0, sizeof(self->adr_peer));
+  if (on)
+    self->adr_power = sx127x_set_power_dbm(self, power_max);
+  SX127X_UNLOCK(self);
+
+  SX127X_DBG("set adaptive data rate to '%s' (margin=%d dB, power<=%d dBm)",
+             on ? "on" : "off", (int) margin, (int) power_max);
+
+  return self->adr_power;
+}
+//----------------------------------------------------------------------------
+// put received frame of `peer` to link history (call it from on_receive_ex()
+// or RX ring consumer; `tx_power` - TX power of peer [dBm] by protocol)
+void sx127x_adr_rx(sx127x_t *self, u32_t peer,
+                   const sx127x_rx_meta_t *meta, i8_t tx_power)
+{
+  sx127x_adr_peer_t *p;
+  i16_t snr, bw_db;
+  int i;
+
+  if (!self->adr_on || meta->mode != SX127X_LORA)
+    return;
+
+  SX127X_LOCK(self);
+  p = sx127x_adr_find(self, peer);
+  if (p == (sx127x_adr_peer_t*) NULL)
+  { // new peer replaces peer with fewest frames
+    p = &self->adr_peer[0];
+    for (i = 1; i < SX127X_ADR_PEERS; i++)
+      if (self->adr_peer[i].frames < p->frames)
+        p = &self->adr_peer[i];
+    memset((void*) p, 0, sizeof(sx127x_adr_peer_t));
+    p->id = peer;
+  }
+
+  bw_db = sx127x_bw_db(meta->bw);
+  snr   = meta->snr * 10;
+  if (meta->snr >= SX127X_ADR_SNR_SAT)
+  { // SNR estimation is saturated: use RSSI over noise floor
+    // (-174 dBm/Hz + 10*log10(BW) + NF=6 dB is -111 dBm at BW=500 kHz)
+    i16_t rssi_snr = meta->rssi * 10 + 1110 + bw_db;
+    if (rssi_snr > snr) snr = rssi_snr;
+  }
+
+  i = (int) (p->frames % SX127X_ADR_HIST);
+  p->rssi[i] = meta->rssi;
+  p->snr[i]  = meta->snr;
+  p->link[i] = snr - bw_db - (i16_t) tx_power * 10;
+  p->frames++;
+  SX127X_UNLOCK(self);
+}
+//----------------------------------------------------------------------------
+// choose fastest BW/SF/power by worst link of `peer` history and apply it
+// by one batch in standby mode (call it between packets); `size` - payload
+// size to compare time on air, `adr` - decision or NULL
+// (return expected time on air saved per packet [us], 0 - no change)
+i32_t sx127x_adr_apply(sx127x_t *self, u32_t peer, int size,
+                       sx127x_adr_t *adr)
+{
+  const sx127x_adr_peer_t *p;
+  sx127x_adr_t a;
+  sx127x_toa_t toa;
+  i16_t link, pred, need, power;
+  i32_t saved = 0;
+  int i, j, n;
+  u8_t mode;
+
+  memset((void*) &a, 0, sizeof(sx127x_adr_t));
+
+  SX127X_LOCK(self);
+  p = sx127x_adr_find(self, peer);
+  if (self->adr_on && self->mode == SX127X_LORA &&
+      p != (const sx127x_adr_peer_t*) NULL)
+  {
+    // worst link of history (0.1 dB at BW=500 kHz and TX power 0 dBm)
+    n = (int) SX127X_MIN(p->frames, SX127X_ADR_HIST);
+    link = p->link[0];
+    for (i = 1; i < n; i++)
+      if (p->link[i] < link) link = p->link[i];
+
+    // fastest BW/SF at maximum TX power which keeps SNR margin
+    // (lowest SF which keeps margin is fastest for each BW)
+    for (i = 0; i < (int) (sizeof(sx127x_adr_bw_tbl) / sizeof(u32_t)); i++)
     {
-      // FIXME: check timeout, save energy
-#if 0
-      SX127X_DBG("#1 RegIrqFlags1=0x%02X",
-                 sx127x_read_reg(self, REG_IRQ_FLAGS_1));
-      SX127X_DBG("#1 RegIrqFlags2=0x%02X",
-                 sx127x_read_reg(self, REG_IRQ_FLAGS_2));
-#endif
-      if (--cnt == 0)
+      u32_t bw = sx127x_adr_bw_tbl[i];
+      pred = link + sx127x_bw_db(bw) + (i16_t) self->adr_power_max * 10;
+      for (j = 0; j < 6; j++)
       {
-        SX127X_DBG("stop waiting `FifoEmpty` by timeout");
-        break; // exit by timeout
+        u8_t sf = (u8_t) (7 + j);
+        bool ldro = (((u64_t) 1000000) << sf) / bw > 16000; // Tsym > 16 ms
+        u32_t t;
+
+        need = sx127x_adr_snr_tbl[j] + (i16_t) self->adr_margin * 10;
+        if (pred < need) continue;
+
+        sx127x_toa_lora(self, &toa, sf, bw, ldro);
+        t = sx127x_toa_us(&toa, true, size);
+        if (a.bw == 0 || t < a.new_us)
+        {
+          a.bw     = bw;
+          a.sf     = sf;
+          a.ldro   = ldro;
+          a.margin = pred - need;
+          a.new_us = t;
+        }
+        break;
       }
     }
 
+    if (a.bw == 0)
+    { // link is too weak: most robust configuration
+      a.bw     = sx127x_adr_bw_tbl[0];
+      a.sf     = 12;
+      a.ldro   = true;
+      a.margin = link + sx127x_bw_db(a.bw) +
+                 (i16_t) self->adr_power_max * 10 -
+                 (sx127x_adr_snr_tbl[5] + (i16_t) self->adr_margin * 10);
+      sx127x_toa_lora(self, &toa, a.sf, a.bw, a.ldro);
+      a.new_us = sx127x_toa_us(&toa, true, size);
+    }
+
+    // decrease TX power by rest of SNR margin
+    power = self->adr_power_max;
+    if (a.margin > 0)
+      power = SX127X_MAX(power - a.margin / 10,
+                         SX127X_MIN(power, SX127X_ADR_POWER_MIN));
+    a.margin -= (self->adr_power_max - power) * 10;
+    a.power   = (i8_t) power;
+    a.old_us  = sx127x_airtime_us(self, size);
+
+    mode = sx127x_get_mode(self);
+    if (mode != MODE_TX &&
+        (a.bw != self->bw || a.sf != self->sf || a.ldro != self->ldro ||
+         a.power != self->adr_power))
+    { // reconfigure by one batch in standby mode
+      if (mode != MODE_SLEEP && mode != MODE_STDBY)
+        sx127x_set_mode(self, MODE_STDBY);
+#ifdef SX127X_USE_BATCH
+      sx127x_batch_begin(self);
+#endif
+      sx127x_set_bw(self, a.bw);
+      sx127x_set_sf(self, a.sf);
+      sx127x_set_ldro(self, a.ldro);
+      a.power = self->adr_power = sx127x_set_power_dbm(self, a.power);
+#ifdef SX127X_USE_BATCH
+      sx127x_batch_commit(self);
+#endif
+      if (mode != MODE_SLEEP && mode != MODE_STDBY)
+        sx127x_set_mode(self, mode);
+
+      saved = (i32_t) a.old_us - (i32_t) a.new_us;
+
+      SX127X_DBG("ADR of peer %lu: BW=%lu Hz, SF=%d, LDRO=%d, power=%d dBm, "
+                 "time on air %lu -> %lu us (saved %ld us per packet)",
+                 (unsigned long) peer, (unsigned long) a.bw, (int) a.sf,
+                 (int) a.ldro, (int) self->adr_power,
+                 (unsigned long) a.old_us, (unsigned long) a.new_us,
+                 (long) saved);
+    }
+  }
+  SX127X_UNLOCK(self);
+
+  if (adr != (sx127x_adr_t*) NULL)
+    *adr = a;
+
+  return saved;
+}
+#endif // SX127X_USE_LORA && SX127X_USE_EXTRA && SX127X_USE_ADR
+//----------------------------------------------------------------------------
+// TX done: clear flag, defer callback and wake up sender (LoRa/FSK/OOK)
+static void sx127x_tx_done(sx127x_t *self, bool ok)
+{
+  self->tx_irq = false;
+
+  if (ok)
+  { // account time on air of sent packet
+    self->air_stat.tx_packets++;
+    self->air_stat.tx_us += self->tx_air_us;
+  }
+
+  sx127x_cb_put(self, SX127X_CB_TRANSMIT, ok, 0, 0, NULL);
+
+  if (ok && self->tx_wake != (void (*)(sx127x_t*, void*)) NULL)
+    self->tx_wake(self, self->tx_context);
+}
+//----------------------------------------------------------------------------
+// load packet to FIFO in standby mode before TX (LoRa/FSK/OOK)
+// irq - set DIO0 mapping to TX done
+static void sx127x_load(sx127x_t *self, const u8_t *data, i16_t size,
+                        bool fixed, bool irq)
+{
+  sx127x_standby(self);
+
+  if (self->mode == SX127X_LORA) // LoRa mode
+  {
+#ifdef SX127X_USE_LORA
+    // set implicit or explicit header mode
+    if (self->impl_hdr != fixed)
+      sx127x_impl_hdr(self, fixed);
+
+    // set FIFO base address
+    sx127x_write_reg(self, REG_FIFO_ADDR_PTR, FIFO_TX_BASE_ADDR);
+
+    // write data to FIFO by burst mode
+    sx127x_write_burst(self, REG_FIFO, data, size);
+
+    // set payload length
+    sx127x_write_reg(self, REG_PAYLOAD_LENGTH, (u8_t) size);
+
+#ifdef SX127X_USE_FHSS
+    // start packet at channel 0 of hop table
+    sx127x_fhss_reset(self);
+#endif
+
+    // set DIO0 mapping (`TxDone`) if wait IRQ
+    if (irq) sx127x_dio0_map(self, DIO0_TX_DONE);
+#endif
+  }
+  else // FSK/OOK mode
+  {
+#ifdef SX127X_USE_FSKOOK
+    // set fixed or variable packet length
+    if (self->fixed != fixed)
+      sx127x_set_fixed(self, fixed);
+
+    // clear FIFO by set `FifoOverrun` (instead of waiting `FifoEmpty`)
+    sx127x_write_reg(self, REG_IRQ_FLAGS_2, IRQ2_FIFO_OVERRUN);
+
     if (self->fixed)
     { // fixed packet length
       sx127x_write_reg(self, REG_PAYLOAD_LEN, size);
-      //add = 0;
+
+      // write data to FIFO by burst mode
+      sx127x_write_burst(self, REG_FIFO, data, size);
     }
     else
     { // variable packet length
-      sx127x_write_reg(self, REG_FIFO, size);
-      //add = 1;
+      u8_t buf[MAX_PKT_LENGTH + 1];
+
+      // write length byte and data to FIFO by one burst
+      buf[0] = (u8_t) size;
+      memcpy((void*) (buf + 1), (const void*) data, size);
+      sx127x_write_burst(self, REG_FIFO, buf, size + 1);
+    }
+
+    // DIO0 mapping 0b00 in TxPacket is `PacketSent` (look sx127x_set_pars())
+#endif
+  }
+}
+//----------------------------------------------------------------------------
+// start TX done timeout of busy waiting: return deadline [ns] by time hook
+// or number of register polls without it (look sx127x_time_hook())
+static u64_t sx127x_poll_start(sx127x_t *self, u32_t timeout_ms)
+{
+  if (self->time_ns != (u64_t (*)(sx127x_t*, void*)) NULL)
+    return self->time_ns(self, self->time_context) +
+           (u64_t) timeout_ms * 1000000;
+  return (u64_t) timeout_ms * SX127X_POLL_PER_MS;
+}
+//----------------------------------------------------------------------------
+// check TX done timeout of busy waiting (`poll` - from sx127x_poll_start())
+static bool sx127x_poll_timeout(sx127x_t *self, u64_t *poll)
+{
+  if (self->time_ns != (u64_t (*)(sx127x_t*, void*)) NULL)
+    return self->time_ns(self, self->time_context) >= *poll;
+  return --(*poll) == 0;
+}
+//----------------------------------------------------------------------------
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_STREAM)
+// restore packet length and FIFO threshold after streaming (look below)
+static void sx127x_stream_end(sx127x_t *self);
+#endif
+//----------------------------------------------------------------------------
+// stop waiting TX done IRQ by timeout of tx_wait() hook; IRQ handler may
+// finish TX just before bus is locked, so `tx_irq` is checked again here
+// (return SX127X_ERR_NONE if TX is done, SX127X_ERR_TIMEOUT otherwise)
+static i16_t sx127x_tx_timeout(sx127x_t *self, u32_t timeout_ms)
+{
+  i16_t retv = SX127X_ERR_NONE;
+
+  sx127x_cb_lock(self, false);
+  if (self->tx_irq)
+  {
+    SX127X_DBG("stop waiting TX done by timeout %u ms",
+               (unsigned) timeout_ms);
+    sx127x_standby(self);
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_STREAM)
+    if (self->stream != SX127X_STREAM_OFF)
+      sx127x_stream_end(self);
+#endif
+    sx127x_tx_done(self, false);
+    retv = SX127X_ERR_TIMEOUT;
+  }
+  sx127x_cb_unlock(self);
+
+  return retv;
+}
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_QUEUE
+// start TX of queued frames if queue is idle (look below)
+static void sx127x_txq_start(sx127x_t *self);
+#endif
+//----------------------------------------------------------------------------
+// take transmitter for blocking send (false - TX queue is draining)
+static bool sx127x_tx_take(sx127x_t *self)
+{
+#ifdef SX127X_USE_QUEUE
+  return __sync_bool_compare_and_swap(&self->txq_busy, 0, 2);
+#else
+  return true;
+#endif
+}
+//----------------------------------------------------------------------------
+// release transmitter after blocking send, start frames queued meanwhile
+static void sx127x_tx_release(sx127x_t *self)
+{
+#ifdef SX127X_USE_QUEUE
+  self->txq_busy = 0;
+  __sync_synchronize();
+  sx127x_txq_start(self);
+#endif
+}
+//----------------------------------------------------------------------------
+// send packet and wait TX done (LoRa/FSK/OOK)
+static i16_t sx127x_send_wait(sx127x_t *self, const u8_t *data, i16_t size,
+                              bool fixed)
+{
+  bool irq = self->tx_wait != (int (*)(sx127x_t*, u32_t, void*)) NULL;
+  u32_t timeout_ms;
+  u64_t poll;
+  bool ok = true;
+
+  // check size
+  if (size <= 0) return SX127X_ERR_BAD_SIZE;
+  size = SX127X_MIN(size, MAX_PKT_LENGTH);
+
+  // load packet to FIFO and start TX by one bus transaction
+  SX127X_LOCK(self);
+  sx127x_load(self, data, size, fixed, irq);
+
+  // TX timeout by time on air of packet (header and length mode are set)
+  self->tx_air_us = sx127x_airtime_us(self, size);
+  timeout_ms = sx127x_airtime_ms(self, size);
+  timeout_ms += timeout_ms / 2 + SX127X_TX_MARGIN;
+  poll = sx127x_poll_start(self, timeout_ms); // timeout of busy waiting
+
+  // start TX packet
+  self->tx_irq = irq;
+  sx127x_tx(self);
+  SX127X_UNLOCK(self); // IRQ handler may access bus while waiting TX done
+
+  if (irq)
+  { // sleep until TX done IRQ on DIO0 (look sx127x_irq_handler())
+    if (self->tx_wait(self, timeout_ms, self->tx_context) < 0)
+      return sx127x_tx_timeout(self, timeout_ms);
+    return SX127X_ERR_NONE;
+  }
+
+  if (self->mode == SX127X_LORA) // LoRa mode
+  {
+#ifdef SX127X_USE_LORA
+    // wait for TX done, standby automatically on TX_DONE
+    while ((sx127x_read_reg(self, REG_IRQ_FLAGS) & IRQ_TX_DONE) == 0)
+    {
+      if (sx127x_poll_timeout(self, &poll))
+      {
+        SX127X_DBG("stop waiting `TxDone` by timeout");
+        ok = false;
+        break; // exit by timeout
+      }
+    }
+
+    // clear IRQ's
+    sx127x_write_reg(self, REG_IRQ_FLAGS, IRQ_TX_DONE);
+#endif
+  }
+  else // FSK/OOK mode
+  {
+#ifdef SX127X_USE_FSKOOK
+    // wait `PacketSent` (bit 3 in `RegIrqFlags2`)
+    while ((sx127x_read_reg(self, REG_IRQ_FLAGS_2) & IRQ2_PACKET_SENT) == 0)
+    {
+      if (sx127x_poll_timeout(self, &poll))
+      {
+        SX127X_DBG("stop waiting `PacketSent` by timeout");
+        ok = false;
+        break; // exit by timeout
+      }
+    }
+#endif
+  }
+
+  // switch to standby mode
+  sx127x_cb_lock(self, false);
+  sx127x_standby(self);
+  sx127x_tx_done(self, ok);
+  sx127x_cb_unlock(self);
+
+  return ok ? SX127X_ERR_NONE : SX127X_ERR_TIMEOUT;
+}
+//----------------------------------------------------------------------------
+// send packet and wait TX done (LoRa/FSK/OOK)
+// fixed - implicit header mode (LoRa), fixed packet length (FSK/OOK)
+// (return SX127X_ERR_TIMEOUT if TX done is not received in time on air,
+//  SX127X_ERR_BUSY if asynchronous TX queue is draining)
+i16_t sx127x_send(sx127x_t *self, const u8_t *data, i16_t size, bool fixed)
+{
+  i16_t retv;
+
+  // check size
+  if (size <= 0) return SX127X_ERR_BAD_SIZE;
+
+  // don't reload FIFO in the middle of frame of TX queue
+  if (!sx127x_tx_take(self)) return SX127X_ERR_BUSY;
+
+  retv = sx127x_send_wait(self, data, size, fixed);
+  sx127x_tx_release(self);
+  return retv;
+}
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_QUEUE
+// set callback on frame of asynchronous TX queue sent (LoRa/FSK/OOK)
+// (called from sx127x_irq_handler() or sx127x_txq_poll())
+void sx127x_on_sent(
+  sx127x_t *self,
+  void (*on_sent)(          // frame sent callback or NULL
+    sx127x_t *self,           // pointer to sx127x_t object
+    void *frame,              // frame context from sx127x_send_async()
+    i16_t status,             // SX127X_ERR_NONE or error code
+    u32_t airtime_ms,         // computed time on air [ms]
+    void *context),           // optional context
+  void *on_sent_context)    // optional on_sent() context
+{
+  self->on_sent         = on_sent;
+  self->on_sent_context = on_sent_context;
+}
+//----------------------------------------------------------------------------
+// load oldest frame of TX queue and start TX
+static void sx127x_txq_tx(sx127x_t *self)
+{
+  sx127x_frame_t *frame = &self->txq[self->txq_tail % SX127X_TXQ_SIZE];
+  sx127x_load(self, frame->data, frame->size, frame->fixed, true);
+  self->tx_air_us   = sx127x_airtime_us(self, frame->size);
+  frame->airtime_ms = sx127x_airtime_ms(self, frame->size);
+  sx127x_tx(self);
+}
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_LBT
+// start channel check before TX: CAD (LoRa) or RSSI sampling (FSK/OOK)
+// (return 1 - busy, 0 - clear, -1 - result by `CadDone` IRQ or LBT timer)
+static int sx127x_lbt_sense(sx127x_t *self)
+{
+  bool rx = self->lbt_state == SX127X_LBT_BACKOFF; // RX mode in backoff
+  self->lbt_state = SX127X_LBT_SENSE;
+
+  if (self->mode == SX127X_LORA) // LoRa mode
+  {
+#ifdef SX127X_USE_LORA
+    // `SignalDetected`, `SignalSynchronized`, `HeaderInfoValid`
+    if (rx && (sx127x_read_reg(self, REG_MODEM_STAT) & 0x0B))
+      return 1; // packet is being received
+
+    sx127x_standby(self);
+    sx127x_dio0_map(self, DIO0_CAD_DONE);
+    sx127x_cad(self); // `CadDone` IRQ (look sx127x_dio0_handler())
+#endif
+  }
+  else // FSK/OOK mode
+  {
+    if (rx) // RSSI is sampled in RX mode while backoff
+      return sx127x_get_rssi(self) > self->lbt_rssi ? 1 : 0;
+
+    sx127x_rx(self);
+    self->lbt_timer(self, SX127X_LBT_SENSE_US, self->lbt_context);
+  }
+
+  return -1;
+}
+#endif // SX127X_USE_LBT
+//----------------------------------------------------------------------------
+// start TX of next frame from queue or go to RX mode if queue is empty
+// (call only by owner of `txq_busy` flag)
+static void sx127x_txq_run(sx127x_t *self)
+{
+  while (1)
+  {
+    if (self->txq_tail != self->txq_head)
+    { // start TX of next frame (after channel check if LBT is on)
+#ifdef SX127X_USE_LBT
+      if (self->lbt_on)
+      {
+        self->lbt_be    = SX127X_LBT_BE_MIN;
+        self->lbt_tries = 0;
+        self->lbt_state = SX127X_LBT_IDLE;
+        sx127x_lbt_sense(self); // first check is never done at once
+        return;
+      }
+#endif
+      sx127x_txq_tx(self);
+      return;
+    }
+
+    // queue is empty: go to RX mode and release queue
+    sx127x_rx(self);
+    self->txq_busy = 0;
+    __sync_synchronize();
+
+    // recheck queue (frame may be put before `txq_busy` is released)
+    if (self->txq_tail == self->txq_head ||
+        !__sync_bool_compare_and_swap(&self->txq_busy, 0, 1))
+      return;
+  }
+}
+//----------------------------------------------------------------------------
+// start TX of queued frames if queue is idle (transmitter is free)
+static void sx127x_txq_start(sx127x_t *self)
+{
+  if (self->txq_tail != self->txq_head &&
+      __sync_bool_compare_and_swap(&self->txq_busy, 0, 1))
+  {
+    sx127x_cb_lock(self, false);
+    sx127x_txq_run(self);
+    sx127x_cb_unlock(self);
+  }
+}
+//----------------------------------------------------------------------------
+// frame of TX queue is sent: defer callback and start next frame
+static void sx127x_txq_done(sx127x_t *self, i16_t status)
+{
+  sx127x_frame_t *frame = &self->txq[self->txq_tail % SX127X_TXQ_SIZE];
+
+  if (status == SX127X_ERR_NONE)
+  { // account time on air of sent frame
+    self->air_stat.tx_packets++;
+    self->air_stat.tx_us += self->tx_air_us;
+  }
+  
+  sx127x_cb_put(self, SX127X_CB_SENT, status == SX127X_ERR_NONE, status,
+                (int) frame->airtime_ms, frame->context);
+
+  __sync_synchronize();
+  self->txq_tail++; // free slot
+  sx127x_txq_run(self);
+}
+//----------------------------------------------------------------------------
+// put packet to asynchronous TX queue and return immediately (LoRa/FSK/OOK);
+// queue is drained back-to-back on TX done IRQ, then go to RX mode
+// (return SX127X_ERR_FULL if queue is full)
+i16_t sx127x_send_async(sx127x_t *self, const u8_t *data, i16_t size,
+                        bool fixed, void *frame)
+{
+  sx127x_frame_t *f;
+
+  // check size
+  if (size <= 0) return SX127X_ERR_BAD_SIZE;
+  size = SX127X_MIN(size, MAX_PKT_LENGTH);
+
+  // check free slot
+  if (self->txq_head - self->txq_tail >= SX127X_TXQ_SIZE)
+    return SX127X_ERR_FULL;
+
+  // fill slot
+  f = &self->txq[self->txq_head % SX127X_TXQ_SIZE];
+  memcpy((void*) f->data, (const void*) data, size);
+  f->size       = size;
+  f->fixed      = fixed;
+  f->airtime_ms = sx127x_airtime_ms(self, size); // updated on TX start
+  f->context    = frame;
+
+  // publish slot
+  __sync_synchronize();
+  self->txq_head++;
+
+  // start TX if queue is idle (else next frame is started on TX done IRQ)
+  sx127x_txq_start(self);
+
+  return SX127X_ERR_NONE;
+}
+//----------------------------------------------------------------------------
+// return number of frames in asynchronous TX queue (0 - queue is empty)
+int sx127x_txq_count(sx127x_t *self)
+{
+  return (int) (self->txq_head - self->txq_tail);
+}
+//----------------------------------------------------------------------------
+// check TX done flag if IRQ on DIO0 is lost (call it periodically)
+void sx127x_txq_poll(sx127x_t *self)
+{
+  if (self->txq_busy == 1)
+    sx127x_irq_handler(self); // TX done flag is checked in IRQ handler
+}
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_LBT
+// set OS hook of one-shot timer for LBT backoff (timer calls sx127x_lbt_wake())
+void sx127x_lbt_hooks(
+  sx127x_t *self,
+  void (*lbt_timer)(        // start one-shot OS timer hook or NULL
+    sx127x_t *self,           // pointer to sx127x_t object
+    u32_t delay_us,           // delay [us]
+    void *context),           // optional context
+  void *lbt_context)        // optional lbt_timer() context
+{
+  self->lbt_timer   = lbt_timer;
+  self->lbt_context = lbt_context;
+}
+//----------------------------------------------------------------------------
+// on/off listen before talk in asynchronous TX queue: each frame is sent
+// after CAD (LoRa) or RSSI <= `rssi` [dBm] (FSK/OOK) finds channel clear,
+// else random backoff of 1...2**BE slots is waited in RX mode and BE grows
+// (`slot_us` = 0 - 2 symbols in LoRa or SX127X_LBT_SENSE_US in FSK/OOK;
+//  return slot [us], 0 - off or lbt_timer() hook is not set)
+u32_t sx127x_lbt(sx127x_t *self, bool on, u32_t slot_us, i16_t rssi)
+{
+  SX127X_LOCK(self);
+  self->lbt_on = false;
+
+  if (on && self->lbt_timer != (void (*)(sx127x_t*, u32_t, void*)) NULL)
+  {
+    if (slot_us == 0)
+      slot_us = self->mode == SX127X_LORA ? 2 * sx127x_symbol_us(self) :
+                                            SX127X_LBT_SENSE_US;
+    self->lbt_slot_us = SX127X_MAX(slot_us, 1);
+    self->lbt_rssi    = rssi;
+    self->lbt_seed    = (self->freq ^ (u32_t) self->irq_time) | 1;
+    memset((void*) &self->lbt_stat, 0, sizeof(self->lbt_stat));
+    self->lbt_on = true;
+  }
+
+  SX127X_DBG("listen before talk: slot=%lu us, RSSI threshold=%d dBm",
+             self->lbt_on ? (unsigned long) self->lbt_slot_us : 0UL,
+             (int) rssi);
+  SX127X_UNLOCK(self);
+  return self->lbt_on ? self->lbt_slot_us : 0;
+}
+//----------------------------------------------------------------------------
+// get busy statistics of current channel (NULL if table is full)
+static sx127x_lbt_ch_t *sx127x_lbt_ch(sx127x_t *self)
+{
+  int i;
+  for (i = 0; i < SX127X_LBT_CH_MAX; i++)
+  {
+    sx127x_lbt_ch_t *ch = &self->lbt_stat.ch[i];
+    if (ch->freq == self->freq) return ch;
+    if (ch->freq == 0)
+    { // new channel
+      ch->freq = self->freq;
+      return ch;
+    }
+  }
+  return (sx127x_lbt_ch_t*) NULL;
+}
+//----------------------------------------------------------------------------
+// channel check is done: start TX, wait random backoff or drop frame
+static void sx127x_lbt_done(sx127x_t *self, bool busy)
+{
+  sx127x_lbt_ch_t *ch = sx127x_lbt_ch(self);
+  u32_t slots, x;
+
+  if (ch != (sx127x_lbt_ch_t*) NULL)
+  {
+    ch->checks++;
+    if (busy) ch->busy++;
+  }
+
+  if (!busy)
+  { // channel is clear
+    self->lbt_stat.sent[self->lbt_tries]++;
+    self->lbt_state = SX127X_LBT_IDLE;
+    sx127x_txq_tx(self);
+    return;
+  }
+
+  if (self->lbt_tries >= SX127X_LBT_TRIES)
+  { // channel is busy too long: drop frame
+    self->lbt_stat.drops++;
+    self->lbt_state = SX127X_LBT_IDLE;
+    sx127x_txq_done(self, SX127X_ERR_BUSY);
+    return;
+  }
+
+  // random backoff 1...2**BE slots (xorshift32, `u32_t` may be 64 bits)
+  x = self->lbt_seed;
+  x ^= (x << 13) & 0xFFFFFFFF;
+  x ^= x >> 17;
+  x ^= (x << 5) & 0xFFFFFFFF;
+  self->lbt_seed = x;
+  slots = 1 + x % (1UL << self->lbt_be);
+
+  self->lbt_stat.be[self->lbt_be]++;
+  self->lbt_stat.backoff_us += (u64_t) slots * self->lbt_slot_us;
+  self->lbt_tries++;
+  if (self->lbt_be < SX127X_LBT_BE_MAX) self->lbt_be++;
+
+  // receive while backoff (channel is busy by other station)
+  self->lbt_state = SX127X_LBT_BACKOFF;
+  sx127x_rx(self);
+  self->lbt_timer(self, slots * self->lbt_slot_us, self->lbt_context);
+}
+//----------------------------------------------------------------------------
+// LBT timer expired: check channel again (call it by lbt_timer() OS timer)
+void sx127x_lbt_wake(sx127x_t *self)
+{
+  int busy = -1;
+
+  sx127x_cb_lock(self, true);
+  if (self->lbt_state == SX127X_LBT_BACKOFF)
+    busy = sx127x_lbt_sense(self); // check channel again
+  else if (self->lbt_state == SX127X_LBT_SENSE &&
+           self->mode != SX127X_LORA) // RSSI is sampled
+    busy = sx127x_get_rssi(self) > self->lbt_rssi ? 1 : 0;
+
+  if (busy >= 0)
+    sx127x_lbt_done(self, busy != 0);
+  sx127x_cb_unlock(self);
+}
+//----------------------------------------------------------------------------
+// get listen before talk statistics (reset it if `reset` is true)
+void sx127x_lbt_stat(sx127x_t *self, sx127x_lbt_stat_t *stat, bool reset)
+{
+  SX127X_LOCK(self);
+  *stat = self->lbt_stat;
+  if (reset)
+    memset((void*) &self->lbt_stat, 0, sizeof(self->lbt_stat));
+  SX127X_UNLOCK(self);
+}
+#endif // SX127X_USE_LBT
+#endif // SX127X_USE_QUEUE
+//----------------------------------------------------------------------------
+// go to RX mode; wait callback by interrupt (LoRa/FSK/OOK)
+// LoRa:    if pkt_len = 0 then explicit header mode, else - implicit
+// FSK/OOK: if pkt_len = 0 then variable packet length, else - fixed
+void sx127x_receive(sx127x_t *self, i16_t pkt_len)
+{
+  SX127X_LOCK(self);
+  pkt_len = SX127X_MIN(pkt_len, MAX_PKT_LENGTH);
+
+  if (self->mode == SX127X_LORA) // LoRa mode
+  {
+#ifdef SX127X_USE_LORA
+    if (pkt_len > 0)
+    { // implicit header mode
+      if (!self->impl_hdr) sx127x_impl_hdr(self, true);
+      sx127x_write_reg(self, REG_PAYLOAD_LENGTH, (u8_t) pkt_len);
+    }
+    else
+    { // explicit header mode
+      if (self->impl_hdr) sx127x_impl_hdr(self, false);
+    }
+#ifdef SX127X_USE_FHSS
+    sx127x_fhss_reset(self); // wait packet at channel 0 of hop table
+#endif
+#endif
+  }
+  else // FSK/OOK mode
+  {
+#ifdef SX127X_USE_FSKOOK
+    if (pkt_len > 0)
+    { // fixed packet length
+      if (!self->fixed) sx127x_set_fixed(self, true);
+      sx127x_write_reg(self, REG_PAYLOAD_LEN, (u8_t) pkt_len);
+    }
+    else
+    { // variable packet length
+      if (self->fixed) sx127x_set_fixed(self, false);
+      sx127x_write_reg(self, REG_PAYLOAD_LEN, MAX_PKT_LENGTH);
+    }
+#endif
+  }
+
+  sx127x_rx(self);
+  SX127X_UNLOCK(self);
+}
+//----------------------------------------------------------------------------
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_DUTY)
+// close RX window of duty-cycled receive at time `ns` (add radio on time)
+static void sx127x_rx_duty_end(sx127x_t *self, u64_t ns)
+{
+  self->duty_rx = false;
+  if (ns > self->duty_start)
+    self->duty_stat.on_ns += ns - self->duty_start;
+}
+//----------------------------------------------------------------------------
+// on/off duty-cycled receive (LoRa, after sx127x_receive()): sleep and open
+// RX single window of `window` symbols (0 - SX127X_DUTY_WINDOW) each period;
+// period is sized by preamble length, SF and BW so that preamble of packet
+// covers one RX window at least (TX side must use same long preamble)
+// (return period [us] for OS timer, 0 - off or preamble is too short)
+u32_t sx127x_rx_duty(sx127x_t *self, bool on, u16_t window)
+{
+  u32_t tsym = sx127x_symbol_us(self), period = 0, window_us = 0;
+
+  SX127X_LOCK(self);
+  self->duty_on = false;
+  self->duty_rx = false;
+  self->duty_window_us = 0;
+
+  if (on && self->mode == SX127X_LORA && tsym != 0)
+  {
+    // preamble and sync word (Npreamble + 4.25 symbols) cover RX window
+    // started at any time of period: T <= (Npreamble + 4.25 - Nwindow) * Tsym
+    i32_t qsym;
+    if (window == 0) window = SX127X_DUTY_WINDOW;
+    window = SX127X_LIMIT(window, 4, 1023);
+    qsym = 4 * (i32_t) self->preamble + 17 - 4 * (i32_t) window;
+    if (qsym > 0)
+      period = (u32_t) (((u64_t) qsym * tsym) / 4);
+    period = period > SX127X_DUTY_GUARD_US ? period - SX127X_DUTY_GUARD_US : 0;
+    window_us = (u32_t) window * tsym;
+
+    if (period > window_us)
+    { // duty cycle < 100%: sleep until first wake-up
+      sx127x_set_symb_timeout(self, window);
+      self->duty_window_us = window_us;
+      self->duty_period_us = period;
+      self->duty_first     = 0;
+      memset((void*) &self->duty_stat, 0, sizeof(self->duty_stat));
+      self->duty_on = true;
+      sx127x_sleep(self);
+    }
+    else
+    { // preamble is too short (use continuous RX mode)
+      period    = 0;
+      window_us = 0;
+    }
+  }
+
+  if (!self->duty_on)
+    sx127x_standby(self);
+
+  SX127X_DBG("duty-cycled receive: period=%lu us, window=%lu us",
+             (unsigned long) period, (unsigned long) window_us);
+  SX127X_UNLOCK(self);
+  return period;
+}
+//----------------------------------------------------------------------------
+// open RX window of duty-cycled receive (call it by OS timer each period;
+// `ns` - current time [ns] by same clock as sx127x_irq_time())
+void sx127x_rx_duty_wake(sx127x_t *self, u64_t ns)
+{
+  SX127X_LOCK(self);
+  if (!self->duty_on)
+  {
+    SX127X_UNLOCK(self);
+    return;
+  }
+
+  if (self->duty_first == 0) self->duty_first = ns;
+  self->duty_stat.run_ns = ns - self->duty_first;
+
+  if (self->duty_rx)
+  { // RX window is still open: packet is received or `RxTimeout` is lost
+    u8_t irq_flags = sx127x_read_reg(self, REG_IRQ_FLAGS);
+    if (irq_flags & IRQ_RX_TIMEOUT)
+    { // `RxTimeout` IRQ is lost: close window at its end
+      sx127x_write_reg(self, REG_IRQ_FLAGS, IRQ_RX_TIMEOUT);
+      sx127x_rx_duty_end(self, self->duty_start +
+                               (u64_t) self->duty_window_us * 1000);
+    }
+    else if (ns - self->duty_start < ((u64_t) self->duty_window_us +
+             sx127x_airtime_us(self, MAX_PKT_LENGTH)) * 1000)
+    { // preamble is detected, RX single waits `RxDone`
+      self->duty_stat.skips++;
+      SX127X_UNLOCK(self);
+      return;
+    }
+    else
+    { // longest packet is over: `RxDone` IRQ is lost or RX is stuck
+      sx127x_standby(self);
+      sx127x_rx_duty_end(self, ns);
+    }
+    self->duty_stat.timeouts++;
+  }
+
+  // open RX window (standby automatically by `RxTimeout` or `RxDone`)
+  self->duty_rx    = true;
+  self->duty_start = ns;
+  self->duty_stat.windows++;
+  sx127x_rx_single(self);
+  SX127X_UNLOCK(self);
+}
+//----------------------------------------------------------------------------
+// get duty-cycled receive statistics (measured radio on time)
+void sx127x_rx_duty_stat(const sx127x_t *self, sx127x_duty_stat_t *stat)
+{
+  *stat = self->duty_stat;
+}
+#endif // SX127X_USE_LORA && SX127X_USE_DUTY
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_LORA
+// clear IRQ flags, set FIFO pointer and read received packet to payload
+// buffer by one vectored SPI exchange (LoRa)
+static void sx127x_lora_read_fifo(sx127x_t *self,
+                                  u8_t irq_flags, u8_t fifo_addr, int size)
+{
+  u8_t tx_buf[4 + SX127X_MAX_PACKET + 2], rx_buf[4 + SX127X_MAX_PACKET + 2];
+  sx127x_seg_t seg[4];
+  int n = 2, pos = 4, i;
+
+  // clear IRQ's
+  tx_buf[0] = REG_IRQ_FLAGS | 0x80;
+  tx_buf[1] = irq_flags;
+  seg[0].tx_buf = tx_buf;
+  seg[0].rx_buf = rx_buf;
+  seg[0].len    = 2;
+
+  // set FIFO address to current RX address
+  tx_buf[2] = REG_FIFO_ADDR_PTR | 0x80;
+  tx_buf[3] = fifo_addr;
+  seg[1].tx_buf = tx_buf + 2;
+  seg[1].rx_buf = rx_buf + 2;
+  seg[1].len    = 2;
+
+  // read data from FIFO (one segment per SX127X_BURST_MAX bytes)
+  memset((void*) (tx_buf + pos), 0, sizeof(tx_buf) - pos);
+  for (i = 0; i < size; i += SX127X_BURST_MAX)
+  {
+    int len = SX127X_MIN(size - i, SX127X_BURST_MAX);
+    tx_buf[pos]   = REG_FIFO;
+    seg[n].tx_buf = tx_buf + pos;
+    seg[n].rx_buf = rx_buf + pos;
+    seg[n].len    = (u8_t) (len + 1);
+    pos += len + 1;
+    n++;
+  }
+
+  sx127x_exchange_v(self, seg, n);
+
+  for (i = 2; i < n; i++)
+    memcpy((void*) (self->payload + (i - 2) * SX127X_BURST_MAX),
+           (const void*) (seg[i].rx_buf + 1), seg[i].len - 1);
+}
+#endif
+//----------------------------------------------------------------------------
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_STREAM)
+// set callback on receive long packet (FSK/OOK)
+void sx127x_on_receive_long(
+  sx127x_t *self,
+  void (*on_receive_long)(          // receive long packet callback or NULL
+    sx127x_t *self,                   // pointer to sx127x_t object
+    u8_t *data,                       // user buffer
+    int size,                         // packet size
+    bool crc,                         // CRC ok/false
+    void *context),                   // optional context
+  void *on_receive_long_context)    // optional on_receive_long() context
+{
+  self->on_receive_long         = on_receive_long;
+  self->on_receive_long_context = on_receive_long_context;
+}
+//----------------------------------------------------------------------------
+// set DIO1 mapping: DIO1_FIFO_LEVEL, DIO1_FIFO_EMPTY or DIO1_FIFO_FULL
+static void sx127x_dio1_map(sx127x_t *self, u8_t map)
+{
+  sx127x_dio_bits(self, REG_DIO_MAPPING_1, DIO1_MASK, map);
+}
+//----------------------------------------------------------------------------
+// setup packet length and FIFO threshold before streaming (FSK/OOK)
+static void sx127x_stream_begin(sx127x_t *self, int size, bool unlimited)
+{
+  u8_t reg;
+
+  sx127x_standby(self);
+
+  // fixed packet length (`PacketFormat`=0), length=0 -> unlimited mode
+  if (self->fixed != true)
+    sx127x_set_fixed(self, true);
+  if (unlimited) size = 0;
+  reg = sx127x_read_reg(self, REG_PACKET_CONFIG_2) & ~0x07;
+  sx127x_write_reg(self, REG_PACKET_CONFIG_2, reg | ((size >> 8) & 0x07));
+  sx127x_write_reg(self, REG_PAYLOAD_LEN, (u8_t) size);
+
+  // `FifoLevel` IRQ on DIO1
+  sx127x_write_reg(self, REG_FIFO_THRESH,
+                   TX_START_FIFO_NOEMPTY | SX127X_FIFO_THRESH);
+  sx127x_dio1_map(self, DIO1_FIFO_LEVEL);
+
+  // clear FIFO
+  sx127x_write_reg(self, REG_IRQ_FLAGS_2, IRQ2_FIFO_OVERRUN);
+
+  self->stream_pos       = 0;
+  self->stream_unlimited = unlimited;
+}
+//----------------------------------------------------------------------------
+// restore packet length and FIFO threshold after streaming (FSK/OOK)
+static void sx127x_stream_end(sx127x_t *self)
+{
+  u8_t reg = sx127x_read_reg(self, REG_PACKET_CONFIG_2);
+  sx127x_write_reg(self, REG_PACKET_CONFIG_2, reg & ~0x07);
+  sx127x_write_reg(self, REG_FIFO_THRESH,
+                   TX_START_FIFO_NOEMPTY | FIFO_THRESH_DEFAULT);
+  sx127x_dio1_map(self, DIO1_FIFO_LEVEL);
+  self->stream = SX127X_STREAM_OFF;
+}
+//----------------------------------------------------------------------------
+// refill FIFO on TX (FIFO level <= `FifoThreshold`) (FSK/OOK)
+static void sx127x_stream_fill(sx127x_t *self, int room)
+{
+  int n = SX127X_MIN(self->stream_size - self->stream_pos, room);
+
+  if (n > 0)
+  {
+    sx127x_write_burst(self, REG_FIFO, self->stream_tx + self->stream_pos, n);
+    self->stream_pos += n;
+    room -= n;
+  }
+
+  if (self->stream_pos >= self->stream_size)
+  { // all data in FIFO
+    if (self->stream_unlimited)
+    { // pad byte: `FifoEmpty` is set when last data byte is shifted out
+      if (room <= 0) return; // no room for pad byte, wait next IRQ
+      sx127x_write_reg(self, REG_FIFO, 0x55);
+      sx127x_dio1_map(self, DIO1_FIFO_EMPTY);
     }
-    
-    // set TX start FIFO condition
-    //sx127x_write_reg(self, REG_FIFO_THRESH, TX_START_FIFO_LEVEL | (size + add));
-    
-    // write data to FIFO
-    for (i = 0; i < size; i++)
-      sx127x_write_reg(self, REG_FIFO, data[i]);
-    
-    // start TX packet
-    sx127x_tx(self);
-   
-    // wait `TxRaedy` (bit 5 in `RegIrqFlags1`)
-    //while ((sx127x_read_reg(self, REG_IRQ_FLAGS_1) & IRQ1_TX_READY) == 0)
-    //{
-    //  // FIXME: check timeout, save energy
-    //}
+    self->stream = SX127X_STREAM_TX_LAST;
+  }
+}
+//----------------------------------------------------------------------------
+// finish receive long packet: defer callback, go to standby (FSK/OOK)
+static void sx127x_stream_rx_done(sx127x_t *self, bool crc)
+{
+  sx127x_standby(self);
+  sx127x_stream_end(self);
 
-    // wait `PacketSent` (bit 3 in `RegIrqFlags2`)
-    cnt = 1000000000; // FIXME: callibrate timeout
-    while ((sx127x_read_reg(self, REG_IRQ_FLAGS_2) & IRQ2_PACKET_SENT) == 0)
+  self->air_stat.rx_packets++;
+  self->air_stat.rx_us += sx127x_airtime_us(self, self->stream_size);
+
+  sx127x_cb_put(self, SX127X_CB_RECEIVE_LONG, crc, 0, self->stream_size,
+                (void*) self->stream_rx);
+}
+//----------------------------------------------------------------------------
+// send long packet by FIFO streaming and wait TX done (FSK/OOK)
+static i16_t sx127x_send_long_wait(sx127x_t *self, const u8_t *data, int size,
+                                   bool unlimited)
+{
+  bool irq = self->tx_wait != (int (*)(sx127x_t*, u32_t, void*)) NULL;
+  u32_t timeout_ms;
+  u64_t poll;
+  bool ok = true;
+
+  SX127X_LOCK(self);
+  sx127x_stream_begin(self, size, unlimited);
+
+  // fill all FIFO before start TX
+  self->stream_tx   = data;
+  self->stream_size = size;
+  self->stream      = SX127X_STREAM_TX;
+  sx127x_stream_fill(self, FIFO_SIZE);
+
+  self->tx_air_us = sx127x_airtime_us(self, size);
+  timeout_ms = sx127x_airtime_ms(self, size);
+  timeout_ms += timeout_ms / 2 + SX127X_TX_MARGIN;
+  poll = sx127x_poll_start(self, timeout_ms); // timeout of busy waiting
+
+  // start TX packet
+  self->tx_irq = irq;
+  sx127x_tx(self);
+  SX127X_UNLOCK(self); // DIO1 handler refills FIFO while waiting TX done
+
+  if (irq)
+  { // sleep until `PacketSent` on DIO0 or `FifoEmpty` on DIO1
+    if (self->tx_wait(self, timeout_ms, self->tx_context) < 0)
+      return sx127x_tx_timeout(self, timeout_ms); // also ends streaming
+    return SX127X_ERR_NONE;
+  }
+
+  // busy polling
+  while (self->stream != SX127X_STREAM_OFF)
+  {
+    sx127x_dio1_handler(self);
+
+    if (self->stream == SX127X_STREAM_TX_LAST && !unlimited &&
+        (sx127x_read_reg(self, REG_IRQ_FLAGS_2) & IRQ2_PACKET_SENT))
+      break; // `PacketSent`
+
+    if (sx127x_poll_timeout(self, &poll))
     {
-      // FIXME: check timeout, save energy
-#if 0
-      SX127X_DBG("#2 RegIrqFlags1=0x%02X",
-                 sx127x_read_reg(self, REG_IRQ_FLAGS_1));
-      SX127X_DBG("#2 RegIrqFlags2=0x%02X",
-                 sx127x_read_reg(self, REG_IRQ_FLAGS_2));
-#endif
-      if (--cnt == 0)
-      {
-        SX127X_DBG("stop waiting `PacketSent` by timeout");
-        break; // exit by timeout
-      }
+      SX127X_DBG("stop streaming TX by timeout");
+      ok = false;
+      break; // exit by timeout
     }
-    
-    // switch to standby mode
-    sx127x_standby(self);
-    sx127x_standby(self); // FIXME: why second?
-#endif
   }
 
+  sx127x_cb_lock(self, false);
+  sx127x_standby(self);
+  sx127x_stream_end(self);
+  sx127x_tx_done(self, ok);
+  sx127x_cb_unlock(self);
+
+  return ok ? SX127X_ERR_NONE : SX127X_ERR_TIMEOUT;
+}
+//----------------------------------------------------------------------------
+// send long packet by FIFO streaming and wait TX done (FSK/OOK)
+// (size <= SX127X_STREAM_MAX in fixed length mode, any in unlimited mode;
+//  FIFO is refilled by `FifoLevel` IRQ on DIO1, look sx127x_dio1_handler())
+// (return SX127X_ERR_BUSY if asynchronous TX queue is draining)
+i16_t sx127x_send_long(sx127x_t *self, const u8_t *data, int size,
+                       bool unlimited)
+{
+  i16_t retv;
+
+  if (self->mode == SX127X_LORA) return SX127X_ERR_BAD_SIZE; // FSK/OOK only
+
+  // check size
+  if (size <= 0 || (!unlimited && size > SX127X_STREAM_MAX))
+    return SX127X_ERR_BAD_SIZE;
+
+  // don't reload FIFO in the middle of frame of TX queue
+  if (!sx127x_tx_take(self)) return SX127X_ERR_BUSY;
+
+  retv = sx127x_send_long_wait(self, data, size, unlimited);
+  sx127x_tx_release(self);
+  return retv;
+}
+//----------------------------------------------------------------------------
+// go to RX mode and receive long packet to user buffer by FIFO streaming;
+// wait on_receive_long() callback, then radio is in standby mode (FSK/OOK)
+// (size <= SX127X_STREAM_MAX in fixed length mode, any in unlimited mode)
+i16_t sx127x_receive_long(sx127x_t *self, u8_t *buf, int size,
+                          bool unlimited)
+{
+  if (self->mode == SX127X_LORA) return SX127X_ERR_BAD_SIZE; // FSK/OOK only
+
+  // check size
+  if (size <= 0 || (!unlimited && size > SX127X_STREAM_MAX))
+    return SX127X_ERR_BAD_SIZE;
+
+  SX127X_LOCK(self);
+  sx127x_stream_begin(self, size, unlimited);
+
+  // short tail of unlimited packet is signalled by lower threshold
+  if (unlimited && size <= SX127X_FIFO_THRESH)
+    sx127x_write_reg(self, REG_FIFO_THRESH,
+                     TX_START_FIFO_NOEMPTY | (u8_t) (size - 1));
+
+  self->stream_rx   = buf;
+  self->stream_size = size;
+  self->stream      = SX127X_STREAM_RX;
+  sx127x_rx(self);
+  SX127X_UNLOCK(self);
+
   return SX127X_ERR_NONE;
 }
 //----------------------------------------------------------------------------
-// go to RX mode; wait callback by interrupt (LoRa/FSK/OOK)
-// LoRa:    if pkt_len = 0 then explicit header mode, else - implicit
-// FSK/OOK: if pkt_len = 0 then variable packet length, else - fixed
-void sx127x_receive(sx127x_t *self, i16_t pkt_len)
+// IRQ handler on DIO1 pin (`FifoLevel` or `FifoEmpty` in streaming mode)
+void sx127x_dio1_handler(sx127x_t *self)
 {
-  pkt_len = SX127X_MIN(pkt_len, MAX_PKT_LENGTH);
+  u8_t irq_flags2;
 
-  if (self->mode == SX127X_LORA) // LoRa mode
-  {
-#ifdef SX127X_USE_LORA
-    if (pkt_len > 0)
-    { // implicit header mode
-      if (!self->impl_hdr) sx127x_impl_hdr(self, true);
-      sx127x_write_reg(self, REG_PAYLOAD_LENGTH, (u8_t) pkt_len);
-    }
-    else
-    { // explicit header mode
-      if (self->impl_hdr) sx127x_impl_hdr(self, false);
+  if (self->stream == SX127X_STREAM_OFF) return;
+
+  sx127x_cb_lock(self, true);
+  irq_flags2 = sx127x_read_reg(self, REG_IRQ_FLAGS_2);
+
+  if (self->stream == SX127X_STREAM_TX)
+  { // refill FIFO if level <= `FifoThreshold`
+    if ((irq_flags2 & IRQ2_FIFO_LEVEL) == 0)
+      sx127x_stream_fill(self, FIFO_SIZE - SX127X_FIFO_THRESH);
+  }
+  else if (self->stream == SX127X_STREAM_TX_LAST)
+  { // unlimited mode: pad byte is shifted out, stop TX
+    if (self->stream_unlimited && (irq_flags2 & IRQ2_FIFO_EMPTY))
+    {
+      sx127x_standby(self);
+      sx127x_stream_end(self);
+      if (self->tx_irq) sx127x_tx_done(self, true);
     }
-#endif
   }
-  else // FSK/OOK mode
-  {
-#ifdef SX127X_USE_FSKOOK
-    if (pkt_len > 0)
-    { // fixed packet length
-      if (!self->fixed) sx127x_set_fixed(self, true);
-      sx127x_write_reg(self, REG_PAYLOAD_LEN, (u8_t) pkt_len);
+  else if (self->stream == SX127X_STREAM_RX)
+  { // drain FIFO while level > `FifoThreshold`
+    int thresh = sx127x_read_reg(self, REG_FIFO_THRESH) & FIFO_THRESH_MASK;
+    int n, rest = self->stream_size - self->stream_pos;
+
+    while ((irq_flags2 & IRQ2_FIFO_LEVEL) && rest > 0)
+    {
+      n = SX127X_MIN(thresh + 1, rest);
+      sx127x_read_burst(self, REG_FIFO, self->stream_rx + self->stream_pos, n);
+      self->stream_pos += n;
+      rest -= n;
+      irq_flags2 = sx127x_read_reg(self, REG_IRQ_FLAGS_2);
     }
-    else
-    { // variable packet length
-      if (self->fixed) sx127x_set_fixed(self, false);
-      sx127x_write_reg(self, REG_PAYLOAD_LEN, MAX_PKT_LENGTH);
+
+    if (self->stream_unlimited)
+    {
+      if (rest == 0)
+        sx127x_stream_rx_done(self, true); // no CRC in unlimited mode
+      else if (rest <= thresh)
+        sx127x_write_reg(self, REG_FIFO_THRESH, // IRQ on last bytes
+                         TX_START_FIFO_NOEMPTY | (u8_t) (rest - 1));
     }
+    // else: tail of fixed length packet is read on `PayloadReady` (DIO0)
+  }
+
+  sx127x_cb_unlock(self);
+}
+#endif // SX127X_USE_FSKOOK && SX127X_USE_STREAM
+//----------------------------------------------------------------------------
+// return true if TX done IRQ is expected (LoRa/FSK/OOK)
+static bool sx127x_tx_pending(sx127x_t *self)
+{
+#ifdef SX127X_USE_QUEUE
+  if (self->txq_busy == 1) return true; // else sx127x_send() may own TX
 #endif
+  return self->tx_irq;
+}
+//----------------------------------------------------------------------------
+// TX done IRQ: wake up sender or start next frame of TX queue
+static void sx127x_tx_irq(sx127x_t *self)
+{
+  if (self->tx_irq)
+  {
+    sx127x_tx_done(self, true);
+    return;
   }
+#ifdef SX127X_USE_QUEUE
+  sx127x_txq_done(self, SX127X_ERR_NONE);
+#endif
+}
+//----------------------------------------------------------------------------
+// return true if receive callback with metadata or RX ring is set
+static bool sx127x_meta_on(const sx127x_t *self)
+{
+#ifdef SX127X_USE_RXQ
+  if (self->rxq_on) return true;
+#endif
+  return self->on_receive_ex != (void (*)(sx127x_t*, u8_t*, u8_t, bool,
+                                          const sx127x_rx_meta_t*, void*)) NULL;
+}
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_LORA
+// fill packet metadata by registers 0x10...0x2A read by one burst (LoRa)
+static void sx127x_lora_meta(sx127x_t *self, const u8_t *regs)
+{
+  sx127x_rx_meta_t *meta = &self->rx_meta;
+#define SX127X_META_REG(address) regs[(address) - REG_FIFO_RX_CURRENT_ADDR]
+  u8_t cfg1 = SX127X_META_REG(REG_MODEM_CONFIG_1);
+  u8_t ix   = cfg1 >> 4, cr = SX127X_META_REG(REG_MODEM_STAT) >> 5;
+  i32_t fei = (((i32_t) SX127X_META_REG(REG_LR_FEI_MSB) & 0x0F) << 16) |
+              (((i32_t) SX127X_META_REG(REG_LR_FEI_MID)) << 8) |
+                (i32_t) SX127X_META_REG(REG_LR_FEI_LSB);
+  i16_t snr = (i16_t) SX127X_META_REG(REG_PKT_SNR_VALUE);
 
-  sx127x_rx(self);
+  meta->bw       = ix < sizeof(sx127x_bw_tbl) / sizeof(u32_t) ?
+                   sx127x_bw_tbl[ix] : self->bw;
+  meta->sf       = SX127X_META_REG(REG_MODEM_CONFIG_2) >> 4;
+  meta->impl_hdr = cfg1 & 0x01;
+  meta->ldro     = !!(SX127X_META_REG(REG_MODEM_CONFIG_3) & 0x08);
+  meta->crc_on   = !!(SX127X_META_REG(REG_HOP_CHANNEL) & 0x40);
+
+  // `RxCodingRate` of last header (explicit mode) or `CodingRate`
+  if (meta->impl_hdr || cr == 0)
+    cr = (cfg1 >> 1) & 0x07;
+  meta->cr = cr + 4; // 1...4 -> 5...8
+
+  // SNR [dB]
+  if (snr & 0x80) // sign bit is 1
+    snr -= 256;
+  meta->snr = snr >> 2;
+
+  // packet RSSI [dBm]
+  meta->rssi = ((i16_t) SX127X_META_REG(REG_PKT_RSSI_VALUE)) -
+               (self->freq < 600000000 ? 164 : 157); // F_LF<=525, F_HF>=779 MHz
+
+  // FEI [Hz] = FeiValue * 2**24 / Fxosc * BW / 500 kHz (20 bit signed)
+  if (fei & 0x80000)
+    fei -= 0x100000;
+  meta->fei = (i32_t) (((long long) fei * 8192 * (long long) meta->bw) /
+                       (15625LL * 500000LL)); // 2**24 / 32 MHz = 8192 / 15625
+#undef SX127X_META_REG
 }
+#endif // SX127X_USE_LORA
 //----------------------------------------------------------------------------
-// IRQ handler on DIO0 pin
-void sx127x_irq_handler(sx127x_t *self)
+#ifdef SX127X_USE_FSKOOK
+// fill packet metadata by registers 0x11...0x1E read by one burst (FSK/OOK)
+static void sx127x_fsk_meta(sx127x_t *self, const u8_t *regs, bool fixed)
+{
+  sx127x_rx_meta_t *meta = &self->rx_meta;
+  i16_t fei = (i16_t) ((((u16_t) regs[REG_FEI_MSB - REG_RSSI_VALUE]) << 8) |
+                                 regs[REG_FEI_LSB - REG_RSSI_VALUE]);
+
+  meta->rssi    = (- (i16_t) regs[0]) >> 1;
+  meta->snr     = 0;
+  meta->fei     = (i32_t) (((long long) fei * 15625) / 256); // * FREQ_STEP
+  meta->bitrate = self->bitrate;
+  meta->fixed   = fixed;
+}
+#endif // SX127X_USE_FSKOOK
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_RXQ
+// put received frame with metadata to RX ring (producer, no locks)
+static void sx127x_rxq_put(sx127x_t *self, u8_t size, bool crc)
+{
+  sx127x_rx_frame_t *frame;
+
+  // check free slot
+  if (self->rxq_head - self->rxq_tail >= SX127X_RXQ_SIZE)
+  { // ring is full: drop frame
+    self->rxq_drops++;
+    return;
+  }
+
+  // fill slot
+  frame = &self->rxq[self->rxq_head % SX127X_RXQ_SIZE];
+  memcpy((void*) frame->data, (const void*) self->payload, size);
+  frame->size = size;
+  frame->crc  = crc;
+  frame->meta = self->rx_meta;
+
+  // publish slot
+  __sync_synchronize();
+  self->rxq_head++;
+  self->rxq_frames++;
+
+  sx127x_cb_put(self, SX127X_CB_RXQ, true, 0, 0, NULL);
+}
+#endif // SX127X_USE_RXQ
+//----------------------------------------------------------------------------
+// handle IRQ on DIO0 pin (SPI bus is locked by sx127x_irq_handler())
+static void sx127x_dio0_handler(sx127x_t *self)
 {
   bool crc_ok = true;
   i16_t payload_len = 0;
-  int i;
     
   // FIXME
   //SX127X_DBG("start sx127x_irq_handler()");
@@ -1235,11 +3997,34 @@ void sx127x_irq_handler(sx127x_t *self)
   if (self->mode == SX127X_LORA) // LoRa mode
   {
 #ifdef SX127X_USE_LORA
-    u8_t irq_flags = sx127x_read_reg(self, REG_IRQ_FLAGS); // should be 0x50
-    sx127x_write_reg(self, REG_IRQ_FLAGS, irq_flags);
+    // read `RegFifoRxCurrentAddr`, `RegIrqFlagsMask`, `RegIrqFlags`
+    // and `RegRxNbBytes` by one burst (with packet status, modem config
+    // and FEI registers up to `RegFeiLsb` if metadata is needed)
+    u8_t regs[REG_LR_FEI_LSB - REG_FIFO_RX_CURRENT_ADDR + 1], irq_flags;
+    bool meta = sx127x_meta_on(self);
+    sx127x_read_burst(self, REG_FIFO_RX_CURRENT_ADDR, regs,
+                      meta ? sizeof(regs) : 4);
+    irq_flags = regs[REG_IRQ_FLAGS - REG_FIFO_RX_CURRENT_ADDR]; // ~ 0x50
+
+    if ((irq_flags & IRQ_TX_DONE) && sx127x_tx_pending(self)) // `TxDone`
+    { // standby automatically on `TxDone`
+      sx127x_write_reg(self, REG_IRQ_FLAGS, irq_flags);
+      sx127x_tx_irq(self);
+      return;
+    }
+
+#if defined(SX127X_USE_QUEUE) && defined(SX127X_USE_LBT)
+    if ((irq_flags & IRQ_CAD_DONE) && self->lbt_state == SX127X_LBT_SENSE)
+    { // channel check before TX of frame (standby automatically)
+      sx127x_write_reg(self, REG_IRQ_FLAGS, irq_flags);
+      sx127x_lbt_done(self, (irq_flags & IRQ_CAD_DETECTED) != 0);
+      return;
+    }
+#endif
 
     if ((irq_flags & IRQ_RX_DONE) == 0) // check `RxDone`
     {
+      sx127x_write_reg(self, REG_IRQ_FLAGS, irq_flags);
 #if 0
       SX127X_DBG("IRQ on DIO0 (LoRa): RegIrqFlags=0x%02X",
                  irq_flags);
@@ -1254,20 +4039,61 @@ void sx127x_irq_handler(sx127x_t *self)
     // get `PayloadCrcError` bit
     crc_ok = !(irq_flags & IRQ_PAYLOAD_CRC_ERROR);
 
-    // set FIFO address to current RX address
-    sx127x_write_reg(self, REG_FIFO_ADDR_PTR,
-                     sx127x_read_reg(self, REG_FIFO_RX_CURRENT_ADDR));
+    // get payload length
+    payload_len = !self->impl_hdr ?
+                  regs[REG_RX_NB_BYTES - REG_FIFO_RX_CURRENT_ADDR] :
+                  meta ? regs[REG_PAYLOAD_LENGTH - REG_FIFO_RX_CURRENT_ADDR] :
+                  sx127x_read_reg(self, REG_PAYLOAD_LENGTH);
 
-    // read payload length
-    payload_len = self->impl_hdr ?
-                  sx127x_read_reg(self, REG_PAYLOAD_LENGTH) :
-                  sx127x_read_reg(self, REG_RX_NB_BYTES);
+    if (meta)
+      sx127x_lora_meta(self, regs);
+
+    // clear IRQ's, set FIFO address to current RX address and read
+    // data from FIFO by one vectored SPI exchange
+    sx127x_lora_read_fifo(self, irq_flags, regs[0], payload_len);
+
+#ifdef SX127X_USE_FHSS
+    sx127x_fhss_reset(self); // wait next packet at channel 0 of hop table
+#endif
+
+#ifdef SX127X_USE_DUTY
+    if (self->duty_rx)
+    { // close RX window (standby automatically by `RxDone`) and sleep
+      sx127x_rx_duty_end(self, self->irq_time);
+      self->duty_stat.packets++;
+      sx127x_sleep(self);
+    }
+#endif
 #endif
   }
   else // FSK/OOK mode
   {
 #ifdef SX127X_USE_FSKOOK
     u8_t irq_flags2 = sx127x_read_reg(self, REG_IRQ_FLAGS_2); // ~ 0x26/0x24
+    bool fixed;
+
+    if ((irq_flags2 & IRQ2_PACKET_SENT) && sx127x_tx_pending(self))
+    { // `PacketSent` is cleared on exit from TX mode
+      sx127x_standby(self);
+#ifdef SX127X_USE_STREAM
+      if (self->stream != SX127X_STREAM_OFF)
+        sx127x_stream_end(self);
+#endif
+      sx127x_tx_irq(self);
+      return;
+    }
+
+#ifdef SX127X_USE_STREAM
+    if ((irq_flags2 & IRQ2_PAYLOAD_READY) &&
+        self->stream == SX127X_STREAM_RX)
+    { // read tail of fixed length long packet
+      sx127x_read_burst(self, REG_FIFO, self->stream_rx + self->stream_pos,
+                        self->stream_size - self->stream_pos);
+      self->stream_pos = self->stream_size;
+      sx127x_stream_rx_done(self, !!(irq_flags2 & IRQ2_CRC_OK));
+      return;
+    }
+#endif
     
     if ((irq_flags2 & IRQ2_PAYLOAD_READY) == 0) // check `PayloadReady`
     {
@@ -1289,27 +4115,301 @@ void sx127x_irq_handler(sx127x_t *self)
     crc_ok = !!(irq_flags2 & IRQ2_CRC_OK);
 
     // read payload length
-    if (sx127x_read_reg(self, REG_PACKET_CONFIG_1) & 0x80) // `PacketFormat`
+    fixed = !(sx127x_read_reg(self, REG_PACKET_CONFIG_1) & 0x80);
+    if (!fixed) // `PacketFormat`
       payload_len = sx127x_read_reg(self, REG_FIFO); // variable length
     else
       payload_len = sx127x_read_reg(self, REG_PAYLOAD_LEN); // fixed length
+
+    if (sx127x_meta_on(self))
+    { // read `RegRssiValue`...`RegFeiLsb` by one burst
+      u8_t regs[REG_FEI_LSB - REG_RSSI_VALUE + 1];
+      sx127x_read_burst(self, REG_RSSI_VALUE, regs, sizeof(regs));
+      sx127x_fsk_meta(self, regs, fixed);
+    }
 #endif
   }
   
-  // read data from FIFO
-  for (i = 0; i < payload_len; i++)
-    self->payload[i] = sx127x_read_reg(self, REG_FIFO);
+#ifdef SX127X_USE_FSKOOK
+  // read data from FIFO by burst mode (FSK/OOK)
+  if (self->mode != SX127X_LORA)
+    sx127x_read_burst(self, REG_FIFO, self->payload, payload_len);
+#endif
+
+  if (sx127x_meta_on(self))
+  {
+    self->rx_meta.time_ns = self->irq_time;
+    self->rx_meta.freq    = self->freq;
+    self->rx_meta.mode    = self->mode;
+  }
+
+  // account time on air of received packet
+  self->air_stat.rx_packets++;
+  self->air_stat.rx_us += sx127x_airtime_us(self, payload_len);
+
+#ifdef SX127X_USE_RXQ
+  // put frame to RX ring (consumer is not called from IRQ thread)
+  if (self->rxq_on)
+  {
+    sx127x_rxq_put(self, (u8_t) payload_len, crc_ok);
+    return;
+  }
+#endif
+
+  // run callback after bus is unlocked
+  sx127x_cb_put(self, SX127X_CB_RECEIVE, crc_ok, 0, payload_len,
+                (void*) self->payload);
+}
+//----------------------------------------------------------------------------
+// IRQ handler on DIO0 pin
+void sx127x_irq_handler(sx127x_t *self)
+{
+  sx127x_cb_lock(self, true); // all registers and FIFO by one transaction
+  sx127x_dio0_handler(self);
+  sx127x_cb_unlock(self);
+}
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_DIO
+// map event SX127X_EV_* to DIO line 0...5 in current mode (LoRa/FSK/OOK)
+// (write `RegDioMapping1/2`; return 0 or -1 if line can't signal event)
+int sx127x_dio_map(sx127x_t *self, int dio, int event)
+{
+  bool lora = self->mode == SX127X_LORA;
+  const u8_t *tbl;
+  u8_t code, mask, bits;
+
+  if (dio < 0 || dio >= SX127X_DIO_NUM || event == SX127X_EV_NONE)
+    return -1;
+
+  tbl = sx127x_dio_tbl[lora ? 0 : 1][dio];
+  if (!lora && event == SX127X_EV_TX_DONE)
+    event = SX127X_EV_RX_DONE; // `PacketSent` is 0b00 on DIO0 too
+
+  for (code = 0; code < 4; code++)
+    if (tbl[code] == event ||
+        (tbl[code] == SX127X_EV_PREAMBLE_DETECT && event == SX127X_EV_RSSI))
+      break;
+  if (code == 4) return -1; // line can't signal event in this mode
+
+  SX127X_LOCK(self);
+  if (dio < 4)
+  { // `RegDioMapping1`: DIO0 - bits 7-6, ..., DIO3 - bits 1-0
+    mask = 0xC0 >> (2 * dio);
+    bits = code << (6 - 2 * dio);
+    sx127x_dio_bits(self, REG_DIO_MAPPING_1, mask, bits);
+  }
+  else
+  { // `RegDioMapping2`: DIO4 - bits 7-6, DIO5 - bits 5-4
+    mask = 0xC0 >> (2 * (dio - 4));
+    bits = code << (14 - 2 * dio);
+    if (!lora && dio == 4 && code == 3)
+    { // `Rssi` or `PreambleDetect`
+      mask |= DIO_MAP_PREAMBLE_DETECT;
+      if (event == SX127X_EV_PREAMBLE_DETECT)
+        bits |= DIO_MAP_PREAMBLE_DETECT;
+    }
+    sx127x_dio_bits(self, REG_DIO_MAPPING_2, mask, bits);
+  }
+  SX127X_UNLOCK(self);
+
+  return 0;
+}
+//----------------------------------------------------------------------------
+// get event SX127X_EV_* mapped to DIO line 0...5 (no SPI exchange)
+int sx127x_dio_event(const sx127x_t *self, int dio)
+{
+  bool lora = self->mode == SX127X_LORA;
+  u8_t code;
+
+  if (dio < 0 || dio >= SX127X_DIO_NUM) return SX127X_EV_NONE;
+
+  if (dio < 4) code = (self->dio_map1 >> (6 - 2 * dio))  & 3;
+  else         code = (self->dio_map2 >> (14 - 2 * dio)) & 3;
+
+  if (!lora && dio == 4 && code == 3 &&
+      (self->dio_map2 & DIO_MAP_PREAMBLE_DETECT) == 0)
+    return SX127X_EV_RSSI;
+
+  return sx127x_dio_tbl[lora ? 0 : 1][dio][code];
+}
+//----------------------------------------------------------------------------
+// set callback on DIO line event (called from sx127x_dio_handler())
+void sx127x_on_event(
+  sx127x_t *self,
+  void (*on_event)(           // DIO line event callback or NULL
+    sx127x_t *self,             // pointer to sx127x_t object
+    int dio,                    // DIO line 0...5
+    int event,                  // SX127X_EV_*
+    void *context),             // optional context
+  void *on_event_context)     // optional on_event() context
+{
+  self->on_event         = on_event;
+  self->on_event_context = on_event_context;
+}
+//----------------------------------------------------------------------------
+// return LoRa IRQ flag of DIO line event (cleared by sx127x_dio_handler())
+static u8_t sx127x_dio_flag(int event)
+{
+  switch (event)
+  {
+    case SX127X_EV_RX_TIMEOUT:   return IRQ_RX_TIMEOUT;
+    case SX127X_EV_VALID_HEADER: return IRQ_VALID_HEADER;
+    case SX127X_EV_CAD_DONE:     return IRQ_CAD_DONE;
+    case SX127X_EV_FHSS_CHANGE:  return IRQ_FHSS_CHANGE;
+    case SX127X_EV_CAD_DETECTED: return IRQ_CAD_DETECTED;
+    default: return 0; // `PayloadCrcError` is cleared with `RxDone`
+  }
+}
+//----------------------------------------------------------------------------
+// return true if any DIO line is mapped to event
+static bool sx127x_dio_mapped(const sx127x_t *self, int event)
+{
+  int dio;
+  for (dio = 0; dio < SX127X_DIO_NUM; dio++)
+    if (sx127x_dio_event(self, dio) == event) return true;
+  return false;
+}
+//----------------------------------------------------------------------------
+// IRQ handler on DIO line 0...5 (rising edge; any edge of DIO1 in FSK/OOK
+// streaming mode): event is known by mapping without reading IRQ flags;
+// RX/TX done go to sx127x_irq_handler(), FIFO events in streaming mode go
+// to sx127x_dio1_handler(), `FhssChangeChannel` goes to sx127x_fhss_handler()
+// if hop table is set, CAD of LBT goes to sx127x_irq_handler(), others go
+// to on_event() callback
+void sx127x_dio_handler(sx127x_t *self, int dio)
+{
+  int event = sx127x_dio_event(self, dio);
+  u8_t flag;
+
+  if (event == SX127X_EV_NONE) return;
+
+  if (event == SX127X_EV_RX_DONE || event == SX127X_EV_TX_DONE)
+  {
+    sx127x_irq_handler(self);
+    return;
+  }
+
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_STREAM)
+  if (self->stream != SX127X_STREAM_OFF &&
+      (event == SX127X_EV_FIFO_LEVEL || event == SX127X_EV_FIFO_EMPTY))
+  {
+    sx127x_dio1_handler(self);
+    return;
+  }
+#endif
+
+#if defined(SX127X_USE_QUEUE) && defined(SX127X_USE_LBT)
+  if ((event == SX127X_EV_CAD_DONE || event == SX127X_EV_CAD_DETECTED) &&
+      self->lbt_state == SX127X_LBT_SENSE)
+  { // CAD of LBT: both flags are read by DIO0 handler
+    sx127x_irq_handler(self);
+    return;
+  }
+#endif
+
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_FHSS)
+  if (event == SX127X_EV_FHSS_CHANGE && self->hop_num != 0)
+  { // fast path: hop deadline is one hop period (e.g. 10 symbols of 256 us)
+    sx127x_fhss_handler(self);
+    return;
+  }
+#endif
+
+  sx127x_cb_lock(self, true); // callback runs after bus is unlocked
+  sx127x_cb_put(self, SX127X_CB_EVENT, true, (i16_t) dio, event, NULL);
+
+  if (self->mode == SX127X_LORA)
+  {
+    flag = sx127x_dio_flag(event);
+
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_DUTY)
+    if (event == SX127X_EV_RX_TIMEOUT && self->duty_rx &&
+        self->irq_time >= self->duty_start +
+                          (u64_t) self->duty_window_us * 1000 /
+                          SX127X_DUTY_EDGE_DIV)
+    { // close RX window (edge of closed window is skipped) and sleep
+      sx127x_rx_duty_end(self, self->irq_time);
+      self->duty_stat.timeouts++;
+      sx127x_sleep(self);
+    }
+#endif
+
+    if (event == SX127X_EV_CAD_DONE &&
+        !sx127x_dio_mapped(self, SX127X_EV_CAD_DETECTED))
+    { // no line for `CadDetected`: read flags once
+      if (sx127x_read_reg(self, REG_IRQ_FLAGS) & IRQ_CAD_DETECTED)
+      {
+        sx127x_cb_put(self, SX127X_CB_EVENT, true, (i16_t) dio,
+                      SX127X_EV_CAD_DETECTED, NULL);
+        flag |= IRQ_CAD_DETECTED;
+      }
+    }
+
+    if (flag) sx127x_write_reg(self, REG_IRQ_FLAGS, flag); // clear by 1
+  }
+
+  sx127x_cb_unlock(self);
+}
+#endif // SX127X_USE_DIO
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_RXQ
+// on/off RX ring: received frames with metadata are put to lock-free ring
+// by sx127x_irq_handler() instead of on_receive()/on_receive_ex() callbacks
+// (one producer - IRQ thread, one consumer - sx127x_rxq_peek()/pop())
+void sx127x_rxq_on(
+  sx127x_t *self,
+  bool on,                  // true - RX ring on, false - callbacks
+  void (*rxq_notify)(       // frame is put to RX ring callback or NULL
+    sx127x_t *self,           // pointer to sx127x_t object
+    void *context),           // optional context
+  void *rxq_context)        // optional rxq_notify() context
+{
+  self->rxq_notify  = rxq_notify;
+  self->rxq_context = rxq_context;
+  __sync_synchronize();
+  self->rxq_on = on;
+}
+//----------------------------------------------------------------------------
+// get oldest frame of RX ring or NULL if ring is empty (consumer)
+// (frame is valid until sx127x_rxq_pop())
+const sx127x_rx_frame_t *sx127x_rxq_peek(sx127x_t *self)
+{
+  if (self->rxq_tail == self->rxq_head)
+    return (const sx127x_rx_frame_t*) NULL;
 
-  // run callback
-  if (self->on_receive != (void (*)(sx127x_t*, u8_t*, u8_t, bool, void*)) NULL)
-    self->on_receive(self, self->payload, payload_len,
-                     crc_ok, self->on_receive_context);
+  __sync_synchronize(); // read slot after `rxq_head`
+  return &self->rxq[self->rxq_tail % SX127X_RXQ_SIZE];
+}
+//----------------------------------------------------------------------------
+// free oldest frame of RX ring (consumer)
+void sx127x_rxq_pop(sx127x_t *self)
+{
+  if (self->rxq_tail != self->rxq_head)
+  {
+    __sync_synchronize();
+    self->rxq_tail++; // free slot
+  }
+}
+//----------------------------------------------------------------------------
+// return number of frames in RX ring (0 - ring is empty)
+int sx127x_rxq_count(sx127x_t *self)
+{
+  return (int) (self->rxq_head - self->rxq_tail);
 }
 //----------------------------------------------------------------------------
+// get RX ring statistics: number of put and dropped (ring is full) frames
+void sx127x_rxq_stat(sx127x_t *self, u32_t *frames, u32_t *drops)
+{
+  if (frames != (u32_t*) NULL) *frames = self->rxq_frames;
+  if (drops  != (u32_t*) NULL) *drops  = self->rxq_drops;
+}
+#endif // SX127X_USE_RXQ
+//----------------------------------------------------------------------------
 #if defined(SX127X_USE_LORA) && defined(SX127X_USE_EXTRA)
 // enable/disable interrupt by RX done for debug (LoRa)
 void sx127x_enable_rx_irq(sx127x_t *self, bool enable)
 {
+  SX127X_LOCK(self);
   if (self->mode == SX127X_LORA) // LoRa mode
   {
     u8_t reg = sx127x_read_reg(self, REG_IRQ_FLAGS_MASK);
@@ -1317,6 +4417,7 @@ void sx127x_enable_rx_irq(sx127x_t *self, bool enable)
     else        reg |=  IRQ_RX_DONE_MASK;
     sx127x_write_reg(self, REG_IRQ_FLAGS_MASK, reg);
   }
+  SX127X_UNLOCK(self);
 }
 #endif
 //----------------------------------------------------------------------------
@@ -1326,8 +4427,11 @@ u16_t sx127x_get_irq_flags(sx127x_t *self)
 {
   if (self->mode == SX127X_LORA) // LoRa mode
   {
-    u8_t irq_flags = sx127x_read_reg(self, REG_IRQ_FLAGS);
+    u8_t irq_flags;
+    SX127X_LOCK(self);
+    irq_flags = sx127x_read_reg(self, REG_IRQ_FLAGS);
     sx127x_write_reg(self, REG_IRQ_FLAGS, irq_flags);
+    SX127X_UNLOCK(self);
     return (u16_t) irq_flags;
   }
   else // FSK/OOK mode
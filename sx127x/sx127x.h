@@ -10,10 +10,61 @@
 #ifndef SX127X_MAX_PACKET
 #define SX127X_MAX_PACKET 256
 #endif
+
+// maximum data bytes in one SPI transaction (`len` of spi_exchange() is u8_t)
+#define SX127X_BURST_MAX 254
+
+// maximum gap of known registers to merge two bursts in batch commit
+#ifndef SX127X_BATCH_GAP
+#define SX127X_BATCH_GAP 4
+#endif
+
+// number of frames in asynchronous TX queue
+#ifndef SX127X_TXQ_SIZE
+#define SX127X_TXQ_SIZE 8
+#endif
+
+// number of frames in lock-free RX ring
+#ifndef SX127X_RXQ_SIZE
+#define SX127X_RXQ_SIZE 16
+#endif
+
+// `FifoThreshold` in FIFO streaming mode (FifoLevel IRQ on DIO1)
+#ifndef SX127X_FIFO_THRESH
+#define SX127X_FIFO_THRESH 32
+#endif
+
+// maximum packet length in fixed length FIFO streaming mode (11 bits)
+#define SX127X_STREAM_MAX 2047
+
+// TX done timeout margin over computed time on air [ms]
+#ifndef SX127X_TX_MARGIN
+#define SX127X_TX_MARGIN 100
+#endif
+
+// maximum register polls per 1 ms in busy waiting loops without TX IRQ
+// and without time hook (one 16-bit SPI read takes 1.6 us at least at
+// 10 MHz SPI clock; look sx127x_time_hook())
+#ifndef SX127X_POLL_PER_MS
+#define SX127X_POLL_PER_MS 625
+#endif
 //-----------------------------------------------------------------------------
 #define SX127X_USE_LORA   // use LoRaTM mode
 #define SX127X_USE_FSKOOK // use FSK/OOK mode
 #define SX127X_USE_EXTRA  // use some extra funtions
+#define SX127X_USE_CACHE  // use shadow register cache
+#define SX127X_USE_BATCH  // use batched register writes
+#define SX127X_USE_QUEUE  // use asynchronous TX queue
+#define SX127X_USE_STREAM // use FIFO streaming of long packets (FSK/OOK)
+#define SX127X_USE_RXQ    // use lock-free RX ring (one producer/one consumer)
+#define SX127X_USE_LOCK   // use SPI bus lock (atomic register transactions)
+#define SX127X_USE_DIO    // use DIO0...DIO5 mapping and per-line IRQ dispatch
+#define SX127X_USE_DUTY   // use duty-cycled receive by RX single (LoRa)
+#define SX127X_USE_FHSS   // use frequency hopping by hop table (LoRa)
+#define SX127X_USE_LBT    // use listen before talk in TX queue (CAD/RSSI)
+#define SX127X_USE_PLAN   // use channel plan of precomputed `Frf` codes
+#define SX127X_USE_SWEEP  // use RSSI spectrum sweep by fast hop (FSK/OOK)
+#define SX127X_USE_ADR    // use adaptive data rate by link statistics (LoRa)
 //-----------------------------------------------------------------------------
 // limit arguments
 #define SX127X_LIMIT(x, min, max) \
@@ -27,6 +78,9 @@
 #define SX127X_ERR_NONE      0 // no error, success
 #define SX127X_ERR_VERSION  -1 // error of crystal revision
 #define SX127X_ERR_BAD_SIZE -2 // bad size of send packet (<=0)
+#define SX127X_ERR_TIMEOUT  -3 // TX done is not received by timeout
+#define SX127X_ERR_FULL     -4 // asynchronous TX queue is full
+#define SX127X_ERR_BUSY     -5 // channel is busy (LBT) or TX queue owns TX
 
 //----------------------------------------------------------------------------
 //#define SX127X_DEBUG
@@ -44,6 +98,7 @@ typedef unsigned short u16_t;
 typedef          short i16_t;
 typedef unsigned long  u32_t;
 typedef          long  i32_t;
+typedef unsigned long long u64_t;
 //----------------------------------------------------------------------------
 // bool type
 typedef u8_t bool;
@@ -77,8 +132,8 @@ typedef struct sx127x_pars_ {
   u8_t  sw;         // Sync Word (allways 0x12)
   u16_t preamble;   // Size of preamble: 6...65535 (8 by default)
   bool impl_hdr;    // true - implicit header mode, false - explicit
-  //bool freq_hop;    // `FreqHopOn`
-  //u8_t hop_period;  // `HopPeriod`                 
+  bool freq_hop;    // FHSS on/off (hop table is set by sx127x_fhss_table())
+  u8_t hop_period;  // `FreqHoppingPeriod` [symbols]: 1...255
 #endif
 
 #ifdef SX127X_USE_FSKOOK
@@ -93,6 +148,321 @@ typedef struct sx127x_pars_ {
 #endif
 } sx127x_pars_t;
 //----------------------------------------------------------------------------
+// segment of vectored SPI exchange (one chip select frame per segment)
+typedef struct sx127x_seg_ {
+  u8_t       *rx_buf; // RX buffer
+  const u8_t *tx_buf; // TX buffer
+  u8_t        len;    // number of bytes
+} sx127x_seg_t;
+
+// maximum number of segments in one vectored SPI exchange
+#define SX127X_SEG_MAX 16
+//----------------------------------------------------------------------------
+// FIFO streaming state (FSK/OOK)
+#define SX127X_STREAM_OFF     0 // no streaming
+#define SX127X_STREAM_TX      1 // refill FIFO on TX
+#define SX127X_STREAM_TX_LAST 2 // all data in FIFO, wait end of TX
+#define SX127X_STREAM_RX      3 // drain FIFO on RX
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_QUEUE
+// frame of asynchronous TX queue (look sx127x_send_async())
+typedef struct sx127x_frame_ {
+  u8_t  data[SX127X_MAX_PACKET]; // packet data
+  i16_t size;       // packet size
+  bool  fixed;      // implicit header (LoRa) or fixed length (FSK/OOK)
+  u32_t airtime_ms; // computed time on air [ms]
+  void *context;    // optional frame context
+} sx127x_frame_t;
+#endif
+//----------------------------------------------------------------------------
+// metadata of received packet (look sx127x_on_receive_ex())
+typedef struct sx127x_rx_meta_ {
+  u64_t time_ns;      // DIO0 IRQ edge timestamp [ns] (look sx127x_irq_time())
+  i16_t rssi;         // packet RSSI [dBm]
+  i16_t snr;          // packet SNR [dB] (LoRa, 0 in FSK/OOK)
+  i32_t fei;          // frequency error [Hz]
+  u32_t freq;         // frequency [Hz]
+  sx127x_mode_t mode; // radio mode: SX127X_LORA, SX127X_FSK, SX127X_OOK
+#ifdef SX127X_USE_LORA
+  u32_t bw;           // Bandwith [Hz] (LoRa)
+  u8_t  sf;           // Spreading Facror: 6..12
+  u8_t  cr;           // Code Rate: 5...8 (from header in explicit mode)
+  bool  impl_hdr;     // true - implicit header mode, false - explicit
+  bool  ldro;         // Low Data Rate Optimize on/off
+  bool  crc_on;       // `CrcOnPayload` (CRC in received header)
+#endif
+#ifdef SX127X_USE_FSKOOK
+  u32_t bitrate;      // bitrate [bit/s] (FSK/OOK)
+  bool  fixed;        // true - fixed packet length, false - variable length
+#endif
+} sx127x_rx_meta_t;
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_RXQ
+// frame of lock-free RX ring (look sx127x_rxq_on())
+typedef struct sx127x_rx_frame_ {
+  u8_t data[SX127X_MAX_PACKET]; // payload data
+  u8_t size;                    // payload size
+  bool crc;                     // CRC ok/false
+  sx127x_rx_meta_t meta;        // packet metadata
+} sx127x_rx_frame_t;
+#endif
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_LOCK
+// SPI bus lock statistics (look sx127x_lock_stat())
+typedef struct sx127x_lock_stat_ {
+  u32_t locks;     // number of transactions of application threads
+  u32_t waits;     // number of them waited bus (lock is contended)
+  u32_t irq_locks; // number of transactions of IRQ handlers
+  u32_t irq_waits; // number of them waited bus (lock is contended)
+  u32_t cb_drops;  // callbacks dropped (deferred list is full)
+} sx127x_lock_stat_t;
+#endif
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_DIO
+// number of DIO lines (DIO0...DIO5)
+#define SX127X_DIO_NUM 6
+
+// events of DIO lines (look sx127x_dio_map() and sx127x_dio_handler())
+#define SX127X_EV_NONE             0 // line is not used
+#define SX127X_EV_RX_DONE          1 // `RxDone` or `PayloadReady` (FSK/OOK)
+#define SX127X_EV_TX_DONE          2 // `TxDone` or `PacketSent` (FSK/OOK)
+#define SX127X_EV_CAD_DONE         3 // `CadDone` (LoRa)
+#define SX127X_EV_CAD_DETECTED     4 // `CadDetected` (LoRa)
+#define SX127X_EV_VALID_HEADER     5 // `ValidHeader` (LoRa)
+#define SX127X_EV_CRC_ERROR        6 // `PayloadCrcError` (LoRa)
+#define SX127X_EV_FHSS_CHANGE      7 // `FhssChangeChannel` (LoRa)
+#define SX127X_EV_RX_TIMEOUT       8 // `RxTimeout` or `Timeout` (FSK/OOK)
+#define SX127X_EV_FIFO_LEVEL       9 // `FifoLevel` (FSK/OOK)
+#define SX127X_EV_FIFO_EMPTY      10 // `FifoEmpty` (FSK/OOK)
+#define SX127X_EV_FIFO_FULL       11 // `FifoFull` (FSK/OOK)
+#define SX127X_EV_SYNC_ADDRESS    12 // `SyncAddress` (FSK/OOK)
+#define SX127X_EV_PREAMBLE_DETECT 13 // `PreambleDetect` (FSK/OOK)
+#define SX127X_EV_CRC_OK          14 // `CrcOk` (FSK/OOK)
+#define SX127X_EV_RX_READY        15 // `RxReady` (FSK/OOK)
+#define SX127X_EV_TX_READY        16 // `TxReady` (FSK/OOK)
+#define SX127X_EV_LOW_BAT         17 // `TempChange`/`LowBat` (FSK/OOK)
+#define SX127X_EV_PLL_LOCK        18 // `PllLock`
+#define SX127X_EV_MODE_READY      19 // `ModeReady`
+#define SX127X_EV_CLK_OUT         20 // `ClkOut`
+#define SX127X_EV_DATA            21 // `Data` (FSK/OOK continuous mode)
+#define SX127X_EV_RSSI            22 // `Rssi` (FSK/OOK)
+#endif
+//----------------------------------------------------------------------------
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_DUTY)
+// default RX window of duty-cycled receive [symbols]
+// (enough to detect preamble, look `RegSymbTimeout` in datasheet)
+#define SX127X_DUTY_WINDOW 6
+
+// margin of RX window period for wake-up latency and OS timer jitter [us]
+#define SX127X_DUTY_GUARD_US 1000
+
+// `RxTimeout` edge earlier than 1/SX127X_DUTY_EDGE_DIV of RX window after
+// wake-up belongs to window closed before (late IRQ of previous period)
+#define SX127X_DUTY_EDGE_DIV 2
+
+// duty-cycled receive statistics (look sx127x_rx_duty_stat())
+typedef struct sx127x_duty_stat_ {
+  u32_t windows;  // number of opened RX windows
+  u32_t packets;  // number of packets received in RX windows
+  u32_t timeouts; // number of RX windows closed by `RxTimeout` or time on air
+  u32_t skips;    // wake-ups skipped while packet is received
+  u64_t on_ns;    // measured radio on time (open RX windows) [ns]
+  u64_t run_ns;   // time from first wake-up [ns]
+} sx127x_duty_stat_t;
+#endif
+//----------------------------------------------------------------------------
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_FHSS)
+// maximum number of channels in hop table (`FhssPresentChannel` is 6 bits)
+#ifndef SX127X_HOP_MAX
+#define SX127X_HOP_MAX 64
+#endif
+
+// FHSS statistics (look sx127x_fhss_stat())
+typedef struct sx127x_fhss_stat_ {
+  u32_t hops;     // number of handled `FhssChangeChannel` IRQ
+  u32_t misses;   // number of missed hops (channel is skipped by chip)
+  u32_t spurious; // number of IRQ without channel change
+} sx127x_fhss_stat_t;
+#endif
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_PLAN
+// maximum number of channels in channel plan
+#ifndef SX127X_PLAN_MAX
+#define SX127X_PLAN_MAX 256
+#endif
+
+// channel plan: RF frequencies converted to `Frf` codes once
+// (read only after sx127x_plan_init(), may be shared by several modules)
+typedef struct sx127x_plan_ {
+  int   num;                     // number of channels
+  u32_t freq[SX127X_PLAN_MAX];   // RF frequencies of `Frf` codes [Hz]
+  u8_t  frf[SX127X_PLAN_MAX][3]; // `Frf` codes (MSB first)
+} sx127x_plan_t;
+#endif
+//----------------------------------------------------------------------------
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_SWEEP)
+// maximum number of bins of RSSI sweep
+#ifndef SX127X_SWEEP_BINS
+#define SX127X_SWEEP_BINS 128
+#endif
+
+// size of ring of RSSI sweep vectors
+#ifndef SX127X_SWEEP_RING
+#define SX127X_SWEEP_RING 8
+#endif
+
+// PLL lock time of fast hop [us] (`FastHopOn`, step <= 1 MHz)
+#define SX127X_SWEEP_HOP_US 20
+
+// power vector of one sweep (look sx127x_sweep_peek())
+typedef struct sx127x_sweep_vec_ {
+  u32_t seq;       // sweep number (from 0)
+  u32_t period_us; // time from end of previous sweep [us] (0 - unknown)
+  u64_t end_ns;    // time of last bin [ns]
+  int   bins;      // number of bins
+  i16_t rssi[SX127X_SWEEP_BINS]; // RSSI of bins [dBm]
+} sx127x_sweep_vec_t;
+
+// RSSI sweep statistics (look sx127x_sweep_stat())
+typedef struct sx127x_sweep_stat_ {
+  u32_t sweeps;   // number of vectors put to ring
+  u32_t drops;    // number of vectors dropped (ring is full)
+  u32_t min_us;   // minimum sweep period [us]
+  u32_t max_us;   // maximum sweep period [us]
+  u64_t total_us; // sum of measured sweep periods [us]
+  u32_t periods;  // number of measured sweep periods
+} sx127x_sweep_stat_t;
+#endif
+//----------------------------------------------------------------------------
+#if defined(SX127X_USE_QUEUE) && defined(SX127X_USE_LBT)
+// state of listen before talk (look sx127x_lbt())
+#define SX127X_LBT_IDLE    0 // no channel check
+#define SX127X_LBT_SENSE   1 // CAD (LoRa) or RSSI sampling (FSK/OOK) is run
+#define SX127X_LBT_BACKOFF 2 // channel is busy, wait random backoff in RX
+
+// minimum and maximum backoff exponent (backoff is 1...2**BE slots)
+#ifndef SX127X_LBT_BE_MIN
+#define SX127X_LBT_BE_MIN 2
+#endif
+#ifndef SX127X_LBT_BE_MAX
+#define SX127X_LBT_BE_MAX 6
+#endif
+
+// maximum number of backoffs per frame (then frame is dropped)
+#ifndef SX127X_LBT_TRIES
+#define SX127X_LBT_TRIES 8
+#endif
+
+// RSSI sampling time before channel check in FSK/OOK mode [us]
+#ifndef SX127X_LBT_SENSE_US
+#define SX127X_LBT_SENSE_US 1000
+#endif
+
+// number of channels (frequencies) in busy statistics
+#ifndef SX127X_LBT_CH_MAX
+#define SX127X_LBT_CH_MAX 8
+#endif
+
+// busy statistics of one channel
+typedef struct sx127x_lbt_ch_ {
+  u32_t freq;   // frequency [Hz] (0 - free slot)
+  u32_t checks; // number of channel checks
+  u32_t busy;   // number of checks found channel busy
+} sx127x_lbt_ch_t;
+
+// listen before talk statistics (look sx127x_lbt_stat())
+typedef struct sx127x_lbt_stat_ {
+  sx127x_lbt_ch_t ch[SX127X_LBT_CH_MAX]; // per channel busy statistics
+  u32_t sent[SX127X_LBT_TRIES + 1];      // frames sent after N backoffs
+  u32_t be[SX127X_LBT_BE_MAX + 1];       // backoffs by exponent BE
+  u32_t drops;      // frames dropped after SX127X_LBT_TRIES backoffs
+  u64_t backoff_us; // total backoff time [us]
+} sx127x_lbt_stat_t;
+#endif
+//----------------------------------------------------------------------------
+// maximum number of callbacks deferred until SPI bus is unlocked
+// (one IRQ pass defers at most 4: event and `CadDetected` of DIO line,
+//  RX and TX done of DIO0; 2x margin for nested handlers)
+#ifndef SX127X_CB_MAX
+#define SX127X_CB_MAX 8
+#endif
+
+// types of deferred callbacks
+#define SX127X_CB_RECEIVE      1 // on_receive_ex() or on_receive()
+#define SX127X_CB_TRANSMIT     2 // on_transmit()
+#define SX127X_CB_SENT         3 // on_sent()
+#define SX127X_CB_EVENT        4 // on_event()
+#define SX127X_CB_RECEIVE_LONG 5 // on_receive_long()
+#define SX127X_CB_RXQ          6 // rxq_notify()
+
+// callback deferred until SPI bus is unlocked (arguments are captured)
+typedef struct sx127x_cb_ {
+  u8_t  type;   // SX127X_CB_*
+  bool  ok;     // CRC ok/false (RX) or TX done/timeout
+  i16_t status; // on_sent() status or on_event() DIO line
+  int   arg;    // payload size, on_event() event or time on air [ms]
+  void *ptr;    // payload, frame context or long packet buffer
+} sx127x_cb_t;
+
+// time on air parameters of active configuration (look sx127x_airtime_us())
+typedef struct sx127x_toa_ {
+  u32_t unit_ns; // LoRa symbol or FSK/OOK bit duration [ns] (0 - not set)
+  u32_t over;    // LoRa preamble and header [1/4 symbols] or
+                 // FSK/OOK preamble, sync word, length and CRC [bits]
+  i32_t num;     // LoRa payload symbols: 28 - 4*SF + 16*CRC - 20*IH
+  u8_t  den;     // LoRa payload symbols: 4 * (SF - 2*LDRO)
+  u8_t  cr;      // LoRa Code Rate: 5...8
+  u8_t  bits;    // FSK/OOK bits per payload byte (16 in Manchester mode)
+} sx127x_toa_t;
+
+// time on air statistics (look sx127x_air_stat())
+typedef struct sx127x_air_stat_ {
+  u32_t tx_packets; // number of transmitted packets
+  u32_t rx_packets; // number of received packets
+  u64_t tx_us;      // computed time on air of transmitted packets [us]
+  u64_t rx_us;      // computed time on air of received packets [us]
+} sx127x_air_stat_t;
+//----------------------------------------------------------------------------
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_EXTRA) && \
+    defined(SX127X_USE_ADR)
+// maximum number of peers of adaptive data rate
+#ifndef SX127X_ADR_PEERS
+#define SX127X_ADR_PEERS 8
+#endif
+
+// number of last received frames in link history of peer
+#ifndef SX127X_ADR_HIST
+#define SX127X_ADR_HIST 8
+#endif
+
+// minimum TX power of adaptive data rate [dBm]
+#define SX127X_ADR_POWER_MIN 2
+
+// SNR [dB] from which LoRa SNR estimation is saturated (RSSI is used)
+#define SX127X_ADR_SNR_SAT 10
+
+// link history of peer (look sx127x_adr_rx())
+typedef struct sx127x_adr_peer_ {
+  u32_t id;     // peer ID (from application)
+  u32_t frames; // number of received frames (0 - free slot)
+  i16_t rssi[SX127X_ADR_HIST]; // RSSI of last frames [dBm]
+  i16_t snr[SX127X_ADR_HIST];  // SNR of last frames [dB]
+  i16_t link[SX127X_ADR_HIST]; // SNR normalized to BW=500 kHz and
+                               // TX power 0 dBm [0.1 dB]
+} sx127x_adr_peer_t;
+
+// decision of adaptive data rate (look sx127x_adr_apply())
+typedef struct sx127x_adr_ {
+  u32_t bw;     // Bandwidth [Hz]
+  u8_t  sf;     // Spreading Factor: 7...12
+  bool  ldro;   // Low Data Rate Optimize on/off
+  i8_t  power;  // TX power [dBm]
+  i16_t margin; // expected SNR margin over demodulator limit [0.1 dB]
+  u32_t old_us; // time on air of packet by previous configuration [us]
+  u32_t new_us; // time on air of packet by chosen configuration [us]
+} sx127x_adr_t;
+#endif
+//----------------------------------------------------------------------------
 // SX127x class pivate data
 typedef struct sx127x_ sx127x_t;
 struct sx127x_ {
@@ -102,9 +472,17 @@ struct sx127x_ {
   bool crc;           // CRC in packet modes: false - off, true - on
 #ifdef SX127X_USE_LORA
   bool impl_hdr;      // true - implicit header mode, false - explicit
+  u32_t bw;           // Bandwith [Hz] (LoRa)
+  u8_t sf;            // Spreading Facror: 6..12
+  u8_t cr;            // Code Rate: 5...8
+  bool ldro;          // Low Data Rate Optimize on/off
+  u16_t preamble;     // Size of preamble (LoRa)
 #endif
 #ifdef SX127X_USE_FSKOOK
   bool fixed;         // true - fixed packet length, false - variable length
+  u32_t bitrate;      // bitrate [bit/s] (FSK/OOK)
+  u8_t dcfree;        // DC free method: 0 - None, 1 - Manchester, 2 - Whitening
+  u32_t rx_bw;        // RX bandwidth [Hz] (FSK/OOK)
 #endif
 
   int (*spi_exchange)( // SPI exchange function
@@ -112,6 +490,11 @@ struct sx127x_ {
     const u8_t *tx_buf, // TX buffer
     u8_t len,           // number of bites
     void *context);     // optional SPI context or NULL
+
+  int (*spi_exchange_v)(  // vectored SPI exchange function or NULL
+    const sx127x_seg_t *seg, // segments (one chip select frame per segment)
+    int n,                   // number of segments (n <= SX127X_SEG_MAX)
+    void *context);          // optional SPI context or NULL
   
   void (*on_receive)( // receive callback or NULL
     sx127x_t *self,     // pointer to sx127x_t object
@@ -120,8 +503,207 @@ struct sx127x_ {
     bool crc,           // CRC ok/false
     void *context);     // optional context
   
+  void (*on_transmit)( // transmit done callback or NULL
+    sx127x_t *self,     // pointer to sx127x_t object
+    bool ok,            // true - TX done, false - timeout
+    void *context);     // optional context
+
+  int (*tx_wait)(     // sleep until TX done or timeout hook or NULL
+    sx127x_t *self,     // pointer to sx127x_t object
+    u32_t timeout_ms,   // timeout [ms]
+    void *context);     // optional context
+
+  void (*tx_wake)(    // wake up thread sleeping in tx_wait() hook or NULL
+    sx127x_t *self,     // pointer to sx127x_t object
+    void *context);     // optional context
+
+  u64_t (*time_ns)(   // monotonic time [ns] hook for busy waiting or NULL
+    sx127x_t *self,     // pointer to sx127x_t object
+    void *context);     // optional context
+
   void *spi_exchange_context; // optional SPI exchange context
   void *on_receive_context;   // optional on_receive() context
+  void *on_transmit_context;  // optional on_transmit() context
+  void *tx_context;           // optional tx_wait()/tx_wake() context
+  void *time_context;         // optional time_ns() context
+
+  void (*on_receive_ex)( // receive callback with metadata or NULL
+    sx127x_t *self,        // pointer to sx127x_t object
+    u8_t *payload,         // payload data
+    u8_t payload_size,     // payload size
+    bool crc,              // CRC ok/false
+    const sx127x_rx_meta_t *meta, // packet metadata
+    void *context);        // optional context
+
+  void *on_receive_ex_context; // optional on_receive_ex() context
+
+  u64_t irq_time;           // timestamp of current DIO0 IRQ edge [ns]
+  sx127x_rx_meta_t rx_meta; // metadata of last received packet
+
+  volatile bool tx_irq; // true - wait TX done by IRQ on DIO0
+
+  sx127x_toa_t toa;           // time on air parameters (updated by setters)
+  u32_t tx_air_us;            // time on air of current TX packet [us]
+  sx127x_air_stat_t air_stat; // time on air statistics
+
+  sx127x_cb_t cb[SX127X_CB_MAX]; // callbacks deferred until bus unlock
+  int cb_num;                    // number of deferred callbacks
+  int cb_depth;                  // nesting level of callback sections
+
+#ifdef SX127X_USE_QUEUE
+  void (*on_sent)(    // frame of TX queue sent callback or NULL
+    sx127x_t *self,     // pointer to sx127x_t object
+    void *frame,        // frame context from sx127x_send_async()
+    i16_t status,       // SX127X_ERR_NONE or error code
+    u32_t airtime_ms,   // computed time on air [ms]
+    void *context);     // optional context
+
+  void *on_sent_context; // optional on_sent() context
+
+  sx127x_frame_t txq[SX127X_TXQ_SIZE]; // asynchronous TX queue (ring)
+  volatile u32_t txq_head;             // write index (sx127x_send_async())
+  volatile u32_t txq_tail;             // read index (sx127x_irq_handler())
+  volatile int   txq_busy;             // 1 - TX queue is draining,
+                                       // 2 - sx127x_send() owns transmitter
+#endif
+
+#ifdef SX127X_USE_RXQ
+  void (*rxq_notify)( // frame is put to RX ring callback or NULL
+    sx127x_t *self,     // pointer to sx127x_t object
+    void *context);     // optional context
+
+  void *rxq_context; // optional rxq_notify() context
+
+  bool rxq_on;                          // RX ring on/off
+  sx127x_rx_frame_t rxq[SX127X_RXQ_SIZE]; // lock-free RX ring
+  volatile u32_t rxq_head;              // write index (sx127x_irq_handler())
+  volatile u32_t rxq_tail;              // read index (sx127x_rxq_pop())
+  volatile u32_t rxq_frames;            // number of frames put to RX ring
+  volatile u32_t rxq_drops;             // number of frames dropped (full)
+#endif
+
+#ifdef SX127X_USE_LOCK
+  int (*bus_lock)(    // lock SPI bus hook (recursive) or NULL
+    sx127x_t *self,     // pointer to sx127x_t object
+    bool wait,          // true - wait, false - try lock (return < 0 if busy)
+    void *context);     // optional context
+
+  void (*bus_unlock)( // unlock SPI bus hook or NULL
+    sx127x_t *self,     // pointer to sx127x_t object
+    void *context);     // optional context
+
+  void *bus_context;     // optional bus_lock()/bus_unlock() context
+  int   bus_depth;       // nesting level of bus lock (changed by owner only)
+  sx127x_lock_stat_t bus_stat; // SPI bus lock statistics
+#endif
+
+#ifdef SX127X_USE_DIO
+  void (*on_event)(   // DIO line event callback or NULL
+    sx127x_t *self,     // pointer to sx127x_t object
+    int dio,            // DIO line 0...5
+    int event,          // SX127X_EV_*
+    void *context);     // optional context
+
+  void *on_event_context; // optional on_event() context
+
+  u8_t dio_map1;         // copy of `RegDioMapping1` (DIO0...DIO3)
+  u8_t dio_map2;         // copy of `RegDioMapping2` (DIO4, DIO5)
+#endif
+
+#if defined(SX127X_USE_QUEUE) && defined(SX127X_USE_LBT)
+  void (*lbt_timer)(  // start one-shot OS timer hook (call sx127x_lbt_wake())
+    sx127x_t *self,     // pointer to sx127x_t object
+    u32_t delay_us,     // delay [us]
+    void *context);     // optional context
+
+  void *lbt_context;     // optional lbt_timer() context
+  bool lbt_on;           // listen before talk is on
+  volatile u8_t lbt_state; // SX127X_LBT_*
+  i16_t lbt_rssi;        // busy RSSI threshold [dBm] (FSK/OOK)
+  u32_t lbt_slot_us;     // backoff slot [us]
+  u8_t  lbt_be;          // backoff exponent of current frame
+  u8_t  lbt_tries;       // number of backoffs of current frame
+  u32_t lbt_seed;        // state of backoff random generator
+  sx127x_lbt_stat_t lbt_stat; // listen before talk statistics
+#endif
+
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_DUTY)
+  bool duty_on;          // duty-cycled receive is on
+  bool duty_rx;          // RX window is open (RX single mode)
+  u32_t duty_window_us;  // RX window [us]
+  u32_t duty_period_us;  // period of RX windows [us]
+  u64_t duty_start;      // start of open RX window [ns]
+  u64_t duty_first;      // first wake-up [ns]
+  sx127x_duty_stat_t duty_stat; // duty-cycled receive statistics
+#endif
+
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_FHSS)
+  u8_t hop_period;       // `FreqHoppingPeriod` [symbols] (0 - FHSS off)
+  u8_t hop_num;          // number of channels in hop table (0 - no table)
+  u8_t hop_ch;           // last `FhssPresentChannel` (0 at start of packet)
+  u8_t hop_idx;          // hop counter modulo `hop_num` (index of hop table)
+  u8_t hop_frf[SX127X_HOP_MAX][3]; // `Frf` codes of hop table (MSB first)
+  sx127x_fhss_stat_t hop_stat;     // FHSS statistics
+#endif
+
+#ifdef SX127X_USE_PLAN
+  const sx127x_plan_t *plan; // channel plan (NULL - no plan)
+#endif
+
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_SWEEP)
+  bool  sweep_on;        // RSSI sweep is run
+  bool  sweep_skip;      // vector of current sweep is dropped (ring is full)
+  u8_t  sweep_pll_hop;   // `RegPllHop` before sweep
+  int   sweep_bins;      // number of bins
+  int   sweep_bin;       // bin of current `Frf`
+  u32_t sweep_dwell_us;  // dwell time per bin [us]
+  u32_t sweep_seq;       // number of current sweep
+  u64_t sweep_end;       // time of last bin of previous sweep [ns]
+  u8_t  sweep_frf[SX127X_SWEEP_BINS][3]; // `Frf` codes of bins (MSB first)
+  sx127x_sweep_vec_t sweep_vec[SX127X_SWEEP_RING]; // ring of power vectors
+  volatile u32_t sweep_head;       // write index (sx127x_sweep_step())
+  volatile u32_t sweep_tail;       // read index (sx127x_sweep_pop())
+  sx127x_sweep_stat_t sweep_stat;  // RSSI sweep statistics
+#endif
+
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_EXTRA) && \
+    defined(SX127X_USE_ADR)
+  bool  adr_on;          // adaptive data rate is on
+  u8_t  adr_margin;      // required SNR margin [dB]
+  i8_t  adr_power_max;   // maximum TX power [dBm]
+  i8_t  adr_power;       // TX power set by adaptive data rate [dBm]
+  sx127x_adr_peer_t adr_peer[SX127X_ADR_PEERS]; // link history of peers
+#endif
+
+#ifdef SX127X_USE_CACHE
+  bool cache;            // shadow register cache on/off
+  u8_t cache_valid[16];  // bit mask of valid shadow registers (128 bits)
+  u8_t regs[128];        // shadow copy of SX127x registers map
+#endif
+
+#ifdef SX127X_USE_BATCH
+  int  batch;            // batch nesting level (0 - batch writes off)
+  u8_t batch_mask[16];   // bit mask of pending register writes (128 bits)
+  u8_t batch_regs[128];  // pending register values
+#endif
+
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_STREAM)
+  void (*on_receive_long)( // receive long packet callback or NULL
+    sx127x_t *self,     // pointer to sx127x_t object
+    u8_t *data,         // user buffer from sx127x_receive_long()
+    int size,           // packet size
+    bool crc,           // CRC ok/false (always true in unlimited mode)
+    void *context);     // optional context
+
+  void *on_receive_long_context; // optional on_receive_long() context
+
+  const u8_t *stream_tx;     // TX data
+  u8_t *stream_rx;           // RX buffer
+  int   stream_size;         // packet size
+  int   stream_pos;          // number of written/read bytes
+  volatile u8_t stream;      // streaming state SX127X_STREAM_*
+  bool  stream_unlimited;    // unlimited length packet mode
+#endif
 
   u8_t payload[SX127X_MAX_PACKET]; // payload receiver buffer
 };
@@ -160,6 +742,8 @@ int sx127x_init(
 void sx127x_free(sx127x_t *self);
 //----------------------------------------------------------------------------
 // set callback on receive packet (Lora/FSK/OOK)
+// (all callbacks run after SPI bus is unlocked by handler, so they may
+//  call any sx127x_*() function; payload is valid until callback returns)
 void sx127x_on_receive(
   sx127x_t *self,
   void (*on_receive)(        // receive callback or NULL
@@ -170,12 +754,128 @@ void sx127x_on_receive(
     void *context),            // optional context
   void *on_receive_context); // optional on_receive() context
 //-----------------------------------------------------------------------------
+// set callback on receive packet with metadata (Lora/FSK/OOK)
+// (metadata registers are read by the same burst as IRQ flags in LoRa mode;
+// if set then it is called instead of on_receive())
+void sx127x_on_receive_ex(
+  sx127x_t *self,
+  void (*on_receive_ex)(        // receive callback with metadata or NULL
+    sx127x_t *self,               // pointer to sx127x_t object
+    u8_t *payload,                // payload data
+    u8_t payload_size,            // payload size
+    bool crc,                     // CRC ok/false
+    const sx127x_rx_meta_t *meta, // packet metadata
+    void *context),               // optional context
+  void *on_receive_ex_context); // optional on_receive_ex() context
+//-----------------------------------------------------------------------------
+// set timestamp of DIO0 IRQ edge [ns] (call before sx127x_irq_handler())
+// (e.g. CLOCK_MONOTONIC of GPIO edge event, 0 - unknown)
+void sx127x_irq_time(sx127x_t *self, u64_t ns);
+//-----------------------------------------------------------------------------
+// set vectored SPI exchange function (NULL by default after sx127x_init())
+// (segments are exchanged by one call, e.g. by one ioctl(SPI_IOC_MESSAGE(n)))
+void sx127x_spi_exchange_v(
+  sx127x_t *self,
+  int (*spi_exchange_v)(      // vectored SPI exchange function or NULL
+    const sx127x_seg_t *seg,    // segments (one chip select frame per segment)
+    int n,                      // number of segments (n <= SX127X_SEG_MAX)
+    void *context));            // optional SPI context or NULL
+//-----------------------------------------------------------------------------
+// set callback on transmit done (LoRa/FSK/OOK)
+// (called from sx127x_irq_handler() or from sx127x_send() on timeout)
+void sx127x_on_transmit(
+  sx127x_t *self,
+  void (*on_transmit)(        // transmit done callback or NULL
+    sx127x_t *self,             // pointer to sx127x_t object
+    bool ok,                    // true - TX done, false - timeout
+    void *context),             // optional context
+  void *on_transmit_context); // optional on_transmit() context
+//-----------------------------------------------------------------------------
+// set OS hooks to sleep in sx127x_send() until TX done IRQ on DIO0
+// (tx_wait() return 0 if TX done or < 0 by timeout; NULL - busy polling)
+void sx127x_tx_hooks(
+  sx127x_t *self,
+  int (*tx_wait)(             // sleep until TX done or timeout hook
+    sx127x_t *self,             // pointer to sx127x_t object
+    u32_t timeout_ms,           // timeout [ms]
+    void *context),             // optional context
+  void (*tx_wake)(            // wake up thread sleeping in tx_wait()
+    sx127x_t *self,             // pointer to sx127x_t object
+    void *context),             // optional context
+  void *tx_context);          // optional tx_wait()/tx_wake() context
+//-----------------------------------------------------------------------------
+// set OS hook of monotonic time for TX done timeout of busy waiting
+// (NULL - timeout by SX127X_POLL_PER_MS register polls, by default)
+void sx127x_time_hook(
+  sx127x_t *self,
+  u64_t (*time_ns)(           // get monotonic time [ns] hook or NULL
+    sx127x_t *self,             // pointer to sx127x_t object
+    void *context),             // optional context
+  void *time_context);        // optional time_ns() context
+//-----------------------------------------------------------------------------
+#ifdef SX127X_USE_LOCK
+// set OS hooks of SPI bus lock shared by IRQ handlers and application
+// threads (bus_lock() must be recursive, e.g. PTHREAD_MUTEX_RECURSIVE;
+// NULL - no locking, by default after sx127x_init())
+void sx127x_lock_hooks(
+  sx127x_t *self,
+  int (*bus_lock)(            // lock SPI bus hook (return 0 if locked)
+    sx127x_t *self,             // pointer to sx127x_t object
+    bool wait,                  // true - wait, false - try lock
+    void *context),             // optional context
+  void (*bus_unlock)(         // unlock SPI bus hook
+    sx127x_t *self,             // pointer to sx127x_t object
+    void *context),             // optional context
+  void *bus_context);         // optional bus_lock()/bus_unlock() context
+//-----------------------------------------------------------------------------
+// begin atomic transaction: lock SPI bus (may be nested)
+// (every driver function locks bus itself; do not call sx127x_send() or
+// sx127x_send_long() inside transaction - IRQ handler waits TX done then)
+void sx127x_lock(sx127x_t *self);
+//-----------------------------------------------------------------------------
+// end atomic transaction: unlock SPI bus
+void sx127x_unlock(sx127x_t *self);
+//-----------------------------------------------------------------------------
+// get SPI bus lock statistics (reset it if `reset` is true)
+void sx127x_lock_stat(sx127x_t *self, sx127x_lock_stat_t *stat, bool reset);
+#endif
+//-----------------------------------------------------------------------------
 // write SX127x 8-bit register to SPI
 void sx127x_write_reg(sx127x_t *self, u8_t address, u8_t value);
 //----------------------------------------------------------------------------
 // read SX127x 8-bit register from SPI
 u8_t sx127x_read_reg(sx127x_t *self, u8_t address);
 //----------------------------------------------------------------------------
+// read `size` bytes from SX127x FIFO (address=0) or registers by burst mode
+// (one SPI transaction per SX127X_BURST_MAX bytes)
+void sx127x_read_burst(sx127x_t *self, u8_t address, u8_t *data, int size);
+//----------------------------------------------------------------------------
+// write `size` bytes to SX127x FIFO (address=0) or registers by burst mode
+// (one SPI transaction per SX127X_BURST_MAX bytes)
+void sx127x_write_burst(sx127x_t *self, u8_t address,
+                        const u8_t *data, int size);
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_CACHE
+// on/off shadow register cache (on by default after sx127x_init())
+void sx127x_cache_on(sx127x_t *self, bool on);
+//----------------------------------------------------------------------------
+// reload shadow register cache from SX127x chip by one SPI burst
+void sx127x_cache_sync(sx127x_t *self);
+//----------------------------------------------------------------------------
+// invalidate shadow register cache (call after hard reset of SX127x chip)
+void sx127x_cache_reset(sx127x_t *self);
+#endif
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_BATCH
+// begin batch of register writes (may be nested)
+// all configuration register writes are queued until sx127x_batch_commit()
+void sx127x_batch_begin(sx127x_t *self);
+//----------------------------------------------------------------------------
+// commit batch of register writes (return number of SPI transactions)
+// pending writes are sorted by address and merged to burst writes
+int sx127x_batch_commit(sx127x_t *self);
+#endif
+//----------------------------------------------------------------------------
 // setup SX127x radio module (uses from sx127x_init())
 void sx127x_set_pars(
   sx127x_t *self,
@@ -224,6 +924,11 @@ void sx127x_tx(sx127x_t *self);
 // switch to RX (continuous) mode
 void sx127x_rx(sx127x_t *self);
 //----------------------------------------------------------------------------
+#ifdef SX127X_USE_LORA
+// switch to RX single mode (LoRa): standby by `RxDone` or `RxTimeout`
+void sx127x_rx_single(sx127x_t *self);
+#endif
+//----------------------------------------------------------------------------
 #if defined(SX127X_USE_LORA) && defined(SX127X_USE_EXTRA)
 // switch to CAD (LoRa) mode
 void sx127x_cad(sx127x_t *self);
@@ -237,6 +942,20 @@ u32_t sx127x_set_frequency(sx127x_t *self, u32_t freq);
 u32_t sx127x_get_frequency(sx127x_t *self);
 #endif
 //----------------------------------------------------------------------------
+#ifdef SX127X_USE_PLAN
+// convert `n` RF frequencies [Hz] of channel plan to `Frf` codes once
+// (return number of channels)
+int sx127x_plan_init(sx127x_plan_t *plan, const u32_t *freq, int n);
+//----------------------------------------------------------------------------
+// set channel plan of module (NULL - no plan)
+void sx127x_set_plan(sx127x_t *self, const sx127x_plan_t *plan);
+//----------------------------------------------------------------------------
+// set RF frequency by channel of plan: one 3 byte burst of cached `Frf`
+// (call sx127x_update_band() if plan crosses LF/HF bands;
+//  return RF frequency [Hz], 0 - no plan or bad channel)
+u32_t sx127x_set_channel(sx127x_t *self, int ch);
+#endif
+//----------------------------------------------------------------------------
 // update band after change RF frequency from one band to another
 void sx127x_update_band(sx127x_t *self);
 //----------------------------------------------------------------------------
@@ -311,6 +1030,12 @@ void sx127x_set_ldro(sx127x_t *self, bool ldro);
 // set preamble length [6...65535] (LoRa)
 void sx127x_set_preamble(sx127x_t *self, u16_t length);
 //----------------------------------------------------------------------------
+// set RX single timeout 4...1023 symbols (`RegSymbTimeout`, LoRa)
+void sx127x_set_symb_timeout(sx127x_t *self, u16_t symbols);
+//----------------------------------------------------------------------------
+// get duration of symbol [us] by SF and BW (LoRa)
+u32_t sx127x_symbol_us(const sx127x_t *self);
+//----------------------------------------------------------------------------
 // set Sync Word (LoRa)
 void sx127x_set_sw(sx127x_t *self, u8_t sw);
 //----------------------------------------------------------------------------
@@ -318,6 +1043,25 @@ void sx127x_set_sw(sx127x_t *self, u8_t sw);
 void sx127x_invert_iq(sx127x_t *self, bool invert);
 #endif
 //----------------------------------------------------------------------------
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_FHSS)
+// set FHSS hop period 1...255 symbols (LoRa, 0 - FHSS off)
+void sx127x_set_hop_period(sx127x_t *self, u8_t period);
+//----------------------------------------------------------------------------
+// set FHSS hop table: `n` channel frequencies [Hz] are converted to `Frf`
+// codes once; channel 0 is used at start of each packet, channel of hop N
+// is `freq[N % n]` by hop counter of driver (also past 64 hops of 6-bit
+// `FhssPresentChannel`) (return number of channels, 0 - table off)
+int sx127x_fhss_table(sx127x_t *self, const u32_t *freq, int n);
+//----------------------------------------------------------------------------
+// IRQ handler of `FhssChangeChannel` (DIO2 line by default mapping, LoRa):
+// write `Frf` of next channel, read `FhssPresentChannel` and clear IRQ flag
+// by one vectored SPI exchange (look sx127x_dio_handler())
+void sx127x_fhss_handler(sx127x_t *self);
+//----------------------------------------------------------------------------
+// get FHSS statistics (reset it if `reset` is true)
+void sx127x_fhss_stat(sx127x_t *self, sx127x_fhss_stat_t *stat, bool reset);
+#endif
+//----------------------------------------------------------------------------
 #ifdef SX127X_USE_FSKOOK
 // select Continuous mode, must use DIO2->DATA, DIO1->DCLK (FSK/OOK)
 void sx127x_continuous(sx127x_t *self, bool on);
@@ -351,18 +1095,221 @@ void sx127x_set_dcfree(sx127x_t *self, u8_t dcfree);
 void sx127x_set_fast_hop(sx127x_t *self, bool on);
 #endif
 //----------------------------------------------------------------------------
-// send packet (LoRa/FSK/OOK)
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_SWEEP)
+// on/off RSSI sweep (FSK/OOK): `bins` channels from `freq` [Hz] by `step`
+// [Hz] in RX mode with fast hop; call sx127x_sweep_step() by OS timer each
+// dwell time, power vectors of sweeps go to lock-free ring
+// (dwell time = PLL lock + RSSI settling by `RssiSmoothing` and RX BW;
+//  return dwell time [us], 0 - off or LoRa mode)
+u32_t sx127x_sweep(sx127x_t *self, bool on, u32_t freq, u32_t step, int bins);
+//----------------------------------------------------------------------------
+// dwell time expired: read RSSI of current bin and hop to next bin by one
+// vectored SPI exchange (call it by OS timer, `time_ns` - current time)
+void sx127x_sweep_step(sx127x_t *self, u64_t time_ns);
+//----------------------------------------------------------------------------
+// get oldest power vector of sweep ring or NULL if ring is empty (consumer)
+// (vector is valid until sx127x_sweep_pop())
+const sx127x_sweep_vec_t *sx127x_sweep_peek(sx127x_t *self);
+//----------------------------------------------------------------------------
+// free oldest power vector of sweep ring (consumer)
+void sx127x_sweep_pop(sx127x_t *self);
+//----------------------------------------------------------------------------
+// get RSSI sweep statistics (reset it if `reset` is true)
+void sx127x_sweep_stat(sx127x_t *self, sx127x_sweep_stat_t *stat, bool reset);
+#endif
+//----------------------------------------------------------------------------
+// get time on air of packet with `size` bytes payload [us] (LoRa/FSK/OOK)
+// (computed by cached parameters of active configuration, look sx127x_toa_t)
+u32_t sx127x_airtime_us(const sx127x_t *self, int size);
+//----------------------------------------------------------------------------
+// get time on air of packet with `size` bytes payload [ms] (rounded up)
+u32_t sx127x_airtime_ms(const sx127x_t *self, int size);
+//----------------------------------------------------------------------------
+// get time on air statistics (reset it if `reset` is true)
+void sx127x_air_stat(sx127x_t *self, sx127x_air_stat_t *stat, bool reset);
+//----------------------------------------------------------------------------
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_EXTRA) && \
+    defined(SX127X_USE_ADR)
+// on/off adaptive data rate (LoRa): keep SNR `margin` [dB] over demodulator
+// limit with TX power up to `power_max` [dBm]; link history is cleared
+// (return TX power set [dBm])
+i8_t sx127x_adr(sx127x_t *self, bool on, u8_t margin, i8_t power_max);
+//----------------------------------------------------------------------------
+// put received frame of `peer` to link history (call it from on_receive_ex()
+// or RX ring consumer; `tx_power` - TX power of peer [dBm] by protocol)
+void sx127x_adr_rx(sx127x_t *self, u32_t peer,
+                   const sx127x_rx_meta_t *meta, i8_t tx_power);
+//----------------------------------------------------------------------------
+// choose fastest BW/SF/power by worst link of `peer` history and apply it
+// by one batch in standby mode (call it between packets); `size` - payload
+// size to compare time on air, `adr` - decision or NULL
+// (return expected time on air saved per packet [us], 0 - no change)
+i32_t sx127x_adr_apply(sx127x_t *self, u32_t peer, int size,
+                       sx127x_adr_t *adr);
+#endif
+//----------------------------------------------------------------------------
+// send packet and wait TX done (LoRa/FSK/OOK)
 // fixed - implicit header mode (LoRa), fixed packet length (FSK/OOK)
+// (return SX127X_ERR_TIMEOUT if TX done is not received in time on air,
+//  SX127X_ERR_BUSY if asynchronous TX queue is draining)
 i16_t sx127x_send(sx127x_t *self, const u8_t *data, i16_t size, bool fixed);
 //----------------------------------------------------------------------------
+#ifdef SX127X_USE_QUEUE
+// set callback on frame of asynchronous TX queue sent (LoRa/FSK/OOK)
+// (called from sx127x_irq_handler() or sx127x_txq_poll())
+void sx127x_on_sent(
+  sx127x_t *self,
+  void (*on_sent)(          // frame sent callback or NULL
+    sx127x_t *self,           // pointer to sx127x_t object
+    void *frame,              // frame context from sx127x_send_async()
+    i16_t status,             // SX127X_ERR_NONE or error code
+    u32_t airtime_ms,         // computed time on air [ms]
+    void *context),           // optional context
+  void *on_sent_context);   // optional on_sent() context
+//----------------------------------------------------------------------------
+// put packet to asynchronous TX queue and return immediately (LoRa/FSK/OOK);
+// queue is drained back-to-back on TX done IRQ, then go to RX mode
+// (return SX127X_ERR_FULL if queue is full)
+i16_t sx127x_send_async(sx127x_t *self, const u8_t *data, i16_t size,
+                        bool fixed, void *frame);
+//----------------------------------------------------------------------------
+// return number of frames in asynchronous TX queue (0 - queue is empty)
+int sx127x_txq_count(sx127x_t *self);
+//----------------------------------------------------------------------------
+// check TX done flag if IRQ on DIO0 is lost (call it periodically)
+void sx127x_txq_poll(sx127x_t *self);
+#endif
+//----------------------------------------------------------------------------
+#if defined(SX127X_USE_QUEUE) && defined(SX127X_USE_LBT)
+// set OS hook of one-shot timer for LBT backoff (timer calls sx127x_lbt_wake())
+void sx127x_lbt_hooks(
+  sx127x_t *self,
+  void (*lbt_timer)(        // start one-shot OS timer hook or NULL
+    sx127x_t *self,           // pointer to sx127x_t object
+    u32_t delay_us,           // delay [us]
+    void *context),           // optional context
+  void *lbt_context);       // optional lbt_timer() context
+//----------------------------------------------------------------------------
+// on/off listen before talk in asynchronous TX queue: each frame is sent
+// after CAD (LoRa) or RSSI <= `rssi` [dBm] (FSK/OOK) finds channel clear,
+// else random backoff of 1...2**BE slots is waited in RX mode and BE grows
+// (`slot_us` = 0 - 2 symbols in LoRa or SX127X_LBT_SENSE_US in FSK/OOK;
+//  return slot [us], 0 - off or lbt_timer() hook is not set)
+u32_t sx127x_lbt(sx127x_t *self, bool on, u32_t slot_us, i16_t rssi);
+//----------------------------------------------------------------------------
+// LBT timer expired: check channel again (call it by lbt_timer() OS timer)
+void sx127x_lbt_wake(sx127x_t *self);
+//----------------------------------------------------------------------------
+// get listen before talk statistics (reset it if `reset` is true)
+void sx127x_lbt_stat(sx127x_t *self, sx127x_lbt_stat_t *stat, bool reset);
+#endif
+//----------------------------------------------------------------------------
 // go to RX mode; wait callback by interrupt (LoRa/FSK/OOK)
 // LoRa:    if pkt_len = 0 then explicit header mode, else - implicit
 // FSK/OOK: if pkt_len = 0 then variable packet length, else - fixed
 void sx127x_receive(sx127x_t *self, i16_t pkt_len);
 //----------------------------------------------------------------------------
-// IRQ handler on DIO0 pin
+#if defined(SX127X_USE_LORA) && defined(SX127X_USE_DUTY)
+// on/off duty-cycled receive (LoRa, after sx127x_receive()): sleep and open
+// RX single window of `window` symbols (0 - SX127X_DUTY_WINDOW) each period;
+// period is sized by preamble length, SF and BW so that preamble of packet
+// covers one RX window at least (TX side must use same long preamble)
+// (return period [us] for OS timer, 0 - off or preamble is too short)
+u32_t sx127x_rx_duty(sx127x_t *self, bool on, u16_t window);
+//----------------------------------------------------------------------------
+// open RX window of duty-cycled receive (call it by OS timer each period;
+// `ns` - current time [ns] by same clock as sx127x_irq_time())
+void sx127x_rx_duty_wake(sx127x_t *self, u64_t ns);
+//----------------------------------------------------------------------------
+// get duty-cycled receive statistics (measured radio on time)
+void sx127x_rx_duty_stat(const sx127x_t *self, sx127x_duty_stat_t *stat);
+#endif
+//----------------------------------------------------------------------------
+// IRQ handler on DIO0 pin (RX done or TX done)
 void sx127x_irq_handler(sx127x_t *self);
 //----------------------------------------------------------------------------
+#ifdef SX127X_USE_RXQ
+// on/off RX ring: received frames with metadata are put to lock-free ring
+// by sx127x_irq_handler() instead of on_receive()/on_receive_ex() callbacks
+// (one producer - IRQ thread, one consumer - sx127x_rxq_peek()/pop())
+void sx127x_rxq_on(
+  sx127x_t *self,
+  bool on,                  // true - RX ring on, false - callbacks
+  void (*rxq_notify)(       // frame is put to RX ring callback or NULL
+    sx127x_t *self,           // pointer to sx127x_t object
+    void *context),           // optional context
+  void *rxq_context);       // optional rxq_notify() context
+//----------------------------------------------------------------------------
+// get oldest frame of RX ring or NULL if ring is empty (consumer)
+// (frame is valid until sx127x_rxq_pop())
+const sx127x_rx_frame_t *sx127x_rxq_peek(sx127x_t *self);
+//----------------------------------------------------------------------------
+// free oldest frame of RX ring (consumer)
+void sx127x_rxq_pop(sx127x_t *self);
+//----------------------------------------------------------------------------
+// return number of frames in RX ring (0 - ring is empty)
+int sx127x_rxq_count(sx127x_t *self);
+//----------------------------------------------------------------------------
+// get RX ring statistics: number of put and dropped (ring is full) frames
+void sx127x_rxq_stat(sx127x_t *self, u32_t *frames, u32_t *drops);
+#endif
+//----------------------------------------------------------------------------
+#if defined(SX127X_USE_FSKOOK) && defined(SX127X_USE_STREAM)
+// set callback on receive long packet (FSK/OOK)
+void sx127x_on_receive_long(
+  sx127x_t *self,
+  void (*on_receive_long)(          // receive long packet callback or NULL
+    sx127x_t *self,                   // pointer to sx127x_t object
+    u8_t *data,                       // user buffer
+    int size,                         // packet size
+    bool crc,                         // CRC ok/false
+    void *context),                   // optional context
+  void *on_receive_long_context);   // optional on_receive_long() context
+//----------------------------------------------------------------------------
+// send long packet by FIFO streaming and wait TX done (FSK/OOK)
+// (size <= SX127X_STREAM_MAX in fixed length mode, any in unlimited mode;
+//  FIFO is refilled by `FifoLevel` IRQ on DIO1, look sx127x_dio1_handler())
+// (return SX127X_ERR_BUSY if asynchronous TX queue is draining)
+i16_t sx127x_send_long(sx127x_t *self, const u8_t *data, int size,
+                       bool unlimited);
+//----------------------------------------------------------------------------
+// go to RX mode and receive long packet to user buffer by FIFO streaming;
+// wait on_receive_long() callback, then radio is in standby mode (FSK/OOK)
+// (size <= SX127X_STREAM_MAX in fixed length mode, any in unlimited mode)
+i16_t sx127x_receive_long(sx127x_t *self, u8_t *buf, int size,
+                          bool unlimited);
+//----------------------------------------------------------------------------
+// IRQ handler on DIO1 pin (`FifoLevel` or `FifoEmpty` in streaming mode)
+void sx127x_dio1_handler(sx127x_t *self);
+#endif
+//----------------------------------------------------------------------------
+#ifdef SX127X_USE_DIO
+// map event SX127X_EV_* to DIO line 0...5 in current mode (LoRa/FSK/OOK)
+// (write `RegDioMapping1/2`; return 0 or -1 if line can't signal event)
+int sx127x_dio_map(sx127x_t *self, int dio, int event);
+//----------------------------------------------------------------------------
+// get event SX127X_EV_* mapped to DIO line 0...5 (no SPI exchange)
+int sx127x_dio_event(const sx127x_t *self, int dio);
+//----------------------------------------------------------------------------
+// set callback on DIO line event (called from sx127x_dio_handler())
+void sx127x_on_event(
+  sx127x_t *self,
+  void (*on_event)(           // DIO line event callback or NULL
+    sx127x_t *self,             // pointer to sx127x_t object
+    int dio,                    // DIO line 0...5
+    int event,                  // SX127X_EV_*
+    void *context),             // optional context
+  void *on_event_context);    // optional on_event() context
+//----------------------------------------------------------------------------
+// IRQ handler on DIO line 0...5 (rising edge; any edge of DIO1 in FSK/OOK
+// streaming mode): event is known by mapping without reading IRQ flags;
+// RX/TX done go to sx127x_irq_handler(), FIFO events in streaming mode go
+// to sx127x_dio1_handler(), `FhssChangeChannel` goes to sx127x_fhss_handler()
+// if hop table is set, CAD of LBT goes to sx127x_irq_handler(), others go
+// to on_event() callback
+void sx127x_dio_handler(sx127x_t *self, int dio);
+#endif
+//----------------------------------------------------------------------------
 #if defined(SX127X_USE_LORA) && defined(SX127X_USE_EXTRA)
 // enable/disable interrupt by RX done for debug (LoRa)
 void sx127x_enable_rx_irq(sx127x_t *self, bool enable);
@@ -102,16 +102,27 @@
 #define REG_IRQ_FLAGS_MASK  0x11 // Optional IRQ flag mask
 #define REG_IRQ_FLAGS       0x12 // IRQ flags
 #define REG_RX_NB_BYTES     0x13 // Number of received bytes
+#define REG_RX_HDR_CNT_MSB  0x14 // Number of valid headers received, MSB
+#define REG_RX_HDR_CNT_LSB  0x15 // Number of valid headers received, LSB
+#define REG_RX_PKT_CNT_MSB  0x16 // Number of valid packets received, MSB
+#define REG_RX_PKT_CNT_LSB  0x17 // Number of valid packets received, LSB
+#define REG_MODEM_STAT      0x18 // Live LoRa modem status
 #define REG_PKT_SNR_VALUE   0x19 // SNR of last packet
 #define REG_PKT_RSSI_VALUE  0x1A // RSSI of last packet
 #define REG_LR_RSSI_VALUE   0x1B // Current RSSI
+#define REG_HOP_CHANNEL     0x1C // FHSS start channel
 #define REG_MODEM_CONFIG_1  0x1D // Modem PHY config 1
 #define REG_MODEM_CONFIG_2  0x1E // Modem PHY config 2
+#define REG_SYMB_TIMEOUT_LSB 0x1F // Receiver timeout value (LSB)
 #define REG_PREAMBLE_MSB    0x20 // Size of preamble (MSB)
 #define REG_PREAMBLE_LSB    0x21 // Size of preamble (LSB)
 #define REG_PAYLOAD_LENGTH  0x22 // LoRa TM payload length
 #define REG_MAX_PAYLOAD_LEN 0x23 // LoRa maximum payload length
+#define REG_HOP_PERIOD      0x24 // FHSS hop period [symbols] (0 - FHSS off)
 #define REG_MODEM_CONFIG_3  0x26 // Modem PHY config 3
+#define REG_LR_FEI_MSB      0x28 // Estimated frequency error, MSB
+#define REG_LR_FEI_MID      0x29 // Estimated frequency error, Mid
+#define REG_LR_FEI_LSB      0x2A // Estimated frequency error, LSB
 #define REG_RSSI_WIDEBAND   0x2C // Wideband RSSI meas-urement
 
 #define REG_DETECT_OPTIMIZE     0x31 // LoRa detection Optimize for SF=6
@@ -152,10 +163,21 @@
 #define IRQ_TX_DONE           0x08 // `TxDone`
 #define IRQ_RX_DONE           0x40 // `RxDone`
 #define IRQ_PAYLOAD_CRC_ERROR 0x20 // `PayloadCrcError`
+#define IRQ_RX_TIMEOUT        0x80 // `RxTimeout`
+#define IRQ_VALID_HEADER      0x10 // `ValidHeader`
+#define IRQ_CAD_DONE          0x04 // `CadDone`
+#define IRQ_FHSS_CHANGE       0x02 // `FhssChangeChannel`
+#define IRQ_CAD_DETECTED      0x01 // `CadDetected`
 
 // REG_IRQn_FLAGS (`RegIrqFlagsN` in datasheet) bits (FSK/OOK)
-#define IRQ1_RX_READY 0x40 // bit 6: `RxReady`
-#define IRQ1_TX_READY 0x20 // bit 5: `TxReady`
+#define IRQ1_MODE_READY      0x80 // bit 7: `ModeReady`
+#define IRQ1_RX_READY        0x40 // bit 6: `RxReady`
+#define IRQ1_TX_READY        0x20 // bit 5: `TxReady`
+#define IRQ1_PLL_LOCK        0x10 // bit 4: `PllLock`
+#define IRQ1_RSSI            0x08 // bit 3: `Rssi`
+#define IRQ1_TIMEOUT         0x04 // bit 2: `Timeout`
+#define IRQ1_PREAMBLE_DETECT 0x02 // bit 1: `PreambleDetect`
+#define IRQ1_SYNC_ADDRESS    0x01 // bit 0: `SyncAddressMatch`
 
 #define IRQ2_FIFO_FULL     0x80 // bit 7: `FifoFull`
 #define IRQ2_FIFO_EMPTY    0x40 // bit 6: `FifoEmpty`
@@ -170,6 +192,25 @@
 #define TX_START_FIFO_LEVEL   0x00 // bit 7: 0 -> `FifoLevel` (use `FifoThreshhold`)
 #define TX_START_FIFO_NOEMPTY 0x80 // bit 7: 1 -> `FifoEmpty` (start if FIFO no empty)
 
+// REG_DIO_MAPPING_1 (`RegDioMapping1` in datasheet) bits 7-6 (LoRa)
+#define DIO0_RX_DONE  0x00 // 0b00 -> `RxDone`
+#define DIO0_TX_DONE  0x40 // 0b01 -> `TxDone`
+#define DIO0_CAD_DONE 0x80 // 0b10 -> `CadDone`
+#define DIO0_MASK     0xC0 // `Dio0Mapping` bit mask
+
+// REG_DIO_MAPPING_1 bits 5-4 `Dio1Mapping` (FSK/OOK packet mode)
+#define DIO1_FIFO_LEVEL 0x00 // 0b00 -> `FifoLevel`
+#define DIO1_FIFO_EMPTY 0x10 // 0b01 -> `FifoEmpty`
+#define DIO1_FIFO_FULL  0x20 // 0b10 -> `FifoFull`
+#define DIO1_MASK       0x30 // `Dio1Mapping` bit mask
+
+// REG_DIO_MAPPING_2 (`RegDioMapping2` in datasheet) bit 0
+#define DIO_MAP_PREAMBLE_DETECT 0x01 // DIO4 0b11: 0 -> `Rssi`, 1 -> `PreambleDetect`
+
+// REG_FIFO_THRESH bits 5-0 `FifoThreshold`
+#define FIFO_THRESH_MASK    0x3F // `FifoThreshold` bit mask
+#define FIFO_THRESH_DEFAULT 0x0F // default `FifoThreshold`
+
 // REG_IRQ_FLAGS_MASK (`RegIrqFlagsMask` in datasheet) bits (LoRa)
 #define IRQ_RX_DONE_MASK 0x40 // bit 6: `RxDoneMask`
 
@@ -186,11 +227,15 @@
 #define FREQ_MAGIC_4 15625 // 625*25
 
 #define MAX_PKT_LENGTH 255 // maximum packet length [bytes]
+#define FIFO_SIZE      64  // FIFO size in FSK/OOK mode [bytes]
 
 // BandWith table [kHz] (LoRa)
 #define BW_TABLE {  7800, 10400,  15600,  20800,  31250, \
                    41700, 62500, 125000, 250000, 500000 }
 
+// 10*log10(500000 / BW) table of BW_TABLE [0.1 dB] (LoRa)
+#define BW_DB_TABLE { 181, 168, 151, 138, 120, 108, 90, 60, 30, 0 }
+
 // RX BandWith (mant/exp/Hz) table (FSK/OOK)
 #define RX_BW_TABLE {\
   {2, 7,   2600}, \
@@ -0,0 +1,874 @@
+/*
+ * -*- coding: UTF8 -*-
+ * Semtech SX127x famaly chips software model (simulator) for Linux
+ * File: "sx127x_sim.c"
+ */
+
+//-----------------------------------------------------------------------------
+#include "sx127x_sim.h"
+#include "sx127x_def.h"   // REG_*, MODE_*, IRQ_*
+#include <string.h>       // memset(), memcpy()
+#include <unistd.h>       // read(), write(), close()
+#include <sys/eventfd.h>  // eventfd()
+#include <time.h>         // clock_gettime()
+//-----------------------------------------------------------------------------
+// FSK/OOK `RegIrqFlags2` bits stored in model (others are FIFO state)
+#define SIM_IRQ2_STORED (IRQ2_FIFO_OVERRUN | IRQ2_PACKET_SENT | \
+                         IRQ2_PAYLOAD_READY | IRQ2_CRC_OK | IRQ2_LOW_BAT)
+
+// FSK/OOK `RegIrqFlags1` bits stored in model (others are mode state)
+#define SIM_IRQ1_STORED (IRQ1_RSSI | IRQ1_TIMEOUT | \
+                         IRQ1_PREAMBLE_DETECT | IRQ1_SYNC_ADDRESS)
+
+// `RegPacketConfig1`/`RegPacketConfig2` bits
+#define SIM_PACKET_FORMAT 0x80 // `PacketFormat` (1 - variable length)
+#define SIM_DATA_MODE     0x40 // `DataMode` (1 - packet mode)
+//-----------------------------------------------------------------------------
+// registers after reset {address, value} (look datasheet)
+static const u8_t sx127x_sim_defaults[][2] = {
+  {REG_OP_MODE,       MODE_LOW_FREQ_MODE_ON | MODE_STDBY},
+  {REG_BITRATE_MSB,   0x1A}, {REG_BITRATE_LSB, 0x0B}, // 4.8 kbit/s
+  {REG_FDEV_MSB,      0x00}, {REG_FDEV_LSB,    0x52}, // 5 kHz
+  {REG_FRF_MSB,       0x6C}, {REG_FRF_MID,     0x80}, // 434 MHz
+  {REG_FRF_LSB,       0x00},
+  {REG_PA_CONFIG,     0x4F}, {REG_PA_RAMP,     0x09},
+  {REG_OCP,           0x2B}, {REG_LNA,         0x20},
+  {REG_RX_CONFIG,     0x0E}, {REG_RSSI_CONFIG, 0x02},
+  {REG_RSSI_COLLISION, 0x0A}, {REG_RSSI_TRESH, 0xFF},
+  {REG_RX_BW,         0x15}, {REG_AFC_BW,      0x0B},
+  {REG_OOK_PEAK,      0x28}, {REG_OOK_FIX,     0x0C},
+  {REG_OOK_AVG,       0x12}, {REG_PREAMBLE_DETECT, 0x40},
+  {REG_OSC,           0x07}, {REG_PREAMBLE_L_LSB,  0x03},
+  {REG_SYNC_CONFIG,   0x93}, {REG_SYNC_VALUE_1,    0x01},
+  {REG_SYNC_VALUE_2,  0x01}, {REG_SYNC_VALUE_3,    0x01},
+  {REG_SYNC_VALUE_4,  0x01}, {REG_SYNC_VALUE_5,    0x01},
+  {REG_SYNC_VALUE_6,  0x01}, {REG_SYNC_VALUE_7,    0x01},
+  {REG_SYNC_VALUE_8,  0x01}, {REG_PACKET_CONFIG_1, 0x90},
+  {REG_PACKET_CONFIG_2, 0x40}, {REG_PAYLOAD_LEN,   0x40},
+  {REG_FIFO_THRESH,   TX_START_FIFO_NOEMPTY | FIFO_THRESH_DEFAULT},
+  {REG_TIMER_1_COEF,  0xF5}, {REG_TIMER_2_COEF,    0x20},
+  {REG_IMAGE_CAL,     0x82}, {REG_LOW_BAT,         0x02},
+  {REG_IRQ_FLAGS_2,   0x00},
+  {REG_VERSION,       0x12}, {REG_TCXO,            0x09},
+  {REG_PA_DAC,        0x84}, {REG_AGC_REF,         0x1C},
+  {REG_AGC_THRESH_1,  0x0E}, {REG_AGC_THRESH_2,    0x5B},
+  {REG_AGC_THRESH_3,  0xCC}, {REG_PLL,             0xD0},
+};
+
+// LoRa page registers after reset {address, value}
+static const u8_t sx127x_sim_lora_defaults[][2] = {
+  {REG_FIFO_TX_BASE_ADDR, 0x80}, {REG_MODEM_CONFIG_1,  0x72},
+  {REG_MODEM_CONFIG_2,    0x70}, {REG_PREAMBLE_LSB,    0x08},
+  {REG_PAYLOAD_LENGTH,    0x01}, {REG_MAX_PAYLOAD_LEN, 0xFF},
+  {REG_MODEM_CONFIG_3,    0x04}, {REG_DETECT_OPTIMIZE, 0xC3},
+  {REG_INVERT_IQ,         0x27}, {REG_DETECTION_THRESHOLD, 0x0A},
+  {REG_SYNC_WORD,         0x12}, {REG_SYMB_TIMEOUT_LSB, 0x64},
+};
+//-----------------------------------------------------------------------------
+// return true if model is in LoRa mode
+static bool sx127x_sim_is_lora(const sx127x_sim_t *sim)
+{
+  return (sim->reg[REG_OP_MODE] & MODE_LONG_RANGE) ? true : false;
+}
+//-----------------------------------------------------------------------------
+// return current mode MODE_* (bits 2-0 of `RegOpMode`)
+static u8_t sx127x_sim_mode(const sx127x_sim_t *sim)
+{
+  return sim->reg[REG_OP_MODE] & MODES_MASK;
+}
+//-----------------------------------------------------------------------------
+// return current time [ns] (CLOCK_MONOTONIC)
+static u64_t sx127x_sim_now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((u64_t) ts.tv_sec) * 1000000000ULL + (u64_t) ts.tv_nsec;
+}
+//-----------------------------------------------------------------------------
+// return LoRa symbol duration [ns] by `SpreadingFactor` and `Bw`
+static u64_t sx127x_sim_symbol_ns(const sx127x_sim_t *sim)
+{
+  static const u32_t bw[] = {7800, 10400, 15600, 20800, 31250, 41700,
+                             62500, 125000, 250000, 500000};
+  int i = SX127X_MIN(sim->lora[REG_MODEM_CONFIG_1] >> 4, 9);
+  int sf = sim->lora[REG_MODEM_CONFIG_2] >> 4;
+  return (1000000000ULL << sf) / bw[i];
+}
+//-----------------------------------------------------------------------------
+// channel is busy by interferer
+static bool sx127x_sim_busy_now(const sx127x_sim_t *sim)
+{
+  return sim->busy_end != 0 && sx127x_sim_now() < sim->busy_end;
+}
+//-----------------------------------------------------------------------------
+// return pointer to register by address (select LoRa or FSK/OOK page)
+static u8_t *sx127x_sim_reg(sx127x_sim_t *sim, u8_t addr)
+{
+  addr &= 0x7F;
+  if (addr >= 0x0D && addr <= 0x3F && sx127x_sim_is_lora(sim) &&
+      !(sim->reg[REG_OP_MODE] & MODE_ACCESS_SHARED_REG))
+    return &sim->lora[addr];
+  return &sim->reg[addr];
+}
+//-----------------------------------------------------------------------------
+// signal DIO event (eventfd + callback)
+static void sx127x_sim_raise(sx127x_sim_t *sim, int dio)
+{
+  unsigned long long one = 1;
+  sim->dio |= (u8_t) dio;
+  if (sim->fd >= 0 && write(sim->fd, &one, sizeof(one)) != sizeof(one))
+  { // counter saturates (EAGAIN): eventfd stays readable, event is not lost
+  }
+
+  if (sim->on_dio != (void (*)(sx127x_sim_t*, int, void*)) NULL)
+    sim->on_dio(sim, dio, sim->on_dio_context);
+}
+//-----------------------------------------------------------------------------
+// raise DIO0 event if `Dio0Mapping` selects the signal
+static void sx127x_sim_dio0(sx127x_sim_t *sim, u8_t map)
+{
+  if ((sim->reg[REG_DIO_MAPPING_1] & DIO0_MASK) == map)
+    sx127x_sim_raise(sim, SX127X_SIM_DIO0);
+}
+//-----------------------------------------------------------------------------
+// raise DIOn event if mapping of line 1...5 selects the signal (code 0...3)
+static void sx127x_sim_dio(sx127x_sim_t *sim, int dio, u8_t code)
+{
+  u8_t map = dio < 4 ? sim->reg[REG_DIO_MAPPING_1] >> (6 - 2 * dio) :
+                       sim->reg[REG_DIO_MAPPING_2] >> (14 - 2 * dio);
+  if ((map & 0x03) == code)
+    sx127x_sim_raise(sim, 1 << dio); // SX127X_SIM_DIO1...SX127X_SIM_DIO5
+}
+//-----------------------------------------------------------------------------
+// store captured TX packet and run callback
+static void sx127x_sim_capture(sx127x_sim_t *sim)
+{
+  int size = SX127X_MIN(sim->tx_size, SX127X_SIM_PACKET_MAX);
+  sim->tx_count++;
+
+  if (sim->on_tx != (void (*)(sx127x_sim_t*, const u8_t*, int, void*)) NULL)
+    sim->on_tx(sim, sim->tx, size, sim->on_tx_context);
+}
+//-----------------------------------------------------------------------------
+// LoRa packet RSSI offset (F_LF<=525, F_HF>=779 MHz)
+static i16_t sx127x_sim_rssi_offset(const sx127x_sim_t *sim)
+{
+  u32_t frf = (((u32_t) sim->reg[REG_FRF_MSB]) << 16) |
+              (((u32_t) sim->reg[REG_FRF_MID]) <<  8) |
+               ((u32_t) sim->reg[REG_FRF_LSB]);
+  return frf < 0x960000 ? 164 : 157; // 0x960000 * FREQ_STEP = 600 MHz
+}
+//-----------------------------------------------------------------------------
+// clear FSK/OOK FIFO
+static void sx127x_sim_fsk_clear(sx127x_sim_t *sim)
+{
+  sim->fsk_head  = 0;
+  sim->fsk_count = 0;
+  sim->reg[REG_IRQ_FLAGS_2] &= ~(IRQ2_PAYLOAD_READY | IRQ2_CRC_OK);
+}
+//-----------------------------------------------------------------------------
+// write byte to FSK/OOK FIFO (set `FifoOverrun` if FIFO is full)
+static void sx127x_sim_fsk_push(sx127x_sim_t *sim, u8_t data)
+{
+  if (sim->fsk_count >= SX127X_SIM_FSK_FIFO)
+  {
+    sim->reg[REG_IRQ_FLAGS_2] |= IRQ2_FIFO_OVERRUN;
+    return;
+  }
+  sim->fsk[(sim->fsk_head + sim->fsk_count) % SX127X_SIM_FSK_FIFO] = data;
+  sim->fsk_count++;
+}
+//-----------------------------------------------------------------------------
+// read byte from FSK/OOK FIFO (`PayloadReady` is cleared on empty FIFO)
+static u8_t sx127x_sim_fsk_pop(sx127x_sim_t *sim)
+{
+  u8_t data;
+  if (sim->fsk_count == 0) return 0;
+
+  data = sim->fsk[sim->fsk_head];
+  sim->fsk_head = (sim->fsk_head + 1) % SX127X_SIM_FSK_FIFO;
+  if (--sim->fsk_count == 0 && sim->rx_ready)
+  { // packet is read
+    sim->reg[REG_IRQ_FLAGS_2] &= ~(IRQ2_PAYLOAD_READY | IRQ2_CRC_OK);
+    sim->rx_ready = false;
+    sim->rx_size  = 0;
+  }
+  return data;
+}
+//-----------------------------------------------------------------------------
+// get level of DIO1 line by `Dio1Mapping` (FSK/OOK)
+static u8_t sx127x_sim_dio1_level(const sx127x_sim_t *sim)
+{
+  u8_t map    = sim->reg[REG_DIO_MAPPING_1] & DIO1_MASK;
+  int  thresh = sim->reg[REG_FIFO_THRESH] & FIFO_THRESH_MASK;
+
+  if (map == DIO1_FIFO_LEVEL) return sim->fsk_count > thresh;
+  if (map == DIO1_FIFO_EMPTY) return sim->fsk_count == 0;
+  if (map == DIO1_FIFO_FULL)  return sim->fsk_count >= SX127X_SIM_FSK_FIFO;
+  return 0;
+}
+//-----------------------------------------------------------------------------
+// raise DIO1 event on both edges of DIO1 line (FSK/OOK)
+static void sx127x_sim_dio1_edge(sx127x_sim_t *sim)
+{
+  u8_t level = sx127x_sim_dio1_level(sim);
+  if (level != sim->dio1_level)
+  {
+    sim->dio1_level = level;
+    sx127x_sim_raise(sim, SX127X_SIM_DIO1);
+  }
+}
+//-----------------------------------------------------------------------------
+// get expected size of FSK/OOK TX packet
+// (-1 - variable length, wait length byte; 0 - unlimited)
+static int sx127x_sim_fsk_len(const sx127x_sim_t *sim)
+{
+  if (sim->reg[REG_PACKET_CONFIG_1] & SIM_PACKET_FORMAT)
+    return -1; // variable length
+  return (((int) (sim->reg[REG_PACKET_CONFIG_2] & 0x07)) << 8) |
+         (int) sim->reg[REG_PAYLOAD_LEN];
+}
+//-----------------------------------------------------------------------------
+// shift out FSK/OOK FIFO in TX mode (transmitter drains FIFO at once)
+static void sx127x_sim_fsk_tx(sx127x_sim_t *sim)
+{
+  int n = 0;
+
+  if (!(sim->reg[REG_PACKET_CONFIG_2] & SIM_DATA_MODE))
+    return; // continuous mode: data on DIO2, FIFO is not used
+
+  if (sim->reg[REG_IRQ_FLAGS_2] & IRQ2_PACKET_SENT)
+    return; // wait exit from TX mode
+
+  while (sim->fsk_count > 0 && (sim->tx_len <= 0 || sim->tx_size < sim->tx_len))
+  {
+    u8_t data = sx127x_sim_fsk_pop(sim);
+    if (sim->tx_size < SX127X_SIM_PACKET_MAX)
+      sim->tx[sim->tx_size] = data;
+    if (sim->tx_len < 0 && sim->tx_size == 0)
+      sim->tx_len = 1 + (int) data; // length byte
+    sim->tx_size++;
+    n++;
+  }
+
+  if (n == 0) return;
+
+  if (sim->tx_len > 0 && sim->tx_size >= sim->tx_len)
+  { // `PacketSent`
+    sim->reg[REG_IRQ_FLAGS_2] |= IRQ2_PACKET_SENT;
+    sx127x_sim_capture(sim);
+    sx127x_sim_dio0(sim, DIO0_RX_DONE); // 0b00 -> `PacketSent` in TX
+  }
+  else // level falls to zero, FIFO may be refilled
+    sx127x_sim_raise(sim, SX127X_SIM_DIO1);
+}
+//-----------------------------------------------------------------------------
+// move injected FSK/OOK packet to FIFO in RX mode
+static void sx127x_sim_fsk_rx(sx127x_sim_t *sim)
+{
+  while (sim->fsk_count < SX127X_SIM_FSK_FIFO && sim->rx_pos < sim->rx_size)
+    sx127x_sim_fsk_push(sim, sim->rx[sim->rx_pos++]);
+
+  if (sim->rx_size == 0 || sim->rx_pos < sim->rx_size || sim->rx_ready)
+    return;
+
+  sim->rx_ready = true;
+  if (sx127x_sim_fsk_len(sim) != 0)
+  { // `PayloadReady` (no `PayloadReady` in unlimited length mode)
+    sim->reg[REG_IRQ_FLAGS_2] |= IRQ2_PAYLOAD_READY |
+                                 (sim->rx_crc ? IRQ2_CRC_OK : 0);
+    sx127x_sim_dio0(sim, DIO0_RX_DONE); // 0b00 -> `PayloadReady` in RX
+  }
+}
+//-----------------------------------------------------------------------------
+// run FSK/OOK FIFO machine after SPI transaction or inject
+static void sx127x_sim_update(sx127x_sim_t *sim)
+{
+  u8_t mode;
+
+  if (sx127x_sim_is_lora(sim)) return;
+
+  sx127x_sim_dio1_edge(sim); // edge by SPI FIFO access
+
+  mode = sx127x_sim_mode(sim);
+  if (mode == MODE_TX)
+    sx127x_sim_fsk_tx(sim);
+  else if (mode == MODE_RX_CONTINUOUS)
+    sx127x_sim_fsk_rx(sim);
+
+  sx127x_sim_dio1_edge(sim); // edge by TX/RX
+}
+//-----------------------------------------------------------------------------
+// end of LoRa packet: standby after TX or RX single, set IRQ flags, raise DIO
+static void sx127x_sim_lora_end(sx127x_sim_t *sim, u8_t irq, u8_t dio0)
+{
+  u8_t mode = sx127x_sim_mode(sim);
+
+  if (mode == MODE_TX || mode == MODE_RX_SINGLE)
+    sim->reg[REG_OP_MODE] = (sim->reg[REG_OP_MODE] & ~MODES_MASK) |
+                            MODE_STDBY;
+
+  sim->hop_left = -1;
+  sim->lora[REG_IRQ_FLAGS] |= irq;
+  if (irq & IRQ_PAYLOAD_CRC_ERROR)
+    sx127x_sim_dio(sim, 3, 2); // `PayloadCrcError` on DIO3 (0b10)
+  sx127x_sim_dio0(sim, dio0);
+}
+//-----------------------------------------------------------------------------
+// return number of FHSS hops of LoRa packet (header and payload symbols
+// by `RegHopPeriod`, 0 - FHSS off)
+static int sx127x_sim_lora_hops(const sx127x_sim_t *sim, int size)
+{
+  u8_t cfg1 = sim->lora[REG_MODEM_CONFIG_1];
+  u8_t cfg2 = sim->lora[REG_MODEM_CONFIG_2];
+  int sf = cfg2 >> 4, cr = ((cfg1 >> 1) & 0x07) + 4;
+  int de = (sim->lora[REG_MODEM_CONFIG_3] >> 3) & 1;
+  int n  = 8 * size - 4 * sf + 28 + 16 * ((cfg2 >> 2) & 1) - 20 * (cfg1 & 1);
+  int d  = 4 * SX127X_MAX(sf - 2 * de, 1);
+
+  if (sim->lora[REG_HOP_PERIOD] == 0)
+    return 0;
+
+  n = n > 0 ? ((n + d - 1) / d) * cr : 0;
+  return (8 + n) / sim->lora[REG_HOP_PERIOD];
+}
+//-----------------------------------------------------------------------------
+// FHSS hop of LoRa packet: next `FhssPresentChannel`, `FhssChangeChannel`
+// on DIO1 (0b01) or DIO2 (0b00...0b10); end of packet after last hop
+// (next hop is done when `FhssChangeChannel` is cleared by host)
+static void sx127x_sim_lora_hop(sx127x_sim_t *sim)
+{
+  u8_t ch = sim->lora[REG_HOP_CHANNEL];
+
+  if (sim->hop_left <= 0)
+  {
+    sx127x_sim_lora_end(sim, sim->hop_irq, sim->hop_dio0);
+    return;
+  }
+
+  sim->hop_left--;
+  sim->hop_count++;
+  sim->hop_frf = false;
+  sim->lora[REG_HOP_CHANNEL] = (ch & ~0x3F) | ((ch + 1) & 0x3F);
+  sim->lora[REG_IRQ_FLAGS] |= IRQ_FHSS_CHANGE;
+  sx127x_sim_dio(sim, 1, 1);
+  sx127x_sim_dio(sim, 2, 0);
+  sx127x_sim_dio(sim, 2, 1);
+  sx127x_sim_dio(sim, 2, 2);
+}
+//-----------------------------------------------------------------------------
+// start FHSS hops of LoRa packet from channel 0 or end packet at once
+static void sx127x_sim_lora_hops_start(sx127x_sim_t *sim, int size,
+                                       u8_t irq, u8_t dio0)
+{
+  sim->lora[REG_HOP_CHANNEL] &= ~0x3F;
+  sim->hop_left = sx127x_sim_lora_hops(sim, size);
+  sim->hop_irq  = irq;
+  sim->hop_dio0 = dio0;
+  sim->hop_frf  = true;
+  sx127x_sim_lora_hop(sim);
+}
+//-----------------------------------------------------------------------------
+// transmit LoRa packet from FIFO at once, go to standby (after last hop)
+static void sx127x_sim_lora_tx(sx127x_sim_t *sim)
+{
+  u8_t addr = sim->lora[REG_FIFO_TX_BASE_ADDR];
+  int i, size = (int) sim->lora[REG_PAYLOAD_LENGTH];
+
+  for (i = 0; i < size; i++)
+    sim->tx[i] = sim->fifo[(u8_t) (addr + i)];
+  sim->tx_size = size;
+
+  sx127x_sim_capture(sim);
+  sx127x_sim_lora_hops_start(sim, size, IRQ_TX_DONE, DIO0_TX_DONE);
+}
+//-----------------------------------------------------------------------------
+// run LoRa CAD at once, go to standby
+static void sx127x_sim_lora_cad(sx127x_sim_t *sim)
+{
+  bool cad = sim->cad || sx127x_sim_busy_now(sim);
+  sim->reg[REG_OP_MODE] = (sim->reg[REG_OP_MODE] & ~MODES_MASK) | MODE_STDBY;
+  sim->lora[REG_IRQ_FLAGS] |= IRQ_CAD_DONE |
+                              (cad ? IRQ_CAD_DETECTED : 0);
+  if (cad)
+  { // `CadDetected` on DIO1 (0b10) or DIO4 (0b00)
+    sx127x_sim_dio(sim, 1, 2);
+    sx127x_sim_dio(sim, 4, 0);
+  }
+  sx127x_sim_dio(sim, 3, 0); // `CadDone` on DIO3 (0b00)
+  sx127x_sim_dio0(sim, DIO0_CAD_DONE);
+}
+//-----------------------------------------------------------------------------
+// receive LoRa packet at once: write it to FIFO from `FifoRxBaseAddr`
+static void sx127x_sim_lora_rx(sx127x_sim_t *sim, const u8_t *data, int size,
+                               bool crc, i16_t rssi, i16_t snr)
+{
+  u8_t addr = sim->lora[REG_FIFO_RX_BASE_ADDR];
+  u16_t cnt;
+  int i;
+
+  for (i = 0; i < size; i++)
+    sim->fifo[(u8_t) (addr + i)] = data[i];
+
+  sim->lora[REG_FIFO_RX_CURRENT_ADDR] = addr;
+  sim->lora[REG_FIFO_RX_BYTE_ADDR]    = (u8_t) (addr + size - 1);
+  sim->lora[REG_RX_NB_BYTES]          = (u8_t) size;
+  sim->lora[REG_PKT_SNR_VALUE]        = (u8_t) (i8_t) (snr * 4);
+  sim->lora[REG_PKT_RSSI_VALUE]       =
+    (u8_t) SX127X_LIMIT(rssi + sx127x_sim_rssi_offset(sim), 0, 255);
+
+  // header of packet: `RxCodingRate` and `CrcOnPayload` as configured
+  sim->lora[REG_MODEM_STAT] = (sim->lora[REG_MODEM_STAT] & 0x1F) |
+    ((sim->lora[REG_MODEM_CONFIG_1] & 0x0E) << 4);
+  sim->lora[REG_HOP_CHANNEL] = (sim->lora[REG_HOP_CHANNEL] & ~0x40) |
+    ((sim->lora[REG_MODEM_CONFIG_2] & 0x04) << 4);
+
+  // count valid headers and packets
+  cnt = (((u16_t) sim->lora[REG_RX_HDR_CNT_MSB]) << 8) +
+        sim->lora[REG_RX_HDR_CNT_LSB] + 1;
+  sim->lora[REG_RX_HDR_CNT_MSB] = (u8_t) (cnt >> 8);
+  sim->lora[REG_RX_HDR_CNT_LSB] = (u8_t) cnt;
+  if (crc)
+  {
+    cnt = (((u16_t) sim->lora[REG_RX_PKT_CNT_MSB]) << 8) +
+          sim->lora[REG_RX_PKT_CNT_LSB] + 1;
+    sim->lora[REG_RX_PKT_CNT_MSB] = (u8_t) (cnt >> 8);
+    sim->lora[REG_RX_PKT_CNT_LSB] = (u8_t) cnt;
+  }
+
+  // standby after `RxDone` in RX single (after last hop)
+  sim->lora[REG_IRQ_FLAGS] |= IRQ_VALID_HEADER;
+  sim->rx_count++;
+  sx127x_sim_dio(sim, 3, 1); // `ValidHeader` on DIO3 (0b01)
+  sx127x_sim_lora_hops_start(sim, size,
+                             IRQ_RX_DONE | (crc ? 0 : IRQ_PAYLOAD_CRC_ERROR),
+                             DIO0_RX_DONE);
+}
+//-----------------------------------------------------------------------------
+// LoRa RX single: `RxTimeout` after `RegSymbTimeout` symbols, go to standby
+// (checked on each access to model)
+static void sx127x_sim_lora_timeout(sx127x_sim_t *sim)
+{
+  if (!sx127x_sim_is_lora(sim) || sx127x_sim_mode(sim) != MODE_RX_SINGLE ||
+      sx127x_sim_now() < sim->rx_timeout)
+    return;
+
+  sim->reg[REG_OP_MODE] = (sim->reg[REG_OP_MODE] & ~MODES_MASK) | MODE_STDBY;
+  sim->lora[REG_IRQ_FLAGS] |= IRQ_RX_TIMEOUT;
+  sx127x_sim_dio(sim, 1, 0); // `RxTimeout` on DIO1 (0b00)
+}
+//-----------------------------------------------------------------------------
+// write `RegOpMode`: mode transitions
+static void sx127x_sim_op_mode(sx127x_sim_t *sim, u8_t value)
+{
+  u8_t old  = sim->reg[REG_OP_MODE];
+  u8_t mode = value & MODES_MASK;
+
+  // `LongRangeMode` may be changed in sleep mode only
+  if ((old & MODES_MASK) != MODE_SLEEP)
+    value = (value & ~MODE_LONG_RANGE) | (old & MODE_LONG_RANGE);
+  sim->reg[REG_OP_MODE] = value;
+
+  if (value & MODE_LONG_RANGE)
+  { // LoRa
+    if ((old & MODES_MASK) != mode)
+      sim->hop_left = -1; // packet is aborted by mode change
+
+    if (mode == MODE_TX)
+      sx127x_sim_lora_tx(sim);
+    else if (mode == MODE_CAD)
+      sx127x_sim_lora_cad(sim);
+    else if ((old & MODES_MASK) != mode &&
+             (mode == MODE_RX_SINGLE || mode == MODE_RX_CONTINUOUS))
+    { // start RX: timeout of RX single window, packet on air
+      u32_t symb = ((((u32_t) sim->lora[REG_MODEM_CONFIG_2]) & 0x03) << 8) |
+                   sim->lora[REG_SYMB_TIMEOUT_LSB];
+      sim->rx_timeout = sx127x_sim_now() + symb * sx127x_sim_symbol_ns(sim);
+      if (sim->air_size > 0 && sx127x_sim_now() < sim->air_end)
+        sx127x_sim_lora_rx(sim, sim->air, sim->air_size, sim->air_crc,
+                           sim->air_rssi, sim->air_snr);
+      sim->air_size = 0; // else preamble is missed
+    }
+    return;
+  }
+
+  // FSK/OOK: `PreambleDetect`, `SyncAddressMatch`... are cleared on mode change
+  if ((old & MODES_MASK) != mode)
+    sim->reg[REG_IRQ_FLAGS_1] &= ~SIM_IRQ1_STORED;
+
+  if ((old & MODES_MASK) == MODE_TX && mode != MODE_TX)
+  { // exit from TX: unlimited length packet is finished by user
+    if (sim->tx_len == 0 && sim->tx_size > 0)
+      sx127x_sim_capture(sim);
+    sim->reg[REG_IRQ_FLAGS_2] &= ~IRQ2_PACKET_SENT;
+  }
+  else if ((old & MODES_MASK) != MODE_TX && mode == MODE_TX)
+  { // start TX (FIFO is drained in sx127x_sim_update())
+    sim->tx_size = 0;
+    sim->tx_len  = sx127x_sim_fsk_len(sim);
+    sim->reg[REG_IRQ_FLAGS_2] &= ~IRQ2_PACKET_SENT;
+  }
+}
+//-----------------------------------------------------------------------------
+// read register with side effects
+static u8_t sx127x_sim_read(sx127x_sim_t *sim, u8_t addr)
+{
+  bool lora = sx127x_sim_is_lora(sim);
+  u8_t mode = sx127x_sim_mode(sim);
+  u8_t *reg = sx127x_sim_reg(sim, addr);
+
+  if (addr == REG_FIFO)
+  {
+    if (lora) return sim->fifo[sim->lora[REG_FIFO_ADDR_PTR]++];
+    return sx127x_sim_fsk_pop(sim);
+  }
+
+  if (reg == &sim->lora[REG_LR_RSSI_VALUE])
+    return (u8_t) SX127X_LIMIT((sx127x_sim_busy_now(sim) ? sim->busy_rssi :
+                                sim->rssi) + sx127x_sim_rssi_offset(sim),
+                               0, 255);
+
+  if (reg == &sim->reg[REG_RSSI_VALUE] && !lora && sx127x_sim_busy_now(sim))
+    return (u8_t) SX127X_LIMIT(-2 * sim->busy_rssi, 0, 255);
+
+  if (reg == &sim->reg[REG_IRQ_FLAGS_1])
+    return (*reg & SIM_IRQ1_STORED) | IRQ1_MODE_READY |
+           (mode == MODE_RX_CONTINUOUS ? IRQ1_RX_READY : 0) |
+           (mode == MODE_TX ? IRQ1_TX_READY : 0) |
+           (mode >= MODE_FS_TX ? IRQ1_PLL_LOCK : 0);
+
+  if (reg == &sim->reg[REG_IRQ_FLAGS_2])
+  {
+    int thresh = sim->reg[REG_FIFO_THRESH] & FIFO_THRESH_MASK;
+    return (*reg & SIM_IRQ2_STORED) |
+           (sim->fsk_count >= SX127X_SIM_FSK_FIFO ? IRQ2_FIFO_FULL  : 0) |
+           (sim->fsk_count == 0                   ? IRQ2_FIFO_EMPTY : 0) |
+           (sim->fsk_count > thresh               ? IRQ2_FIFO_LEVEL : 0);
+  }
+
+  return *reg;
+}
+//-----------------------------------------------------------------------------
+// write register with side effects
+static void sx127x_sim_write(sx127x_sim_t *sim, u8_t addr, u8_t value)
+{
+  u8_t *reg = sx127x_sim_reg(sim, addr);
+
+  if (addr == REG_FIFO)
+  {
+    if (sx127x_sim_is_lora(sim))
+      sim->fifo[sim->lora[REG_FIFO_ADDR_PTR]++] = value;
+    else
+      sx127x_sim_fsk_push(sim, value);
+  }
+  else if (addr == REG_OP_MODE)
+    sx127x_sim_op_mode(sim, value);
+  else if (addr == REG_VERSION)
+    return; // read only
+  else if (reg == &sim->lora[REG_IRQ_FLAGS])
+  { // clear IRQ flags by writing 1
+    if ((*reg & value & IRQ_FHSS_CHANGE) && sim->hop_left >= 0)
+    { // next hop: channel must be rewritten before
+      *reg &= ~value;
+      if (!sim->hop_frf) sim->hop_late++;
+      sx127x_sim_lora_hop(sim);
+    }
+    else
+      *reg &= ~value;
+  }
+  else if (addr == REG_FRF_LSB)
+  { // last byte of `Frf` burst
+    *reg = value;
+    sim->hop_frf = true;
+  }
+  else if (reg == &sim->reg[REG_IRQ_FLAGS_1]) // clear flags by writing 1
+    *reg &= ~(value & (IRQ1_RSSI | IRQ1_PREAMBLE_DETECT | IRQ1_SYNC_ADDRESS));
+  else if (reg == &sim->reg[REG_IRQ_FLAGS_2])
+  {
+    if (value & IRQ2_FIFO_OVERRUN)
+    { // clear FIFO and `FifoOverrun`
+      sx127x_sim_fsk_clear(sim);
+      *reg &= ~IRQ2_FIFO_OVERRUN;
+    }
+    *reg &= ~(value & IRQ2_LOW_BAT);
+  }
+  else if (reg >= &sim->lora[REG_FIFO_RX_CURRENT_ADDR] &&
+           reg <= &sim->lora[REG_LR_RSSI_VALUE] &&
+           reg != &sim->lora[REG_IRQ_FLAGS_MASK])
+    return; // LoRa status registers are read only
+  else
+    *reg = value;
+}
+//-----------------------------------------------------------------------------
+// init SX127x model (return 0 or -1 on error)
+int sx127x_sim_init(sx127x_sim_t *sim)
+{
+  pthread_mutexattr_t attr;
+
+  memset((void*) sim, 0, sizeof(sx127x_sim_t));
+  sim->rssi = -120; // noise floor
+
+  pthread_mutexattr_init(&attr);
+  pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&sim->mutex, &attr);
+  pthread_mutexattr_destroy(&attr);
+
+  sx127x_sim_reset(sim);
+
+  sim->fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  return sim->fd < 0 ? -1 : 0;
+}
+//-----------------------------------------------------------------------------
+// free SX127x model
+void sx127x_sim_free(sx127x_sim_t *sim)
+{
+  if (sim->fd >= 0) close(sim->fd);
+  sim->fd = -1;
+  pthread_mutex_destroy(&sim->mutex);
+}
+//-----------------------------------------------------------------------------
+// hard reset SX127x model (all registers to defaults)
+void sx127x_sim_reset(sx127x_sim_t *sim)
+{
+  int i;
+
+  pthread_mutex_lock(&sim->mutex);
+
+  memset((void*) sim->reg,  0, sizeof(sim->reg));
+  memset((void*) sim->lora, 0, sizeof(sim->lora));
+  memset((void*) sim->fifo, 0, sizeof(sim->fifo));
+
+  for (i = 0; i < (int) (sizeof(sx127x_sim_defaults) / 2); i++)
+    sim->reg[sx127x_sim_defaults[i][0]] = sx127x_sim_defaults[i][1];
+
+  for (i = 0; i < (int) (sizeof(sx127x_sim_lora_defaults) / 2); i++)
+    sim->lora[sx127x_sim_lora_defaults[i][0]] = sx127x_sim_lora_defaults[i][1];
+
+  sx127x_sim_fsk_clear(sim);
+  sim->rx_size    = 0;
+  sim->rx_pos     = 0;
+  sim->rx_ready   = false;
+  sim->tx_size    = 0;
+  sim->tx_len     = -1;
+  sim->rx_timeout = 0;
+  sim->air_size   = 0;
+  sim->hop_left   = -1;
+  sim->dio        = 0;
+  sim->dio1_level = sx127x_sim_dio1_level(sim);
+  sim->reg[REG_RSSI_VALUE] = (u8_t) SX127X_LIMIT(-2 * sim->rssi, 0, 255);
+
+  pthread_mutex_unlock(&sim->mutex);
+}
+//-----------------------------------------------------------------------------
+// set DIO event callback (called under lock from SPI exchange or inject)
+void sx127x_sim_on_dio(
+  sx127x_sim_t *sim,
+  void (*on_dio)(       // DIO event callback or NULL
+    sx127x_sim_t *sim,    // pointer to sx127x_sim_t object
+    int dio,              // SX127X_SIM_DIO*
+    void *context),       // optional context
+  void *on_dio_context)   // optional on_dio() context
+{
+  pthread_mutex_lock(&sim->mutex);
+  sim->on_dio         = on_dio;
+  sim->on_dio_context = on_dio_context;
+  pthread_mutex_unlock(&sim->mutex);
+}
+//-----------------------------------------------------------------------------
+// set TX capture callback (called under lock when packet is transmitted)
+void sx127x_sim_on_tx(
+  sx127x_sim_t *sim,
+  void (*on_tx)(        // TX capture callback or NULL
+    sx127x_sim_t *sim,    // pointer to sx127x_sim_t object
+    const u8_t *data,     // transmitted packet
+    int size,             // packet size
+    void *context),       // optional context
+  void *on_tx_context)    // optional on_tx() context
+{
+  pthread_mutex_lock(&sim->mutex);
+  sim->on_tx         = on_tx;
+  sim->on_tx_context = on_tx_context;
+  pthread_mutex_unlock(&sim->mutex);
+}
+//-----------------------------------------------------------------------------
+// get eventfd signalled on DIO events (for poll()/epoll())
+int sx127x_sim_fd(const sx127x_sim_t *sim)
+{
+  return sim->fd;
+}
+//-----------------------------------------------------------------------------
+// read and clear pending DIO events (return bit mask SX127X_SIM_DIO*)
+int sx127x_sim_events(sx127x_sim_t *sim)
+{
+  unsigned long long cnt;
+  int dio;
+
+  pthread_mutex_lock(&sim->mutex);
+  if (read(sim->fd, &cnt, sizeof(cnt)) < 0)
+    cnt = 0; // EAGAIN: no events
+  dio = (int) sim->dio;
+  sim->dio = 0;
+  pthread_mutex_unlock(&sim->mutex);
+
+  return dio;
+}
+//-----------------------------------------------------------------------------
+// inject received packet (LoRa/FSK/OOK)
+// (in FSK/OOK variable length mode length byte is added by model;
+//  LoRa packet injected in sleep/standby is on air while preamble is sent;
+//  LoRa packet with FHSS ends after last hop)
+int sx127x_sim_inject(
+  sx127x_sim_t *sim,
+  const u8_t *data, // packet data
+  int size,         // packet size
+  bool crc,         // CRC ok/false
+  i16_t rssi,       // packet RSSI [dBm]
+  i16_t snr)        // packet SNR [dB] (LoRa)
+{
+  int retv = SX127X_SIM_ERR_NONE;
+  u8_t mode;
+
+  pthread_mutex_lock(&sim->mutex);
+  mode = sx127x_sim_mode(sim);
+
+  if (sx127x_sim_is_lora(sim))
+  { // LoRa: write packet to FIFO at once or keep it on air
+    sx127x_sim_lora_timeout(sim);
+    mode = sx127x_sim_mode(sim);
+
+    if (size <= 0 || size > MAX_PKT_LENGTH)
+      retv = SX127X_SIM_ERR_BAD_SIZE;
+    else if (mode == MODE_RX_CONTINUOUS || mode == MODE_RX_SINGLE)
+      sx127x_sim_lora_rx(sim, data, size, crc, rssi, snr);
+    else if (mode == MODE_SLEEP || mode == MODE_STDBY)
+    { // packet is on air: received if RX starts before end of preamble
+      u32_t qsym = 4 * ((((u32_t) sim->lora[REG_PREAMBLE_MSB]) << 8) |
+                        sim->lora[REG_PREAMBLE_LSB]) + 17;
+      memcpy((void*) sim->air, (const void*) data, size);
+      sim->air_size = size;
+      sim->air_crc  = crc;
+      sim->air_rssi = rssi;
+      sim->air_snr  = snr;
+      sim->air_end  = sx127x_sim_now() + qsym * sx127x_sim_symbol_ns(sim) / 4;
+      retv = SX127X_SIM_ON_AIR;
+    }
+    else
+      retv = SX127X_SIM_ERR_NOT_RX;
+  }
+  else
+  { // FSK/OOK: FIFO is filled in sx127x_sim_update()
+    bool variable = !!(sim->reg[REG_PACKET_CONFIG_1] & SIM_PACKET_FORMAT);
+
+    if (mode != MODE_RX_CONTINUOUS)
+      retv = SX127X_SIM_ERR_NOT_RX;
+    else if (size <= 0 || size > (variable ? MAX_PKT_LENGTH :
+                                             SX127X_SIM_PACKET_MAX))
+      retv = SX127X_SIM_ERR_BAD_SIZE;
+    else
+    {
+      sx127x_sim_fsk_clear(sim);
+      sim->rx_pos   = 0;
+      sim->rx_size  = 0;
+      sim->rx_ready = false;
+      sim->rx_crc   = crc;
+
+      if (variable)
+        sim->rx[sim->rx_size++] = (u8_t) size; // length byte
+      memcpy((void*) (sim->rx + sim->rx_size), (const void*) data, size);
+      sim->rx_size += size;
+
+      sim->reg[REG_RSSI_VALUE] = (u8_t) SX127X_LIMIT(-2 * rssi, 0, 255);
+      sim->rx_count++;
+
+      // preamble and sync word are received before payload
+      sim->reg[REG_IRQ_FLAGS_1] |= IRQ1_PREAMBLE_DETECT | IRQ1_SYNC_ADDRESS;
+      if (sim->reg[REG_DIO_MAPPING_2] & DIO_MAP_PREAMBLE_DETECT)
+        sx127x_sim_dio(sim, 4, 3); // `PreambleDetect` on DIO4 (0b11)
+      sx127x_sim_dio(sim, 2, 3);   // `SyncAddress` on DIO2 (0b11)
+
+      sx127x_sim_update(sim);
+    }
+  }
+
+  pthread_mutex_unlock(&sim->mutex);
+  return retv;
+}
+//-----------------------------------------------------------------------------
+// set current RSSI [dBm] and `CadDetected` of next CAD
+void sx127x_sim_channel(sx127x_sim_t *sim, i16_t rssi, bool cad)
+{
+  pthread_mutex_lock(&sim->mutex);
+  sim->rssi = rssi;
+  sim->cad  = cad;
+  sim->reg[REG_RSSI_VALUE] = (u8_t) SX127X_LIMIT(-2 * rssi, 0, 255);
+  pthread_mutex_unlock(&sim->mutex);
+}
+//-----------------------------------------------------------------------------
+// start interferer transmission: RSSI is `rssi` [dBm] and CAD detects it
+// during `duration_us` [us] (for listen before talk)
+void sx127x_sim_busy(sx127x_sim_t *sim, i16_t rssi, u32_t duration_us)
+{
+  pthread_mutex_lock(&sim->mutex);
+  sim->busy_rssi = rssi;
+  sim->busy_end  = sx127x_sim_now() + (u64_t) duration_us * 1000ULL;
+  pthread_mutex_unlock(&sim->mutex);
+}
+//-----------------------------------------------------------------------------
+// SPI exchange function of model (return number or RX bytes)
+int sx127x_sim_exchange(
+  u8_t       *rx_buf, // RX buffer
+  const u8_t *tx_buf, // TX buffer
+  u8_t len,           // number of bytes
+  void *context)      // pointer to sx127x_sim_t object
+{
+  sx127x_sim_t *sim = (sx127x_sim_t*) context;
+  u8_t addr;
+  bool wr;
+  int i;
+
+  if (len == 0) return 0;
+
+  pthread_mutex_lock(&sim->mutex);
+  sx127x_sim_lora_timeout(sim);
+
+  addr = tx_buf[0] & 0x7F;
+  wr   = !!(tx_buf[0] & 0x80);
+  rx_buf[0] = 0;
+
+  for (i = 1; i < (int) len; i++)
+  { // burst: address is incremented (except FIFO)
+    if (wr)
+    {
+      sx127x_sim_write(sim, addr, tx_buf[i]);
+      rx_buf[i] = 0;
+    }
+    else
+      rx_buf[i] = sx127x_sim_read(sim, addr);
+
+    if (addr != REG_FIFO)
+      addr = (addr + 1) & 0x7F;
+  }
+
+  sx127x_sim_update(sim);
+
+  pthread_mutex_unlock(&sim->mutex);
+  return (int) len;
+}
+//-----------------------------------------------------------------------------
+// vectored SPI exchange function of model (return number or RX bytes)
+int sx127x_sim_exchange_v(
+  const sx127x_seg_t *seg, // array of segments
+  int n,                   // number of segments
+  void *context)           // pointer to sx127x_sim_t object
+{
+  int i, retv = 0;
+  for (i = 0; i < n; i++)
+    retv += sx127x_sim_exchange(seg[i].rx_buf, seg[i].tx_buf, seg[i].len,
+                                context);
+  return retv;
+}
+//-----------------------------------------------------------------------------
+
+/*** end of "sx127x_sim.c" file ***/
+
+
@@ -0,0 +1,187 @@
+/*
+ * -*- coding: UTF8 -*-
+ * Semtech SX127x famaly chips software model (simulator) for Linux
+ * File: "sx127x_sim.h"
+ */
+
+#ifndef SX127X_SIM_H
+#define SX127X_SIM_H
+//-----------------------------------------------------------------------------
+#include "sx127x.h" // `u8_t`, `sx127x_seg_t`
+#include <pthread.h> // `pthread_mutex_t`
+//-----------------------------------------------------------------------------
+// LoRa FIFO (data buffer) size [bytes]
+#define SX127X_SIM_LORA_FIFO 256
+
+// FSK/OOK FIFO size [bytes]
+#define SX127X_SIM_FSK_FIFO 64
+
+// maximum size of injected/captured FSK/OOK packet (with length byte)
+#ifndef SX127X_SIM_PACKET_MAX
+#define SX127X_SIM_PACKET_MAX (SX127X_STREAM_MAX + 1)
+#endif
+
+// DIO events (bit mask returned by sx127x_sim_events())
+#define SX127X_SIM_DIO0 1 // DIO0 rising edge (`RxDone`/`TxDone`/`CadDone`...)
+#define SX127X_SIM_DIO1 2 // DIO1 edge (`FifoLevel`/`FifoEmpty`/`FifoFull`)
+                          // or rising edge (`CadDetected`...) in LoRa mode
+#define SX127X_SIM_DIO2 4  // DIO2 rising edge (`SyncAddress`)
+#define SX127X_SIM_DIO3 8  // DIO3 rising edge (`ValidHeader`/`CadDone`...)
+#define SX127X_SIM_DIO4 16 // DIO4 rising edge (`PreambleDetect`/`CadDetected`)
+#define SX127X_SIM_DIO5 32 // DIO5 rising edge (not simulated)
+
+// error codes of sx127x_sim_inject()
+#define SX127X_SIM_ERR_NONE      0 // packet is received
+#define SX127X_SIM_ERR_NOT_RX   -1 // modem is not in RX mode (packet is lost)
+#define SX127X_SIM_ERR_BAD_SIZE -2 // bad packet size
+#define SX127X_SIM_ON_AIR        1 // LoRa modem sleeps: packet is received
+                                   // if RX starts before end of preamble
+//----------------------------------------------------------------------------
+// SX127x software model
+typedef struct sx127x_sim_ sx127x_sim_t;
+struct sx127x_sim_ {
+  u8_t reg[128];  // common registers and FSK/OOK page of 0x0D...0x3F
+  u8_t lora[64];  // LoRa page of registers 0x0D...0x3F (index = address)
+
+  u8_t fifo[SX127X_SIM_LORA_FIFO]; // LoRa FIFO (`RegFifoAddrPtr` access)
+
+  u8_t fsk[SX127X_SIM_FSK_FIFO]; // FSK/OOK FIFO (circular buffer)
+  int fsk_head;  // index of first byte in FSK/OOK FIFO
+  int fsk_count; // number of bytes in FSK/OOK FIFO
+
+  u8_t rx[SX127X_SIM_PACKET_MAX]; // injected FSK/OOK packet (not in FIFO)
+  int  rx_size;    // size of injected FSK/OOK packet
+  int  rx_pos;     // number of bytes moved to FIFO
+  bool rx_crc;     // `CrcOk` of injected FSK/OOK packet
+  bool rx_ready;   // all bytes of FSK/OOK packet are in FIFO
+
+  u8_t tx[SX127X_SIM_PACKET_MAX]; // captured TX packet
+  int  tx_size;    // size of captured TX packet
+  int  tx_len;     // expected FSK/OOK packet size (< 0 - unknown)
+
+  i16_t rssi;      // current RSSI [dBm]
+  bool  cad;       // `CadDetected` on next CAD
+
+  i16_t busy_rssi;  // RSSI of interferer [dBm]
+  u64_t busy_end;   // end of interferer transmission [ns] (CLOCK_MONOTONIC)
+
+  u64_t rx_timeout; // end of LoRa RX single window [ns] (CLOCK_MONOTONIC)
+
+  u8_t  air[SX127X_SIM_LORA_FIFO]; // LoRa packet on air (preamble is sent)
+  int   air_size;   // size of packet on air (0 - no packet)
+  bool  air_crc;    // CRC ok/false of packet on air
+  i16_t air_rssi;   // RSSI of packet on air [dBm]
+  i16_t air_snr;    // SNR of packet on air [dB]
+  u64_t air_end;    // end of preamble of packet on air [ns]
+
+  int   hop_left;   // hops to end of LoRa packet (FHSS, < 0 - no packet)
+  u8_t  hop_irq;    // IRQ flags of end of packet (`TxDone`/`RxDone`...)
+  u8_t  hop_dio0;   // DIO0 mapping of end of packet
+  bool  hop_frf;    // `Frf` is written after last hop
+
+  u8_t dio;        // pending DIO events SX127X_SIM_DIO*
+  u8_t dio1_level; // last level of DIO1 line (FSK/OOK)
+  int  fd;         // eventfd signalled on DIO events
+
+  unsigned long tx_count; // number of transmitted packets
+  unsigned long rx_count; // number of received packets
+  unsigned long hop_count; // number of FHSS hops
+  unsigned long hop_late;  // number of hops without `Frf` rewrite in time
+
+  void (*on_dio)(     // DIO event callback or NULL
+    sx127x_sim_t *sim,  // pointer to sx127x_sim_t object
+    int dio,            // SX127X_SIM_DIO*
+    void *context);     // optional context
+
+  void (*on_tx)(      // TX capture callback or NULL
+    sx127x_sim_t *sim,  // pointer to sx127x_sim_t object
+    const u8_t *data,   // transmitted packet (with length byte in FSK/OOK)
+    int size,           // packet size
+    void *context);     // optional context
+
+  void *on_dio_context; // optional on_dio() context
+  void *on_tx_context;  // optional on_tx() context
+
+  pthread_mutex_t mutex; // recursive (callbacks may call sx127x_sim_*())
+};
+//----------------------------------------------------------------------------
+#ifdef __cplusplus
+extern "C"
+{
+#endif // __cplusplus
+//----------------------------------------------------------------------------
+// init SX127x model (return 0 or -1 on error)
+int sx127x_sim_init(sx127x_sim_t *sim);
+//----------------------------------------------------------------------------
+// free SX127x model
+void sx127x_sim_free(sx127x_sim_t *sim);
+//----------------------------------------------------------------------------
+// hard reset SX127x model (all registers to defaults)
+void sx127x_sim_reset(sx127x_sim_t *sim);
+//----------------------------------------------------------------------------
+// set DIO event callback (called under lock from SPI exchange or inject)
+void sx127x_sim_on_dio(
+  sx127x_sim_t *sim,
+  void (*on_dio)(       // DIO event callback or NULL
+    sx127x_sim_t *sim,    // pointer to sx127x_sim_t object
+    int dio,              // SX127X_SIM_DIO*
+    void *context),       // optional context
+  void *on_dio_context);  // optional on_dio() context
+//----------------------------------------------------------------------------
+// set TX capture callback (called under lock when packet is transmitted)
+void sx127x_sim_on_tx(
+  sx127x_sim_t *sim,
+  void (*on_tx)(        // TX capture callback or NULL
+    sx127x_sim_t *sim,    // pointer to sx127x_sim_t object
+    const u8_t *data,     // transmitted packet
+    int size,             // packet size
+    void *context),       // optional context
+  void *on_tx_context);   // optional on_tx() context
+//----------------------------------------------------------------------------
+// get eventfd signalled on DIO events (for poll()/epoll())
+int sx127x_sim_fd(const sx127x_sim_t *sim);
+//----------------------------------------------------------------------------
+// read and clear pending DIO events (return bit mask SX127X_SIM_DIO*)
+int sx127x_sim_events(sx127x_sim_t *sim);
+//----------------------------------------------------------------------------
+// inject received packet (LoRa/FSK/OOK)
+// (in FSK/OOK variable length mode length byte is added by model;
+//  LoRa packet injected in sleep/standby is on air while preamble is sent;
+//  LoRa packet with FHSS ends after last hop)
+int sx127x_sim_inject(
+  sx127x_sim_t *sim,
+  const u8_t *data, // packet data
+  int size,         // packet size
+  bool crc,         // CRC ok/false
+  i16_t rssi,       // packet RSSI [dBm]
+  i16_t snr);       // packet SNR [dB] (LoRa)
+//----------------------------------------------------------------------------
+// set current RSSI [dBm] and `CadDetected` of next CAD
+void sx127x_sim_channel(sx127x_sim_t *sim, i16_t rssi, bool cad);
+//----------------------------------------------------------------------------
+// start interferer transmission: RSSI is `rssi` [dBm] and CAD detects it
+// during `duration_us` [us] (for listen before talk)
+void sx127x_sim_busy(sx127x_sim_t *sim, i16_t rssi, u32_t duration_us);
+//----------------------------------------------------------------------------
+// SPI exchange function of model (return number or RX bytes)
+int sx127x_sim_exchange(
+  u8_t       *rx_buf, // RX buffer
+  const u8_t *tx_buf, // TX buffer
+  u8_t len,           // number of bytes
+  void *context);     // pointer to sx127x_sim_t object
+//----------------------------------------------------------------------------
+// vectored SPI exchange function of model (return number or RX bytes)
+int sx127x_sim_exchange_v(
+  const sx127x_seg_t *seg, // array of segments
+  int n,                   // number of segments
+  void *context);          // pointer to sx127x_sim_t object
+//----------------------------------------------------------------------------
+#ifdef __cplusplus
+}
+#endif // __cplusplus
+//----------------------------------------------------------------------------
+#endif // SX127X_SIM_H
+
+/*** end of "sx127x_sim.h" file ***/
+
+
@@ -8,29 +8,164 @@
 #include <stdio.h>      // printf(), NULL
 #include <string.h>     // strlen()
 #include "stimer.h"     // `stimer_t`
-#include "radio.h"      // `sx127x_t`, radio_*()
+#include "radio.h"      // `sx127x_t`, `radio_t`, radio_*()
 #include "sx127x_def.h" // SX127x define's
-#include <stdlib.h>     // exit(), EXIT_SUCCESS, EXIT_FAILURE
+#include "vsthread.h"   // vsthread_create(), vsthread_join()
+#include <stdlib.h>     // exit(), rand(), EXIT_SUCCESS, EXIT_FAILURE
+#include <signal.h>     // pthread_sigmask()
 //-----------------------------------------------------------------------------
 // demo mode
-#define DEMO_MODE 1 // 0 - transmitter, 1 - receiver, 2 - morse beeper
+#ifndef DEMO_MODE
+#define DEMO_MODE 1 // 0 - transmitter, 1 - receiver, 2 - OOK bit streaming,
+                    // 3 - SPI benchmark, 4 - RSSI sweep (FSK)
+#endif
 
 // radio mode
+#ifndef RADIO_MODE
 #define RADIO_MODE 0 // 0 - LoRa, 1 - FSK, 2 - OOK
+#endif
 
 // LoRa settings 1..5
 #define LORA_VARIANT 1
 
-// timer interval
+// timer interval (transmitter keeps time on air under 50%)
 #define TIMER_INTERVAL 1000 // ms
 
 // implicit header (LoRa) or fixed packet length (FSK/OOK)
 //#define FIXED
 
+// transmit by asynchronous TX queue (several frames per timer tick)
+//#define ASYNC_TX 3
+
+// receive by lock-free RX ring and consumer thread (not in IRQ thread)
+//#define RX_QUEUE
+
+// long packet size by FIFO streaming (FSK/OOK only, up to 2047 bytes)
+//#define STREAM_SIZE 1000
+
+// duty-cycled LoRa receive by preamble length (transmitter uses same one)
+//#define RX_DUTY 64
+
+// LoRa frequency hopping by hop table (hop period [symbols], DIO2 line)
+//#define FHSS 10
+
+// listen before talk in asynchronous TX queue (backoff slot [us],
+// 0 - by modem; need ASYNC_TX, model is jammed by random interferer)
+//#define LBT 0
+
+// adaptive data rate of LoRa receiver by link of peer (SNR margin [dB];
+// BW/SF/power are changed from LORA_VARIANT by SNR of received frames)
+//#define ADR 10
+
+// number of packets in SPI benchmark
+#define BENCH_PACKETS 100
+
+// number of register accesses in SPI latency benchmark
+#define BENCH_ACCESSES 1000
+
+// number of channels in retune benchmark (25 kHz step from 433.05 MHz)
+#define BENCH_CHANNELS 64
+
+// bitrate of OOK bit streaming demo on DATA line (DIO2) [bit/s]
+#define BITS_RATE 4800
+
+// size of bit stream per timer tick (preamble, sync word, "Hello!"...)
+#define BITS_SIZE 128 // bytes
+
+// band of RSSI sweep demo (433.05...434.775 MHz by 25 kHz)
+#define SWEEP_FREQ 433050000 // first bin [Hz]
+#define SWEEP_STEP 25000     // step [Hz]
+#define SWEEP_BINS 70        // number of bins
+
 //-----------------------------------------------------------------------------
 stimer_t timer;
+sx127x_t radio; // SX127x driver object
+radio_t  board; // board layer of SX127x module (SPI, GPIOs, IRQ)
 int demo_mode = DEMO_MODE;
 //-----------------------------------------------------------------------------
+#ifdef FHSS
+// FHSS hop table [Hz] (channel 0 is used at start of each packet)
+static const u32_t hop_freq[] = {
+  433175000, 433375000, 433575000, 433775000,
+  433975000, 434175000, 434375000, 434575000
+};
+//-----------------------------------------------------------------------------
+// print FHSS statistics
+static void fhss_print()
+{
+  sx127x_fhss_stat_t st;
+  sx127x_fhss_stat(&radio, &st, false);
+  printf(">>> FHSS: hops=%lu, misses=%lu, spurious=%lu\n",
+         (unsigned long) st.hops, (unsigned long) st.misses,
+         (unsigned long) st.spurious);
+#ifdef RADIO_SIM
+  printf(">>> SX127x model: hops=%lu, late=%lu\n",
+         board.sim.hop_count, board.sim.hop_late);
+#endif
+}
+#endif // FHSS
+//-----------------------------------------------------------------------------
+// print time on air statistics (channel utilization by computed airtime)
+static void air_print()
+{
+  sx127x_air_stat_t st;
+  sx127x_air_stat(&radio, &st, false);
+  printf(">>> Airtime: TX %lu packets %.1f ms, RX %lu packets %.1f ms\n",
+         (unsigned long) st.tx_packets, (double) st.tx_us * 1e-3,
+         (unsigned long) st.rx_packets, (double) st.rx_us * 1e-3);
+}
+//-----------------------------------------------------------------------------
+#if defined(ASYNC_TX) && defined(LBT)
+// print listen before talk statistics
+static void lbt_print()
+{
+  sx127x_lbt_stat_t st;
+  int i;
+  sx127x_lbt_stat(&radio, &st, false);
+  for (i = 0; i < SX127X_LBT_CH_MAX && st.ch[i].freq != 0; i++)
+    printf(">>> LBT: %lu Hz busy %lu of %lu checks\n",
+           (unsigned long) st.ch[i].freq, (unsigned long) st.ch[i].busy,
+           (unsigned long) st.ch[i].checks);
+  printf(">>> LBT: sent by backoffs");
+  for (i = 0; i <= SX127X_LBT_TRIES; i++)
+    printf(" %lu", (unsigned long) st.sent[i]);
+  printf(", BE");
+  for (i = SX127X_LBT_BE_MIN; i <= SX127X_LBT_BE_MAX; i++)
+    printf(" %lu", (unsigned long) st.be[i]);
+  printf(", drops=%lu, backoff=%.1f ms\n",
+         (unsigned long) st.drops, (double) st.backoff_us * 1e-3);
+}
+#endif
+//-----------------------------------------------------------------------------
+// drain RSSI sweep ring, print statistics and last vector as waterfall line
+static void sweep_print()
+{
+  static const char shade[] = " .:-=+*#%@"; // -120...-30 dBm by 10 dB
+  const sx127x_sweep_vec_t *vec;
+  sx127x_sweep_stat_t st;
+  char line[SX127X_SWEEP_BINS + 1];
+  int i, n = 0;
+
+  line[0] = '\0';
+  while ((vec = sx127x_sweep_peek(&radio)) != NULL)
+  { // consume power vectors (waterfall or interference monitor)
+    for (i = 0; i < vec->bins; i++)
+      line[i] = shade[SX127X_LIMIT((vec->rssi[i] + 120) / 10, 0, 9)];
+    line[vec->bins] = '\0';
+    sx127x_sweep_pop(&radio);
+    n++;
+  }
+
+  sx127x_sweep_stat(&radio, &st, false);
+  printf(">>> Sweep: %d vectors, sweeps=%lu, drops=%lu, "
+         "period min/avg/max=%.1f/%.1f/%.1f ms\n",
+         n, (unsigned long) st.sweeps, (unsigned long) st.drops,
+         (double) st.min_us * 1e-3,
+         st.periods ? (double) st.total_us * 1e-3 / (double) st.periods : 0.,
+         (double) st.max_us * 1e-3);
+  printf(">>> |%s|\n", line);
+}
+//-----------------------------------------------------------------------------
 // SIGINT handler (Ctrl-C)
 static void sigint_handler(void *context)
 {
@@ -51,7 +186,7 @@ static void on_receive(
   i16_t rssi = sx127x_get_pkt_rssi(&radio);
   i16_t snr  = sx127x_get_snr(&radio);
   
-  radio_blink_led();
+  radio_blink_led(&board);
   printf("*** Received message:\n");
 
   for (i = 0; i < payload_size; i++)
@@ -66,49 +201,480 @@ static void on_receive(
 
 }
 //-----------------------------------------------------------------------------
+// receive callback with metadata (no extra SPI exchanges)
+static void on_receive_ex(
+    sx127x_t *self,     // pointer to sx127x_t object
+    u8_t *payload,      // payload data
+    u8_t payload_size,  // payload size
+    bool crc,           // CRC ok/false
+    const sx127x_rx_meta_t *meta, // packet metadata
+    void *context)      // optional context
+{
+  static u64_t time_ns = 0; // timestamp of previous packet
+  int i;
+
+  radio_blink_led(&board);
+  printf("*** Received message:\n");
+
+  for (i = 0; i < payload_size; i++)
+    printf("%c", (char) payload[i]);
+
+  printf("\n^^^ CrcOk=%s, size=%i, RSSI=%d, SNR=%d, FEI=%ld Hz, "
+         "freq=%lu Hz, dt=%.3f ms\n",
+         crc ? "true" : "false", payload_size, meta->rssi, meta->snr,
+         (long) meta->fei, (unsigned long) meta->freq,
+         time_ns ? (double) (meta->time_ns - time_ns) * 1e-6 : 0.);
+  if (meta->mode == SX127X_LORA)
+    printf("^^^ LoRa: BW=%lu Hz, SF=%d, CR=4/%d, ImplHdr=%d, LDRO=%d, "
+           "CrcOn=%d\n", (unsigned long) meta->bw, meta->sf, meta->cr,
+           meta->impl_hdr, meta->ldro, meta->crc_on);
+  else
+    printf("^^^ %s: bitrate=%lu bit/s, fixed=%d\n",
+           meta->mode == SX127X_FSK ? "FSK" : "OOK",
+           (unsigned long) meta->bitrate, meta->fixed);
+#ifdef ADR
+  if (meta->mode == SX127X_LORA)
+  { // frames of peer 1 are sent on 17 dBm TX power (look setup)
+    sx127x_adr_t adr;
+    i32_t saved;
+    sx127x_adr_rx(self, 1, meta, 17);
+    saved = sx127x_adr_apply(self, 1, payload_size, &adr);
+    printf("^^^ ADR: BW=%lu Hz, SF=%d, LDRO=%d, power=%d dBm, "
+           "margin=%.1f dB, saved %ld of %lu us\n",
+           (unsigned long) adr.bw, adr.sf, adr.ldro, adr.power,
+           (double) adr.margin * 0.1, (long) saved,
+           (unsigned long) adr.old_us);
+  }
+#endif
+
+  time_ns = meta->time_ns;
+}
+//-----------------------------------------------------------------------------
+#ifdef SX127X_USE_DIO
+// DIO line event callback (`ValidHeader`, `PreambleDetect`...)
+static void on_event(
+    sx127x_t *self, // pointer to sx127x_t object
+    int dio,        // DIO line 0...5
+    int event,      // SX127X_EV_*
+    void *context)  // optional context
+{
+  printf("*** DIO%d event %d\n", dio, event);
+}
+#endif
+//-----------------------------------------------------------------------------
+#ifdef RX_QUEUE
+vsthread_t rxq_thread;
+//-----------------------------------------------------------------------------
+// RX ring consumer thread (slow printf() does not delay IRQ thread)
+static void *rxq_thread_fn(void *arg)
+{
+  sigset_t mask; // SIGINT and timer signals are handled by main thread
+  sigfillset(&mask);
+  pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+  while (!radio_stop)
+  {
+    const sx127x_rx_frame_t *frame;
+    u32_t frames, drops;
+
+    if (radio_rxq_wait(&board, 200) <= 0)
+      continue; // timeout (check `radio_stop`)
+
+    while ((frame = sx127x_rxq_peek(&radio)) != NULL)
+    {
+      on_receive_ex(&radio, (u8_t*) frame->data, frame->size, frame->crc,
+                    &frame->meta, NULL);
+      sx127x_rxq_pop(&radio);
+    }
+
+    sx127x_rxq_stat(&radio, &frames, &drops);
+    printf("^^^ RX ring: frames=%lu, drops=%lu\n",
+           (unsigned long) frames, (unsigned long) drops);
+  }
+  return NULL;
+}
+#endif // RX_QUEUE
+//-----------------------------------------------------------------------------
+#ifdef STREAM_SIZE
+u8_t stream_buf[STREAM_SIZE]; // long packet buffer
+//-----------------------------------------------------------------------------
+// receive long packet callback
+static void on_receive_long(
+    sx127x_t *self, // pointer to sx127x_t object
+    u8_t *data,     // user buffer
+    int size,       // packet size
+    bool crc,       // CRC ok/false
+    void *context)  // optional context
+{
+  int i, errors = 0;
+  for (i = 0; i < size; i++)
+    if (data[i] != (u8_t) i) errors++;
+
+  printf("*** Received long packet: size=%d, CrcOk=%s, errors=%d\n",
+         size, crc ? "true" : "false", errors);
+
+  // receive next long packet
+  sx127x_receive_long(self, stream_buf, STREAM_SIZE, false);
+}
+#endif
+//-----------------------------------------------------------------------------
+// transmit done callback
+static void on_transmit(
+    sx127x_t *self, // pointer to sx127x_t object
+    bool ok,        // true - TX done, false - timeout
+    void *context)  // optional context
+{
+  printf("*** Transmit %s\n", ok ? "done" : "timeout");
+}
+//-----------------------------------------------------------------------------
+#ifdef RADIO_SIM
+// packet transmitted by SX127x model callback
+static void on_sim_tx(
+    sx127x_sim_t *sim, // pointer to sx127x_sim_t object
+    const u8_t *data,  // transmitted packet
+    int size,          // packet size
+    void *context)     // optional context
+{
+  printf("*** SX127x model transmit %d bytes (#%lu)\n", size, sim->tx_count);
+}
+#endif
+//-----------------------------------------------------------------------------
+#ifdef ASYNC_TX
+// frame of asynchronous TX queue sent callback
+static void on_sent(
+    sx127x_t *self,   // pointer to sx127x_t object
+    void *frame,      // frame context from sx127x_send_async()
+    i16_t status,     // SX127X_ERR_NONE or error code
+    u32_t airtime_ms, // computed time on air [ms]
+    void *context)    // optional context
+{
+  printf("*** Frame #%d sent: status=%d, airtime=%u ms\n",
+         (int) (long) frame, (int) status, (unsigned) airtime_ms);
+}
+#endif
+//-----------------------------------------------------------------------------
 // periodic timer handler (main periodic function)
 static int timer_handler(void *context)
 {
   if (demo_mode == 0)
   { // transmitter
     char *str = "Hello!";
+    int retv;
+    air_print();
+#ifdef FHSS
+    if (sx127x_is_lora(&radio)) fhss_print();
+#endif
+#ifdef STREAM_SIZE
+    if (!sx127x_is_lora(&radio))
+    {
+      retv = sx127x_send_long(&radio, stream_buf, STREAM_SIZE, false);
+      printf(">>> sx127x_send_long(%d) return %d\n", STREAM_SIZE, retv);
+      return 0;
+    }
+#endif
+#ifdef ASYNC_TX
+    static long frame = 0;
+    int i;
+#ifdef LBT
+    lbt_print();
+#ifdef RADIO_SIM
+    // interferer occupies channel up to time on air of two frames
+    sx127x_sim_busy(&board.sim, -70, (u32_t) rand() %
+                    (2 * sx127x_airtime_us(&radio, strlen(str)) + 1));
+#endif
+#endif
+    for (i = 0; i < ASYNC_TX; i++, frame++)
+    {
+      retv = sx127x_send_async(&radio, (u8_t*) str, strlen(str), false,
+                               (void*) frame);
+      printf(">>> sx127x_send_async('%s', #%ld) return %d\n",
+             str, frame, retv);
+    }
+    return 0;
+#endif
     printf(">>> sx127x_send('%s')\n", str);
-    //radio_led_on(true);
+    //radio_led_on(&board, true);
 #ifdef FIXED
-    sx127x_send(&radio,
+    retv = sx127x_send(&radio,
                 (u8_t*) str, strlen(str), true); // implicit header / fixed
 #else
-    sx127x_send(&radio,
+    retv = sx127x_send(&radio,
                 (u8_t*) str, strlen(str), false); // explicit header / varible
 #endif
-    //radio_led_on(false);
+    printf(">>> sx127x_send() return %d\n", retv);
+    //radio_led_on(&board, false);
   }
   else if (demo_mode == 1)
   { // receiver
     i16_t rssi = sx127x_get_rssi(&radio);
     printf(">>> RSSI = %d dBm\n", rssi); 
+    air_print();
+#ifdef SX127X_USE_LOCK
+    {
+      sx127x_lock_stat_t st;
+      sx127x_lock_stat(&radio, &st, false);
+      printf(">>> SPI bus: locks=%lu (waits=%lu), IRQ locks=%lu (waits=%lu), "
+             "callback drops=%lu\n",
+             (unsigned long) st.locks, (unsigned long) st.waits,
+             (unsigned long) st.irq_locks, (unsigned long) st.irq_waits,
+             (unsigned long) st.cb_drops);
+    }
+#endif
+#ifdef FHSS
+    if (sx127x_is_lora(&radio)) fhss_print();
+#endif
+#ifdef RX_DUTY
+    {
+      sx127x_duty_stat_t st;
+      sx127x_rx_duty_stat(&radio, &st);
+      printf(">>> RX duty: windows=%lu, packets=%lu, timeouts=%lu, "
+             "radio on %.1f of %.1f ms (%.1f%%)\n",
+             (unsigned long) st.windows, (unsigned long) st.packets,
+             (unsigned long) st.timeouts, (double) st.on_ns * 1e-6,
+             (double) st.run_ns * 1e-6,
+             st.run_ns ? (double) st.on_ns * 100. / (double) st.run_ns : 0.);
+    }
+#endif
+#ifdef RADIO_SIM
+    { // inject packet to SX127x model
+      char *str = "Hello!";
+      int retv;
+#ifdef STREAM_SIZE
+      if (!sx127x_is_lora(&radio))
+      { // long packet with test pattern
+        static u8_t buf[STREAM_SIZE];
+        for (retv = 0; retv < STREAM_SIZE; retv++)
+          buf[retv] = (u8_t) retv;
+        retv = sx127x_sim_inject(&board.sim, buf, STREAM_SIZE, true, -60, 0);
+        printf(">>> sx127x_sim_inject(%d) return %d\n", STREAM_SIZE, retv);
+        return 0;
+      }
+#endif
+      retv = sx127x_sim_inject(&board.sim, (u8_t*) str, strlen(str),
+                               true, -60, 9); // CRC, RSSI, SNR
+      printf(">>> sx127x_sim_inject('%s') return %d\n", str, retv);
+    }
+#endif
   }
   else if (demo_mode == 2)
-  { // morse beeper
-    sx127x_tx(&radio);
-    
-    printf(">>> *** BEEP ***\n"); 
-    radio_led_on(1);
-    radio_data_on(1);
-    stimer_sleep_ms(500); // FIXME
-    radio_led_on(0);
-    radio_data_on(0);
+  { // OOK bit streaming on DATA line (continuous mode)
+    static u8_t bits[BITS_SIZE];
+    radio_bits_stat_t st;
+    int i, retv;
+
+    if (bits[0] == 0)
+    { // preamble, sync word and repeated "Hello!"
+      for (i = 0; i < BITS_SIZE; i++)
+        bits[i] = i < 16 ? 0x55 : i < 18 ? (i == 16 ? 0x2D : 0xD4) :
+                  (u8_t) "Hello!"[(i - 18) % 6];
+    }
 
+    sx127x_tx(&radio);
+    radio_led_on(&board, 1);
+    retv = radio_bits_send(&board, bits, BITS_SIZE * 8, BITS_RATE, &st);
+    radio_led_on(&board, 0);
     sx127x_standby(&radio);
+
+    printf(">>> radio_bits_send(%d bits) return %d: %lu bit/s, edges=%lu, "
+           "late=%lu\n", BITS_SIZE * 8, retv, (unsigned long) st.bitrate,
+           (unsigned long) st.edges, (unsigned long) st.late);
+    printf(">>> Jitter: p50=%.1f us, p90=%.1f us, p99=%.1f us, max=%.1f us\n",
+           (double) st.p50_ns * 1e-3, (double) st.p90_ns * 1e-3,
+           (double) st.p99_ns * 1e-3, (double) st.max_ns * 1e-3);
+  }
+  else if (demo_mode == 4)
+  { // RSSI sweep
+    sweep_print();
+#ifdef RADIO_SIM
+    // interferer occupies band up to one timer tick
+    sx127x_sim_busy(&board.sim, -60, (u32_t) rand() % (TIMER_INTERVAL * 1000));
+#endif
   }
 
   return 0;
 }
 //-----------------------------------------------------------------------------
+// get monotonic time [us] (for benchmark)
+static double bench_time_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((double) ts.tv_sec) * 1e6 + ((double) ts.tv_nsec) * 1e-3;
+}
+//-----------------------------------------------------------------------------
+// print benchmark result (per packet)
+static void bench_result(const char *name, int packets, double time_us)
+{
+  printf(">>> %-24s: %7.1f SPI calls, %7.1f syscalls, %9.1f us per packet\n",
+         name,
+         (double) board.stat.calls    / (double) packets,
+         (double) board.stat.syscalls / (double) packets,
+         time_us / (double) packets);
+}
+//-----------------------------------------------------------------------------
+// reconfigure LoRa modem to one of two profiles (for benchmark)
+static void bench_config(int profile)
+{
+  sx127x_set_frequency(&radio, profile ? 433000000 : 434000000);
+  sx127x_set_power_dbm(&radio, profile ? 17 : 10);
+  sx127x_enable_crc(   &radio, profile ? true : false, true);
+  sx127x_set_bw(       &radio, profile ? 125000 : 250000);
+  sx127x_set_sf(       &radio, profile ? 11 : 9);
+  sx127x_set_cr(       &radio, profile ? 8 : 5);
+  sx127x_set_preamble( &radio, profile ? 8 : 12);
+  sx127x_set_ldro(     &radio, profile ? true : false);
+  sx127x_set_sw(       &radio, profile ? 0x12 : 0x34);
+}
+//-----------------------------------------------------------------------------
+// SPI benchmark (drain FIFO like sx127x_irq_handler() do)
+static void benchmark()
+{
+  int i, j, n = BENCH_PACKETS;
+  u8_t buf[MAX_PKT_LENGTH];
+  double t;
+
+  printf(">>> SPI benchmark: %d packets by %d bytes\n", n, MAX_PKT_LENGTH);
+
+  // read FIFO by one SPI transaction per byte
+  radio_spi_stat_reset(&board);
+  t = bench_time_us();
+  for (i = 0; i < n; i++)
+    for (j = 0; j < MAX_PKT_LENGTH; j++)
+      buf[j] = sx127x_read_reg(&radio, REG_FIFO);
+  bench_result("FIFO read by bytes", n, bench_time_us() - t);
+
+  // read FIFO in burst mode
+  radio_spi_stat_reset(&board);
+  t = bench_time_us();
+  for (i = 0; i < n; i++)
+    sx127x_read_burst(&radio, REG_FIFO, buf, MAX_PKT_LENGTH);
+  bench_result("FIFO read by burst", n, bench_time_us() - t);
+
+  // write FIFO by one SPI transaction per byte
+  radio_spi_stat_reset(&board);
+  t = bench_time_us();
+  for (i = 0; i < n; i++)
+    for (j = 0; j < MAX_PKT_LENGTH; j++)
+      sx127x_write_reg(&radio, REG_FIFO, buf[j]);
+  bench_result("FIFO write by bytes", n, bench_time_us() - t);
+
+  // write FIFO in burst mode
+  radio_spi_stat_reset(&board);
+  t = bench_time_us();
+  for (i = 0; i < n; i++)
+    sx127x_write_burst(&radio, REG_FIFO, buf, MAX_PKT_LENGTH);
+  bench_result("FIFO write by burst", n, bench_time_us() - t);
+
+  // reconfigure LoRa modem by setters without shadow register cache
+  sx127x_cache_on(&radio, false);
+  radio_spi_stat_reset(&board);
+  t = bench_time_us();
+  for (i = 0; i < n; i++)
+    bench_config(i & 1);
+  bench_result("config without cache", n, bench_time_us() - t);
+  sx127x_cache_on(&radio, true);
+  sx127x_cache_sync(&radio);
+
+  // reconfigure LoRa modem by setters with shadow register cache
+  radio_spi_stat_reset(&board);
+  t = bench_time_us();
+  for (i = 0; i < n; i++)
+    bench_config(i & 1);
+  bench_result("config with cache", n, bench_time_us() - t);
+
+  // reconfigure LoRa modem in batch
+  radio_spi_stat_reset(&board);
+  t = bench_time_us();
+  for (i = 0; i < n; i++)
+  {
+    sx127x_batch_begin(&radio);
+    bench_config(i & 1);
+    sx127x_batch_commit(&radio);
+  }
+  bench_result("config in batch", n, bench_time_us() - t);
+}
+//-----------------------------------------------------------------------------
+// register access latency benchmark for all CS strategies
+static void benchmark_cs()
+{
+  int i, cs, mode, n = BENCH_ACCESSES;
+  double t;
+
+  printf(">>> SPI latency benchmark: %d register accesses\n", n);
+
+  sx127x_cache_on(&radio, false); // all reads go to SPI
+  for (cs = RADIO_CS_NATIVE; cs <= RADIO_CS_GPIO_HOLD; cs++)
+  {
+    char name[32];
+    mode = radio_spi_cs_mode(&board, cs);
+    if (mode != cs) continue; // strategy is not supported by board
+
+    // read one register by one SPI transaction
+    radio_spi_stat_reset(&board);
+    t = bench_time_us();
+    for (i = 0; i < n; i++)
+      sx127x_read_reg(&radio, REG_VERSION);
+    snprintf(name, sizeof(name), "read reg (%s CS)", radio_spi_cs_name(cs));
+    bench_result(name, n, bench_time_us() - t);
+
+    // reconfigure LoRa modem in batch (vectored exchange)
+    radio_spi_stat_reset(&board);
+    t = bench_time_us();
+    for (i = 0; i < BENCH_PACKETS; i++)
+    {
+      sx127x_batch_begin(&radio);
+      bench_config(i & 1);
+      sx127x_batch_commit(&radio);
+    }
+    snprintf(name, sizeof(name), "batch (%s CS)", radio_spi_cs_name(cs));
+    bench_result(name, BENCH_PACKETS, bench_time_us() - t);
+  }
+  sx127x_cache_on(&radio, true);
+  sx127x_cache_sync(&radio);
+
+  mode = radio_spi_cs_mode(&board, RADIO_CS_MODE); // restore default
+  printf(">>> CS strategy is '%s'\n", radio_spi_cs_name(mode));
+}
+//-----------------------------------------------------------------------------
+// retune latency benchmark: sx127x_set_frequency() vs channel plan
+static void benchmark_retune()
+{
+  static sx127x_plan_t plan;
+  u32_t freq[BENCH_CHANNELS], f = radio.freq;
+  int i, n = BENCH_ACCESSES;
+  double t;
+
+  printf(">>> Retune benchmark: %d retunes over %d channels\n",
+         n, BENCH_CHANNELS);
+
+  for (i = 0; i < BENCH_CHANNELS; i++)
+    freq[i] = 433050000 + i * 25000;
+  sx127x_plan_init(&plan, freq, BENCH_CHANNELS);
+  sx127x_set_plan(&radio, &plan);
+
+  // convert frequency to `Frf` on each retune
+  radio_spi_stat_reset(&board);
+  t = bench_time_us();
+  for (i = 0; i < n; i++)
+    sx127x_set_frequency(&radio, freq[i % BENCH_CHANNELS]);
+  bench_result("retune by frequency", n, bench_time_us() - t);
+
+  // write cached `Frf` of channel plan
+  radio_spi_stat_reset(&board);
+  t = bench_time_us();
+  for (i = 0; i < n; i++)
+    sx127x_set_channel(&radio, i % BENCH_CHANNELS);
+  bench_result("retune by channel plan", n, bench_time_us() - t);
+
+  sx127x_set_plan(&radio, NULL);
+  sx127x_set_frequency(&radio, f); // restore RF frequency
+}
+//-----------------------------------------------------------------------------
 // simple example usage of `sx127x_t` component 
 int main()
 {
   int retv, radio_mode = RADIO_MODE;
+  u32_t interval = TIMER_INTERVAL;
   u8_t reg;
   u32_t freq;
   i16_t rssi;
@@ -126,10 +692,19 @@ int main()
   if (retv != 0) exit(EXIT_FAILURE);
 
   if (demo_mode == 2)
-    radio_mode = SX127X_OOK; // OOK in morse beeper demo
+    radio_mode = SX127X_OOK; // OOK in bit streaming demo
+  else if (demo_mode == 4)
+    radio_mode = SX127X_FSK; // FSK in RSSI sweep demo
 
   // init SX127x radio module hardware layer (before call sx127x_init())
-  radio_init();
+  retv = radio_init(&board, &radio, (const radio_cfg_t*) NULL);
+  printf(">>> radio_init() return %d\n", retv);
+  if (retv != 0) exit(EXIT_FAILURE);
+
+#ifdef RADIO_SIM
+  // capture packets transmitted by SX127x model
+  sx127x_sim_on_tx(&board.sim, on_sim_tx, (void*) NULL);
+#endif
 
   // setup SX127x module
   retv = sx127x_init(
@@ -138,12 +713,26 @@ int main()
       radio_spi_exchange, // SPI exchange function (return number or RX bytes)
       on_receive,         // receive callback or NULL
       (const sx127x_pars_t *) NULL, // configuration parameters or NULL
-      (void*) NULL,       // optional SPI exchange context
+      (void*) &board,     // SPI exchange context (`radio_t`)
       (void*) NULL);      // optional on_receive() context
   printf(">>> sx127x_init() return %d\n", retv);
 
-  // create listen IRQ thread (after sx127x_init())
-  radio_create_irq_thread();
+  // set callback on transmit done (by IRQ on DIO0)
+  sx127x_on_transmit(&radio, on_transmit, (void*) NULL);
+
+#ifdef ASYNC_TX
+  // set callback on frame of asynchronous TX queue sent
+  sx127x_on_sent(&radio, on_sent, (void*) NULL);
+#endif
+
+  // set vectored SPI exchange function (several transactions by one ioctl())
+  sx127x_spi_exchange_v(&radio, radio_spi_exchange_v);
+
+  // attach module to IRQ dispatcher thread (after sx127x_init())
+  radio_create_irq_thread(&board);
+
+  // queue all settings and write them by a few SPI bursts
+  sx127x_batch_begin(&radio);
 
   // common settings
   sx127x_set_frequency(&radio, 433000000); // RF frequency [Hz]
@@ -159,6 +748,9 @@ int main()
 
     sx127x_set_cr(&radio, 8);       // CR: 5..8
     sx127x_set_preamble(&radio, 8); // 6..65535 (8 by default)
+#ifdef RX_DUTY
+    sx127x_set_preamble(&radio, RX_DUTY); // long preamble for duty cycle
+#endif
     sx127x_set_sw(&radio, 0x12);    // SW allways 0x12
     sx127x_impl_hdr(&radio, false); // explicit header
     sx127x_set_ldro(&radio, true);  // Low Datarate Optimize
@@ -188,6 +780,11 @@ int main()
       sx127x_set_bw(&radio, 500000); // BW: 78000...500000 Hz
       sx127x_set_sf(&radio, 11);     // SF: 6...12
     }
+#ifdef FHSS
+    // hop on `FhssChangeChannel` IRQ (DIO2 by default mapping)
+    sx127x_set_hop_period(&radio, FHSS); // [symbols]
+    sx127x_fhss_table(&radio, hop_freq, sizeof(hop_freq) / sizeof(u32_t));
+#endif
   }
   else
   { // FSK/OOK settings
@@ -200,6 +797,9 @@ int main()
     sx127x_set_dcfree( &radio, 0);     // 0=Off, 1=Manchester, 2=Whitening
   }
 
+  retv = sx127x_batch_commit(&radio);
+  printf(">>> sx127x_batch_commit() return %d\n", retv);
+
   // get RF frequency [Hz]
   freq = sx127x_get_frequency(&radio);
   printf(">>> sx127x_get_frequency() return %lu Hz\n", freq);
@@ -218,6 +818,14 @@ int main()
   // preapre to run one of demo application
   if (demo_mode == 0)
   { // transmitter
+#ifdef STREAM_SIZE
+    for (retv = 0; retv < STREAM_SIZE; retv++)
+      stream_buf[retv] = (u8_t) retv; // test pattern
+#endif
+#if defined(ASYNC_TX) && defined(LBT)
+    // check channel by CAD (LoRa) or RSSI (FSK/OOK) before each frame
+    radio_lbt(&board, true, LBT, -90);
+#endif
     // UNSET callback on receive packet (Lora/FSK/OOK)
     //sx127x_on_receive(&radio, NULL, NULL); // FIXME
   }
@@ -225,35 +833,102 @@ int main()
   { // receiver
     // set !!!AGAIN!!! callback on receive packet (Lora/FSK/OOK)
     sx127x_on_receive(&radio, on_receive, NULL);
+
+    // set callback on receive packet with metadata (used instead)
+    sx127x_on_receive_ex(&radio, on_receive_ex, NULL);
+#ifdef RX_QUEUE
+    // put frames to RX ring, consume them by other thread
+    radio_rxq_on(&board, true);
+    vsthread_create(0, SCHED_OTHER, &rxq_thread, rxq_thread_fn, NULL);
+#endif
+#ifdef SX127X_USE_DIO
+    // signal `ValidHeader` (LoRa) or `PreambleDetect` (FSK/OOK) by DIO line
+    sx127x_on_event(&radio, on_event, NULL);
+    if (sx127x_is_lora(&radio))
+      sx127x_dio_map(&radio, 3, SX127X_EV_VALID_HEADER);
+    else
+      sx127x_dio_map(&radio, 4, SX127X_EV_PREAMBLE_DETECT);
+#endif
+#ifdef ADR
+    // choose BW/SF/power by SNR of received frames (LoRa)
+    if (sx127x_is_lora(&radio))
+      sx127x_adr(&radio, true, ADR, 17);
+#endif
     // go to receive mode
 #ifdef FIXED
     sx127x_receive(&radio, 6); // 6=size("Hello!")
 #else
     sx127x_receive(&radio, 0); // explicit header or variable packet length
+#endif
+#ifdef RX_DUTY
+    // sleep and open short RX windows by timer (LoRa)
+    if (sx127x_is_lora(&radio))
+      radio_rx_duty(&board, true, 0);
+#endif
+#ifdef STREAM_SIZE
+    if (!sx127x_is_lora(&radio))
+    { // receive long packet by FIFO streaming
+      sx127x_on_receive_long(&radio, on_receive_long, NULL);
+      sx127x_receive_long(&radio, stream_buf, STREAM_SIZE, false);
+    }
 #endif
   }
   else if (demo_mode == 2)
-  { // morse beeper
+  { // OOK bit streaming
     sx127x_continuous(&radio, true); // switch to continuous mode
     //sx127x_set_fast_hop(&radio, true); // FIXME
   }
+  else if (demo_mode == 3)
+  { // SPI benchmark
+    benchmark();
+    benchmark_cs();
+    benchmark_retune();
+    radio_free(&board);
+    return EXIT_SUCCESS;
+  }
+  else if (demo_mode == 4)
+  { // RSSI sweep: RX BW matches step, IRQ thread hops by timer
+    sx127x_set_rx_bw(&radio, SWEEP_STEP / 2);
+    radio_sweep(&board, true, SWEEP_FREQ, SWEEP_STEP, SWEEP_BINS);
+  }
 
   // setup timer
   retv = stimer_init(&timer, timer_handler, (void*) NULL);
   printf(">>> stimer_init() return %d\n", retv);
   if (retv != 0) exit(EXIT_FAILURE);
 
+  if (demo_mode == 0)
+  { // transmitter: timer interval by time on air of frames per tick
+    int size = strlen("Hello!"), frames = 1;
+    u32_t airtime_ms;
+#ifdef ASYNC_TX
+    frames = ASYNC_TX;
+#endif
+#ifdef STREAM_SIZE
+    if (!sx127x_is_lora(&radio)) size = STREAM_SIZE;
+#endif
+    airtime_ms = sx127x_airtime_ms(&radio, size);
+    printf(">>> sx127x_airtime_us(%d) return %lu\n",
+           size, (unsigned long) sx127x_airtime_us(&radio, size));
+    interval = SX127X_MAX(interval, 2 * airtime_ms * frames);
+  }
+
   // run periodic timer
-  retv = stimer_start(&timer, (double) TIMER_INTERVAL);
-  printf(">>> stimer_start(%f) return %d\n", (double) TIMER_INTERVAL, retv);
+  retv = stimer_start(&timer, (double) interval);
+  printf(">>> stimer_start(%f) return %d\n", (double) interval, retv);
   if (retv != 0) exit(EXIT_FAILURE);
 
   // run timer loop ()
   retv = stimer_loop(&timer);
   printf(">>> stimer_loop() return %i\n", retv);
 
+#ifdef RX_QUEUE
+  if (demo_mode == 1)
+    vsthread_join(rxq_thread, NULL);
+#endif
+
   // free SX127x radio module
-  radio_free();
+  radio_free(&board);
 
   return EXIT_SUCCESS;
 }